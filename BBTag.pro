@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -13,6 +13,9 @@ TEMPLATE = app
 
 INCLUDEPATH += ./include
 
+# zlib inflates the deflated members of zip archives
+LIBS += -lz
+
 SOURCES += \
     src/ui/main.cpp \
     src/core/tag_model.cpp \
@@ -20,7 +23,24 @@ SOURCES += \
     src/ui/main_window.cpp \
     src/ui/tag_viewer.cpp \
     src/ui/tag_scroll_view.cpp \
-    src/core/tag_io.cpp
+    src/core/tag_io.cpp \
+    src/core/image_codec.cpp \
+    src/core/tar_writer.cpp \
+    src/core/io_locality.cpp \
+    src/core/tag_painter.cpp \
+    src/core/json_reader.cpp \
+    src/core/image_archive.cpp \
+    src/core/thumbnail_cache.cpp \
+    src/ui/lazy_list.cpp \
+    src/ui/thumbnail_grid.cpp \
+    src/core/crop_loader.cpp \
+    src/ui/crop_gallery.cpp \
+    src/core/image_metadata.cpp \
+    src/core/image_loader.cpp \
+    src/core/tile_pyramid.cpp \
+    src/core/box_index.cpp \
+    src/core/display_adjustment.cpp \
+    src/ui/display_adjustment_panel.cpp
 
 HEADERS  += \
     include/core/tag_model.h \
@@ -28,7 +48,24 @@ HEADERS  += \
     include/ui/main_window.h \
     include/ui/tag_viewer.h \
     include/ui/tag_scroll_view.h \
-    include/core/tag_io.h
+    include/core/tag_io.h \
+    include/core/image_codec.h \
+    include/core/tar_writer.h \
+    include/core/io_locality.h \
+    include/core/tag_painter.h \
+    include/core/json_reader.h \
+    include/core/image_archive.h \
+    include/core/thumbnail_cache.h \
+    include/ui/lazy_list.h \
+    include/ui/thumbnail_grid.h \
+    include/core/crop_loader.h \
+    include/ui/crop_gallery.h \
+    include/core/image_metadata.h \
+    include/core/image_loader.h \
+    include/core/tile_pyramid.h \
+    include/core/box_index.h \
+    include/core/display_adjustment.h \
+    include/ui/display_adjustment_panel.h
 
 RESOURCES += resources/pixmaps_list.qrc
 
@@ -0,0 +1,131 @@
+#ifndef BOX_INDEX_H
+#define BOX_INDEX_H
+
+#include <QHash>
+#include <QVector>
+#include <QRect>
+#include <QString>
+
+// spatial index of the labeled boxes of an image
+// boxes are put in the cells of a uniform grid (image coordinates)
+// they overlap so that picking a box among thousands
+// only visits the boxes around the picked point
+// boxes are inserted and removed one by one as the image is tagged
+class BoxIndex
+{
+public:
+    // box found by the queries
+    struct Box {
+        QString _label;
+        QRect _bbox;
+    };
+
+public:
+    BoxIndex();
+
+    virtual ~BoxIndex();
+
+    // removes all the boxes
+    // the grid cells are sized for the given image
+    void reset(
+        const QSize& image_size
+    );
+
+    void insert(
+        const QString& label,
+        const QRect& bbox
+    );
+
+    // removes one box of this label and rectangle
+    // returns false if there is none
+    bool remove(
+        const QString& label,
+        const QRect& bbox
+    );
+
+    // returns the number of boxes
+    inline int count() const;
+
+    // finds the box closest to the point (see squared_distance)
+    // among the boxes closer than max_squared_distance
+    // the smallest box wins among equally close boxes (e.g. nested boxes)
+    // returns false if there is none
+    bool nearest(
+        const QPoint& p,
+        int max_squared_distance,
+        Box& found
+    ) const;
+
+    // finds the smallest box containing the point
+    // returns false if there is none
+    bool box_at(
+        const QPoint& p,
+        Box& found
+    ) const;
+
+    // returns the squared distance from the point to the rectangle
+    // (0 inside the rectangle)
+    static int squared_distance(
+        const QPoint& p,
+        const QRect& rect
+    );
+
+protected:
+    // returns the cells covering the rectangle
+    // (columns and rows of the grid)
+    QRect cell_range(
+        const QRect& rect
+    ) const;
+
+    // returns true if the box covers too many cells
+    // to be put in each of them
+    static bool is_large(
+        const QRect& cells
+    );
+
+    // returns the indices of the boxes (in entries_) which may intersect the rectangle
+    // a box may be listed several times
+    QVector<int> candidates(
+        const QRect& rect
+    ) const;
+
+    static inline qint64 cell_key(
+        int col,
+        int row
+    );
+
+private:
+    struct Entry {
+        QString _label;
+        QRect _bbox;
+        bool _used;
+    };
+
+    int cell_size_;
+
+    // entries of removed boxes are reused
+    QVector<Entry> entries_;
+    QVector<int> free_entries_;
+    int count_;
+
+    QHash<qint64, QVector<int> > cells_;
+    QVector<int> large_entries_;
+};
+
+
+/************************* inline *************************/
+
+int BoxIndex::count() const
+{
+    return count_;
+}
+
+qint64 BoxIndex::cell_key(
+        int col,
+        int row
+    )
+{
+    return ( qint64( col ) << 32 ) | quint32( row );
+}
+
+#endif // BOX_INDEX_H
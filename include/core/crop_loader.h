@@ -0,0 +1,70 @@
+#ifndef CROP_LOADER_H
+#define CROP_LOADER_H
+
+#include <QObject>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+// decodes the content of bounding boxes in the background
+// crops are decoded with region decoding (only the box is decoded
+// by the formats supporting it) and scaled to fit a square tile
+class CropLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    // crop to decode
+    struct Request {
+        QString _fullpath;
+        QRect _bbox;
+    };
+
+public:
+    CropLoader(
+        QObject* parent = 0
+    );
+
+    // cancels and waits for the background decoding
+    virtual ~CropLoader();
+
+    // decodes the box of the image scaled to fit in a side x side square
+    // returns a null image if the image cannot be decoded
+    static QImage crop(
+        const QString& fullpath,
+        const QRect& bbox,
+        int side
+    );
+
+    // queues the crops for background decoding
+    // queued crops of a higher priority are decoded first
+    // crop_ready is emitted for every decoded crop
+    void request(
+        const QList<Request>& requests,
+        int side,
+        int priority = 0
+    );
+
+    // drops the queued requests
+    // crops being decoded are not reported
+    void cancel();
+
+signals:
+    // emitted (from a worker thread) when the crop is decoded
+    void crop_ready(
+        const QString& fullpath,
+        const QRect& bbox,
+        const QImage& crop
+    );
+
+private:
+    friend class CropTask;
+
+    QThreadPool pool_;
+    QAtomicInt generation_;
+};
+
+
+#endif // CROP_LOADER_H
@@ -0,0 +1,76 @@
+#ifndef DISPLAY_ADJUSTMENT_H
+#define DISPLAY_ADJUSTMENT_H
+
+#include <QImage>
+
+// display-only tone adjustment of the viewed image
+// (e.g. for annotating dark night-time frames)
+// the adjustment is turned into one 8-bit lookup table per channel
+// which is applied to the displayed pixels only: images files
+// and decoded images are never modified
+class DisplayAdjustment
+{
+public:
+    enum Channel {
+        RED = 0,
+        GREEN,
+        BLUE,
+        CHANNEL_COUNT
+    };
+
+    // lookup tables of the 8-bit values of each channel
+    struct Luts {
+        uchar _channel[CHANNEL_COUNT][256];
+    };
+
+public:
+    // no adjustment
+    DisplayAdjustment();
+
+    // returns true if the adjustment leaves the pixels unchanged
+    bool is_identity() const;
+
+    bool operator == ( const DisplayAdjustment& other ) const;
+    inline bool operator != ( const DisplayAdjustment& other ) const;
+
+    // sets the levels of each channel so that the darkest and brightest
+    // clip_fraction of the pixels of the image are saturated
+    // (the other parameters are left unchanged)
+    // large images are subsampled
+    void auto_stretch(
+        const QImage& image,
+        float clip_fraction = 0.005f
+    );
+
+    // returns the lookup tables applying, in this order:
+    // levels, gamma, contrast (around mid gray) and brightness
+    Luts make_luts() const;
+
+    // applies the lookup tables to the pixels of the image (in place)
+    // the image is converted to RGB32 first if needed
+    static void apply(
+        const Luts& luts,
+        QImage& image
+    );
+
+public:
+    float _brightness; // -1 (black) to 1 (white), 0 is unchanged
+    float _contrast;   // -1 (flat gray) to 1 (maximum), 0 is unchanged
+    float _gamma;      // 1 is unchanged, greater brightens the midtones
+
+    // levels: values mapped to black and white per channel
+    int _black[CHANNEL_COUNT];
+    int _white[CHANNEL_COUNT];
+};
+
+
+/************************* inline *************************/
+
+bool DisplayAdjustment::operator != (
+        const DisplayAdjustment& other
+    ) const
+{
+    return !( *this == other );
+}
+
+#endif // DISPLAY_ADJUSTMENT_H
@@ -0,0 +1,162 @@
+#ifndef IMAGE_ARCHIVE_H
+#define IMAGE_ARCHIVE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QFile>
+#include <QSharedPointer>
+
+// read access to the images stored in zip and tar archives
+// without extracting them
+// archive members are addressed by paths such as
+// /data/set.tar!/dir/img.jpg (archive path, separator, member name)
+// the index of an archive is built once, kept for the session and
+// persisted in the application cache (reused while the archive
+// size and modification time are unchanged)
+// an object holds the data of a single member (or of its start):
+// - stored members are memory mapped (only the pages read are loaded)
+// - deflated (zip) members are inflated in memory
+class ImageArchive
+{
+public:
+    // separates the archive path from the member name
+    static const QString SEPARATOR;
+
+public:
+    // opens the member given by its archive path
+    // max_size (optional) limits the data to the start of the member
+    // (header probes): deflated members are only inflated that far
+    // data() is empty if the member cannot be read
+    ImageArchive(
+        const QString& path,
+        qint64 max_size = -1
+    );
+
+    // unmaps the member
+    virtual ~ImageArchive();
+
+    // returns true if the member data is available
+    inline bool is_open() const;
+
+    // returns the member data
+    // (only valid as long as the object exists)
+    inline const QByteArray& data() const;
+
+    // returns true if the path points inside an archive
+    static bool is_member_path(
+        const QString& path
+    );
+
+    // returns true if the file is a supported archive (by suffix)
+    static bool is_archive(
+        const QString& path
+    );
+
+    // returns the name filters of the supported archives
+    static QStringList name_filters();
+
+    // returns true if the archive member exists
+    static bool contains(
+        const QString& path
+    );
+
+    // returns the offset of the member in the archive
+    // (used to read members in archive order)
+    // returns -1 if the member does not exist
+    static qint64 member_offset(
+        const QString& path
+    );
+
+    // returns the paths of the regular file members
+    // of the archive whose name matches one of the filters
+    static QStringList list_members(
+        const QString& archive_path,
+        const QStringList& name_filters
+    );
+
+protected:
+    // location of a member in the archive
+    struct Entry {
+        qint64 _offset;       // data offset (local header offset for zip)
+        qint64 _size;         // uncompressed size
+        qint64 _packed_size;  // size in the archive
+        int _method;          // 0: stored, 8: deflated
+        bool _local_header;   // _offset points to a zip local header
+    };
+
+    // member name -> location
+    typedef QHash<QString, Entry> Index;
+
+    // splits an archive path into the archive file and member name
+    static bool split_path(
+        const QString& path,
+        QString& archive_path,
+        QString& member
+    );
+
+    // returns the cached index of the archive
+    // the index is (re)built if the archive changed since it was cached
+    // returns null if the archive cannot be read
+    static QSharedPointer<const Index> index(
+        const QString& archive_path
+    );
+
+    // returns the file of the persisted index of the archive
+    static QString index_path(
+        const QString& archive_path
+    );
+
+    // reads the persisted index of the archive
+    // returns false if there is none or if it does not match
+    // the size and modification time of the archive
+    static bool load_index(
+        const QString& archive_path,
+        qint64 size,
+        qint64 mtime,
+        Index& index
+    );
+
+    // persists the index of the archive
+    // returns false if it cannot be written
+    static bool save_index(
+        const QString& archive_path,
+        qint64 size,
+        qint64 mtime,
+        const Index& index
+    );
+
+    // lists the members of a tar archive (ustar, GNU and pax names)
+    static bool build_tar_index(
+        QFile& file,
+        Index& index
+    );
+
+    // lists the members of a zip archive from its central directory
+    // (zip64 archives included)
+    static bool build_zip_index(
+        QFile& file,
+        Index& index
+    );
+
+private:
+    QFile file_;
+    uchar* map_;
+    QByteArray data_;
+};
+
+
+/************************* inline *************************/
+
+bool ImageArchive::is_open() const
+{
+    return !data_.isEmpty();
+}
+
+const QByteArray& ImageArchive::data() const
+{
+    return data_;
+}
+
+#endif // IMAGE_ARCHIVE_H
@@ -0,0 +1,107 @@
+#ifndef IMAGE_CODEC_H
+#define IMAGE_CODEC_H
+
+#include <QImage>
+#include <QString>
+#include <QByteArray>
+
+class QIODevice;
+class QImageReader;
+
+// reading and encoding of the images
+// it reads image files and archive members (headers or pixels)
+// through the Qt image readers, and wraps the Qt image writers
+// with tunable encoder parameters for the exporters
+// and the formats Qt does not have (QOI)
+class ImageCodec
+{
+public:
+    // output format of the encoded images
+    enum Format {
+        SOURCE_FORMAT = 0, // same format as the source image file
+        PNG,
+        JPEG,
+        PPM, // uncompressed binary PPM (RGB, grayscale images included)
+        QOI  // "Quite OK Image" format: lossless and very fast
+    };
+
+    // encoder parameters
+    // negative values let the encoder pick its default
+    struct Options {
+        Options();
+
+        Format _format;
+        int _png_compression; // zlib level: 0 (fastest) to 9 (smallest)
+        int _jpeg_quality;    // 0 to 100
+        bool _jpeg_optimize;  // extra Huffman pass: smaller but slower
+    };
+
+public:
+    // returns the size of the image read from the file header
+    // (the image is not decoded), archive members are supported:
+    // only the start of the member is read (or inflated)
+    // returns an invalid size if the file cannot be read
+    static QSize probe_size(
+        const QString& path
+    );
+
+    // returns the number of color channels of the image read from
+    // the file header: 1 for grayscale images, 3 otherwise
+    // (alpha is not counted)
+    static int probe_channels(
+        const QString& path
+    );
+
+    // returns true if the decoder of the image can decode
+    // a region without decoding the whole image (e.g. JPEG)
+    // the decoder is picked from the suffix for archive members
+    // so that their data is not read (cheap on the interface thread)
+    static bool supports_region_decoding(
+        const QString& path
+    );
+
+    // decodes the image file (or archive member, see ImageArchive)
+    // clip (optional) restricts decoding to a region of the image
+    // scaled_size (optional) is the size of the decoded image (or region):
+    // decoders supporting it (e.g. JPEG) directly decode at reduced size
+    // other formats are decoded then smoothly scaled
+    static QImage read(
+        const QString& path,
+        const QSize& scaled_size = QSize(),
+        const QRect& clip = QRect()
+    );
+
+    // decodes the image of the given reader
+    // (see read above for the optional parameters)
+    static QImage read(
+        QImageReader& reader,
+        const QSize& scaled_size,
+        const QRect& clip
+    );
+
+    // returns the file suffix (without dot) used for the given options
+    // source_path is only used when the source format is kept
+    static QString suffix(
+        const Options& options,
+        const QString& source_path
+    );
+
+    // encodes the image into the given device
+    // returns false if the image could not be encoded
+    static bool encode(
+        QIODevice* out,
+        const QImage& image,
+        const Options& options,
+        const QString& source_path
+    );
+
+    // encodes the image as QOI into the given device
+    // see https://qoiformat.org/qoi-specification.pdf
+    static bool encode_qoi(
+        QIODevice* out,
+        const QImage& image
+    );
+};
+
+
+#endif // IMAGE_CODEC_H
@@ -0,0 +1,171 @@
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include <QObject>
+#include <QImage>
+#include <QStringList>
+#include <QCache>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+
+// decodes images on worker threads for the viewer
+// images are first decoded at display resolution (decoders supporting it,
+// e.g. JPEG, directly decode at reduced size) and at full resolution on demand
+// decoded images are kept in a memory-bounded LRU cache
+// so that stepping back and forth through images does not decode them again
+// the cache is only accessed from the interface thread
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    // max_cost is the memory of the cached images (in KB)
+    ImageLoader(
+        int max_cost = 512 * 1024,
+        QObject* parent = 0
+    );
+
+    // waits for the decoding in progress
+    virtual ~ImageLoader();
+
+    // gets the cached image (at the best resolution decoded so far)
+    // and the size of the full resolution image, then counts a hit
+    // (image is null if it could not be decoded)
+    // returns false and counts a miss if it is not cached
+    bool cached(
+        const QString& path,
+        QImage& image,
+        QSize& full_size
+    );
+
+    // decodes the image in the background (if not cached)
+    // then the neighbors (e.g. next and previous images)
+    // images are decoded to fit in display_size (never enlarged)
+    // an invalid display_size decodes at full resolution
+    // images of a previous call not decoded yet are dropped
+    // image_ready is emitted for every decoded image
+    void load(
+        const QString& path,
+        const QStringList& neighbors,
+        const QSize& display_size
+    );
+
+    // decodes the image at full resolution in the background
+    // (if not cached at full resolution)
+    // image_ready is emitted when it is decoded
+    void load_full_resolution(
+        const QString& path
+    );
+
+    // cache lookups since the loader creation
+    inline int hit_count() const;
+    inline int miss_count() const;
+
+    // returns the memory of the cached images (in KB)
+    inline int cost() const;
+
+signals:
+    // emitted (in the interface thread) when the image is cached
+    void image_ready(
+        const QString& path
+    );
+
+    // emitted by the workers (internal)
+    // display_size is the one of the request
+    void decoded(
+        const QString& path,
+        const QSize& display_size,
+        const QImage& image,
+        const QSize& full_size
+    );
+
+protected slots:
+    // caches the image decoded by a worker
+    void add_image(
+        const QString& path,
+        const QSize& display_size,
+        const QImage& image,
+        const QSize& full_size
+    );
+
+protected:
+    // decoded image and size of the full resolution image
+    struct CachedImage {
+        QImage _image;
+        QSize _full_size;
+
+        inline bool is_full_resolution() const;
+    };
+
+    // queues the decoding of the image if needed
+    void enqueue(
+        const QString& path,
+        const QSize& display_size,
+        int priority
+    );
+
+    // returns the key of a request in the wanted and in flight sets
+    static QString request_key(
+        const QString& path,
+        const QSize& display_size
+    );
+
+    // returns true if the request is still wanted
+    // called by the workers before decoding
+    // if not, the request is no longer considered in flight
+    bool take(
+        const QString& key
+    );
+
+    // stores a decoded image
+    // (or keeps it aside if it is too large for the cache)
+    void store(
+        const QString& path,
+        const CachedImage& cached_image
+    );
+
+private:
+    friend class ImageLoadTask;
+
+    QCache<QString, CachedImage> images_;
+    int hits_;
+    int misses_;
+
+    // last image too large for the cache
+    QString oversized_path_;
+    CachedImage oversized_;
+
+    // requests of the last calls to load and load_full_resolution
+    // and requests queued or being decoded
+    QMutex mutex_;
+    QSet<QString> wanted_;
+    QSet<QString> in_flight_;
+
+    QThreadPool pool_;
+};
+
+
+/************************* inline *************************/
+
+int ImageLoader::hit_count() const
+{
+    return hits_;
+}
+
+int ImageLoader::miss_count() const
+{
+    return misses_;
+}
+
+int ImageLoader::cost() const
+{
+    return images_.totalCost();
+}
+
+bool ImageLoader::CachedImage::is_full_resolution() const
+{
+    return _image.isNull() || _image.size() == _full_size;
+}
+
+#endif // IMAGE_LOADER_H
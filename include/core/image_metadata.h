@@ -0,0 +1,91 @@
+#ifndef IMAGE_METADATA_H
+#define IMAGE_METADATA_H
+
+#include <QString>
+#include <QStringList>
+#include <QSize>
+
+class QProgressDialog;
+
+// process-wide store of image metadata keyed by path:
+// file size and modification time (of the archive for archive members)
+// and pixel dimensions (probed from the header)
+// the store is saved as a sidecar file next to the tag XML file
+// so that reopening a session needs no per-file decoding
+// entries are invalidated when the file size or modification time changes
+// all functions are thread-safe
+class ImageMetadata
+{
+public:
+    struct Entry {
+        Entry();
+
+        qint64 _file_size;
+        qint64 _mtime;      // in ms since epoch
+        QSize _size;        // pixel dimensions
+    };
+
+public:
+    // returns the sidecar file of the given tag XML file
+    static QString sidecar_path(
+        const QString& filename
+    );
+
+    // merges the entries of the sidecar file into the store
+    // entries are trusted until validated by refresh
+    // returns false if the file cannot be read
+    static bool load(
+        const QString& sidecar
+    );
+
+    // writes the entries of the given paths to the sidecar file
+    // returns false if the file cannot be written
+    static bool save(
+        const QString& sidecar,
+        const QStringList& paths
+    );
+
+    // validates the entries of the given paths with parallel stats
+    // new or changed files are probed (header only)
+    // returns the paths that exist
+    // changed (optional) is the number of entries probed again
+    // progress (optional) is kept updated from the calling thread
+    // until every path is checked: canceling it leaves the entries
+    // of the paths not checked yet as they are
+    static QStringList refresh(
+        const QStringList& paths,
+        int* changed = 0,
+        QProgressDialog* progress = 0
+    );
+
+    // returns true if the path was validated by refresh or probed
+    // in this session, i.e. the file is known to exist
+    static bool is_valid(
+        const QString& path
+    );
+
+    // returns the pixel dimensions of the image
+    // probes (and stores) them if the path is not valid yet
+    // returns an invalid size if the file cannot be read
+    static QSize image_size(
+        const QString& path
+    );
+
+    // reads the file size and modification time of the path
+    // and probes its dimensions
+    // returns false if the file does not exist
+    static bool probe(
+        const QString& path,
+        Entry& entry
+    );
+
+    // returns true if the entry matches the file size
+    // and modification time of the path
+    static bool is_up_to_date(
+        const QString& path,
+        const Entry& entry
+    );
+};
+
+
+#endif // IMAGE_METADATA_H
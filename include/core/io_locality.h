@@ -0,0 +1,36 @@
+#ifndef IO_LOCALITY_H
+#define IO_LOCALITY_H
+
+#include <QStringList>
+
+class QProgressDialog;
+
+// helpers for reading many files from slow storage
+// (spinning disks, network file systems) in an order
+// that follows their location on disk
+class IOLocality
+{
+public:
+    // returns the paths sorted by directory, then by physical location:
+    // - offset of the first extent if the file system reports it (Linux)
+    // - inode number otherwise (Unix)
+    // - file name on other platforms
+    // archive members are sorted by archive, then by offset
+    // progress (optional) is kept updated from the calling thread
+    // while the files are looked up: canceling it returns the paths
+    // in their given order
+    static QStringList sort_by_locality(
+        const QStringList& paths,
+        QProgressDialog* progress = 0
+    );
+
+    // hints the system that the given files are about to be read
+    // so that they are read ahead while other files are processed
+    // does nothing on platforms without posix_fadvise
+    static void will_need(
+        const QStringList& paths
+    );
+};
+
+
+#endif // IO_LOCALITY_H
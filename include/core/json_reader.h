@@ -0,0 +1,145 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+// pull parser of JSON documents
+// tokens are read one by one from the device through a fixed size buffer
+// so that documents larger than memory can be read without building a tree
+// the parser is lenient: separators are not validated
+class JsonReader
+{
+public:
+    enum Token {
+        BEGIN_OBJECT = 0,
+        END_OBJECT,
+        BEGIN_ARRAY,
+        END_ARRAY,
+        KEY,        // object member name
+        STRING,
+        NUMBER,
+        BOOLEAN,
+        NULL_VALUE,
+        END,        // end of the document
+        INVALID     // syntax or read error
+    };
+
+public:
+    // the device must be open for reading
+    // it is not owned by the reader
+    JsonReader(
+        QIODevice* in
+    );
+
+    virtual ~JsonReader();
+
+    // reads the next token
+    Token next();
+
+    // skips the value following a KEY (or the current BEGIN_* token
+    // if skip_current is on) including all its nested values
+    // returns false if the document is invalid
+    bool skip_value(
+        bool skip_current = false
+    );
+
+    // returns the UTF-8 text of the last KEY or STRING token
+    // (escape sequences already decoded)
+    inline const QByteArray& utf8() const;
+
+    // returns the text of the last KEY or STRING token
+    inline QString string() const;
+
+    // returns the value of the last NUMBER token
+    inline double number() const;
+
+    // returns the value of the last BOOLEAN token
+    inline bool boolean() const;
+
+    // returns the number of bytes consumed so far
+    inline qint64 position() const;
+
+protected:
+    // returns the next byte without consuming it
+    // returns -1 at the end of the device
+    inline int peek();
+
+    // refills the buffer from the device
+    // returns false at the end of the device
+    bool fill();
+
+    // reads the string after its opening quote
+    bool read_string();
+
+    // reads the 4 hexadecimal digits of a \u escape sequence
+    bool read_code_unit(
+        uint& code
+    );
+
+    // reads a number starting with the given byte
+    bool read_number(
+        char first
+    );
+
+    // reads a true/false/null literal starting with the given byte
+    Token read_literal(
+        char first
+    );
+
+private:
+    QIODevice* in_;
+    QByteArray buffer_;
+    int pos_;
+    qint64 consumed_;
+
+    // open containers: 'o' for objects, 'a' for arrays
+    QVector<char> stack_;
+    bool expect_key_;
+
+    QByteArray text_;
+    double number_;
+    bool boolean_;
+};
+
+
+/************************* inline *************************/
+
+const QByteArray& JsonReader::utf8() const
+{
+    return text_;
+}
+
+QString JsonReader::string() const
+{
+    return QString::fromUtf8( text_ );
+}
+
+double JsonReader::number() const
+{
+    return number_;
+}
+
+bool JsonReader::boolean() const
+{
+    return boolean_;
+}
+
+qint64 JsonReader::position() const
+{
+    return consumed_ + pos_;
+}
+
+int JsonReader::peek()
+{
+    if( pos_ >= buffer_.size() && !fill() ) {
+        return -1;
+    }
+
+    return (unsigned char)buffer_.at( pos_ );
+}
+
+#endif // JSON_READER_H
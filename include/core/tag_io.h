@@ -2,9 +2,13 @@
 #define TAG_IO_H
 
 #include <core/tag_item.h>
+#include <core/image_codec.h>
 
 #include <QIODevice>
 #include <QDir>
+#include <QModelIndex>
+
+class TagModel;
 
 // class for writing/reading XML files
 // containing tag information
@@ -27,6 +31,32 @@ public:
     static const QString WIDTH;
     static const QString HEIGHT;
 
+public:
+    // layout of the cropped images on disk
+    enum CropLayout {
+        LABEL_FOLDERS = 0, // one image file per crop in one folder per label
+        TAR_SHARDS,        // crops and annotations packed into tar shards
+        NPY_TENSOR         // fixed size crops stored in a single NumPy array
+    };
+
+    // annotation formats of the training frameworks
+    enum AnnotationFormat {
+        COCO_JSON = 0, // single JSON file with all images and annotations
+        PASCAL_VOC,    // one XML file per image
+        YOLO_TXT       // one text file per image with normalized coordinates
+    };
+
+    // statistics gathered while exporting
+    // used for reporting the export throughput
+    struct ExportStats {
+        ExportStats();
+
+        int _images;      // number of source images decoded
+        int _files;       // number of files written
+        qint64 _bytes;    // number of bytes written
+        qint64 _elapsed;  // duration of the export in ms
+    };
+
 public:
     // write to XML file the given elements
     // label colors (optional) are provided by tag_color_dict
@@ -45,9 +75,166 @@ public:
         QHash< QString, QList<TagItem::Elements> >& elts
     );
 
+    // read a COCO instances JSON file
+    // categories become labels and annotations become boxes
+    // annotations with a score below min_score are dropped
+    // (detector outputs, annotations without score are always kept)
+    // images without annotation are listed without element
+    // the file is parsed as a stream: no document tree is built
+    static bool read_coco(
+        QIODevice* in,
+        const QString& relative_dir,
+        double min_score,
+        QHash< QString, QList<TagItem::Elements> >& elts
+    );
+
+    // read a directory (and its sub-directories) of per-image
+    // annotation files: Pascal VOC (.xml) or YOLO (.txt) format
+    // each file is paired with the image listed in index.tsv (BBTag export),
+    // or else with the image of the same name in the same directory
+    // (or in the images directory next to a labels directory),
+    // or else with the image named in the VOC file
+    // YOLO files without such an image are ignored (other text files)
+    // YOLO class names are read from classes.txt or obj.names if any
+    // and coordinates are scaled by the image size read from its header
+    // files are parsed in parallel in batches
+    static bool read_annotation_dir(
+        const QDir& input_dir,
+        AnnotationFormat format,
+        QHash< QString, QList<TagItem::Elements> >& elts
+    );
+
+    // crop the given elements and save one image per bounding box
+    // in one sub-directory per label
+    // crops are encoded with the given options
+    // stats (optional) are filled with the export throughput
     static void write_images(
         const QDir& output_dir,
-        const QHash< QString, QList<TagItem::Elements> >& elts
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        const ImageCodec::Options& options = ImageCodec::Options(),
+        ExportStats* stats = 0
+    );
+
+    // crop the given elements and pack them with their annotations
+    // into tar shards of at most shard_size bytes (webdataset layout):
+    // - <key>.<ext> for the cropped image
+    // - <key>.json for its label, bounding box and source image
+    // an index.tsv file gives the shard and offset of every crop
+    // shards are written in parallel: each worker fills its own sequence
+    // of shards, so the last shard of each worker can be short
+    static void write_shards(
+        const QDir& output_dir,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        qint64 shard_size,
+        const ImageCodec::Options& options = ImageCodec::Options(),
+        ExportStats* stats = 0
+    );
+
+    // crop the given elements, resample each crop to side x side pixels
+    // (aspect ratio is not kept) with 1 (gray) or 3 (RGB) channels
+    // and store them in a preallocated NumPy file crops.npy:
+    // uint8 array of shape (crop count, side, side, channels)
+    // labels.npy is the parallel int32 array of label indices (-1 if the
+    // source could not be read), labels.txt gives one label name per index
+    // and crops.tsv gives the source image and bounding box of every crop
+    // both arrays can be loaded with np.load( ..., mmap_mode='r' )
+    // crops are resampled in parallel and written at their known offset
+    static void write_tensor(
+        const QDir& output_dir,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        int side,
+        int channels,
+        ExportStats* stats = 0
+    );
+
+    // resize the source images so that their longest side is at most
+    // longest_side pixels (smaller images are not upscaled), save them
+    // in output_dir and rescale their bounding boxes accordingly
+    // the resized dataset is saved as dataset.xml in output_dir
+    // (image paths relative to output_dir) with the given label colors
+    // images are resized in parallel
+    static void write_resized(
+        const QDir& output_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        int longest_side,
+        const ImageCodec::Options& options = ImageCodec::Options(),
+        ExportStats* stats = 0
+    );
+
+    // cut the source images into tiles of tile_size x tile_size pixels
+    // overlapping by the given number of pixels (the last tile of a row
+    // or column is aligned on the image border) and save them in output_dir
+    // boxes are clipped to each tile and kept only if at least min_visible
+    // (fraction of the box area) is inside the tile
+    // tiles without box are saved only if keep_empty_tiles is on
+    // the tagged tiles are saved as dataset.xml in output_dir
+    // sources are processed in parallel and each is decoded once
+    // (by strips of tiles for very large images with region decoding)
+    // the memory of the images decoded at once is capped
+    static void write_tiles(
+        const QDir& output_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        int tile_size,
+        int overlap,
+        double min_visible,
+        bool keep_empty_tiles,
+        const ImageCodec::Options& options = ImageCodec::Options(),
+        ExportStats* stats = 0
+    );
+
+    // render the tags on the source images the way the viewer does
+    // and save them as JPEG files for review in any image viewer
+    // images are downscaled by scale (at most 1) before rendering
+    // label colors are taken from tag_color_dict when available
+    // images are rendered in parallel
+    static void write_overlays(
+        const QDir& output_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        double scale,
+        int jpeg_quality,
+        ExportStats* stats = 0
+    );
+
+    // write the model elements (selection only if not empty)
+    // as a COCO instances JSON file
+    // category ids are given by the label names in alphabetical order
+    // image sizes are read from the file headers (in parallel)
+    // images and annotations are streamed from the model
+    // images whose size cannot be read are skipped
+    // boxes are clipped to the image
+    // file names are relative to relative_dir (absolute if empty)
+    static void write_coco(
+        QIODevice* out,
+        const QString& relative_dir,
+        const TagModel& model,
+        const QModelIndexList& selection,
+        ExportStats* stats = 0
+    );
+
+    // write the model elements (selection only if not empty)
+    // as one Pascal VOC XML file per image in output_dir
+    // boxes are clipped to the image and flagged as truncated if needed
+    // files are written in parallel and listed in index.tsv
+    static void write_voc(
+        const QDir& output_dir,
+        const TagModel& model,
+        const QModelIndexList& selection,
+        ExportStats* stats = 0
+    );
+
+    // write the model elements (selection only if not empty)
+    // as one YOLO text file per image in output_dir
+    // with coordinates normalized by the image size
+    // classes.txt gives the class names in class index order
+    // files are written in parallel and listed in index.tsv
+    static void write_yolo(
+        const QDir& output_dir,
+        const TagModel& model,
+        const QModelIndexList& selection,
+        ExportStats* stats = 0
     );
 
 };
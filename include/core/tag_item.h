@@ -67,6 +67,14 @@ public:
         const QRect& bbox
     );
 
+    // replaces the bounding box in place
+    // (the box keeps its position in the list)
+    // returns false if the item has no such box
+    inline bool replace_tag(
+        const QRect& bbox,
+        const QRect& new_bbox
+    );
+
     // returns the filename with extension
     inline QString filename() const;
 
@@ -121,6 +129,20 @@ void TagItem::remove_tag(
     bbox_.removeOne( bbox );
 }
 
+bool TagItem::replace_tag(
+        const QRect& bbox,
+        const QRect& new_bbox
+    )
+{
+    int i = bbox_.indexOf( bbox );
+    if( i < 0 ) {
+        return false;
+    }
+
+    bbox_[i] = new_bbox;
+    return true;
+}
+
 QString TagItem::filename() const
 {
     return QFileInfo( fullpath_ ).fileName();
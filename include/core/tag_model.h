@@ -26,6 +26,21 @@ public:
     static QString ALL;
     static QString UNTAGGED;
 
+    // interface for going through the elements image by image
+    // without building the table of all the elements
+    class ElementVisitor
+    {
+    public:
+        virtual ~ElementVisitor() {}
+
+        // called once per tagged image with the elements of all its labels
+        // returns false to stop the visit
+        virtual bool visit(
+            const QString& fullpath,
+            const QList<TagItem::Elements>& elts
+        ) = 0;
+    };
+
 public:
     // does nothing
     TagModel(
@@ -110,12 +125,51 @@ public:
         const QModelIndexList& index_list
     ) const;
 
+    // returns the elements of all the labels of the given image
+    // (excluding UNTAGGED and ALL)
+    QList<TagItem::Elements> get_image_elements(
+        const QString& fullpath
+    ) const;
+
+    // returns the images of the given label index in row order
+    // returns an empty list if index is not a label
+    QStringList get_image_paths(
+        const QModelIndex& label_index
+    ) const;
+
+    // returns the elements of the images of the given label index in row order
+    // returns an empty list if index is not a label
+    QList<TagItem::Elements> get_label_elements(
+        const QModelIndex& label_index
+    ) const;
+
+    // returns the index of the image item under the given label
+    // returns an invalid index if there is no such item
+    QModelIndex get_index(
+        const QString& fullpath,
+        const QString& label
+    );
+
     // if selection is empty, returns all the data as unique table of image file associated to tag item
     // if selection is not empty, returns only the data that is selected
     QHash< QString, QList<TagItem::Elements> > get_all_elements(
         const QModelIndexList& selection
     ) const;
 
+    // calls the visitor for every tagged image
+    // (same selection rules as get_all_elements)
+    // images are always visited in the same order
+    // as long as the model is not modified
+    // returns false if the visitor stopped the visit
+    bool visit_elements(
+        const QModelIndexList& selection,
+        ElementVisitor& visitor
+    ) const;
+
+    // returns the number of images in the model
+    // (upper bound of the number of visited images)
+    inline int image_count() const;
+
     // clears the current model and reinitializes it from the given elements
     // if merge is on, the tree is not cleared first
     void init_from_elements(
@@ -141,6 +195,17 @@ public:
         const QRect& tag
     );
 
+    // replaces the bounding box of the tag in place (moved or resized box)
+    // the tree is left unchanged and the box keeps its position
+    // among the boxes of the image for the label
+    // returns false if there is no such tag
+    bool update_tag(
+        const QString& fullpath,
+        const QString& label,
+        const QRect& tag,
+        const QRect& new_tag
+    );
+
 protected:
     // internal use: adds a new image item in the model
     // and reference the label associated with it
@@ -184,4 +249,9 @@ void TagModel::attach(
     view->setModel( model_ );
 }
 
+int TagModel::image_count() const
+{
+    return image_image_ref_.count();
+}
+
 #endif // TAG_MODEL_H
@@ -0,0 +1,75 @@
+#ifndef TAG_PAINTER_H
+#define TAG_PAINTER_H
+
+#include <QColor>
+#include <QString>
+#include <QList>
+#include <QRect>
+
+class QPainter;
+class QFont;
+class QStaticText;
+
+// draws tags (bounding boxes and label)
+// shared by the viewer and the exporters so that
+// rendered images look like the viewer display
+// painting is thread-safe as long as it targets a QImage
+class TagPainter
+{
+public:
+    // pen width of the bounding boxes
+    static const int PEN_WIDTH;
+
+    // point size of the label text
+    static const int FONT_SIZE;
+
+public:
+    // returns the font used for labels
+    static QFont label_font();
+
+    // sets the font used for labels
+    static void set_label_font(
+        QPainter& p
+    );
+
+    // returns the area painted by draw_tags for a single box
+    // (box, pen and label text) with the given label font
+    static QRect painted_rect(
+        const QFont& font,
+        const QString& label,
+        const QRect& bbox,
+        float scale_factor
+    );
+
+    // draws the bounding boxes scaled by scale_factor
+    // with the label written on top of each box
+    static void draw_tags(
+        QPainter& p,
+        const QColor& color,
+        const QString& label,
+        const QList<QRect>& bbox,
+        float scale_factor
+    );
+
+    // returns the label text laid out once with the label font
+    // for drawing many boxes of the same label (see below)
+    static QStaticText label_text(
+        const QString& label
+    );
+
+    // same as above for boxes in large numbers (e.g. viewer display):
+    // only the boxes painted within clip (in painter coordinates) are drawn,
+    // all at once, and the label is the prepared text of label_text
+    // the painter font must be the label font
+    static void draw_tags(
+        QPainter& p,
+        const QColor& color,
+        const QStaticText& label,
+        const QList<QRect>& bbox,
+        float scale_factor,
+        const QRect& clip
+    );
+};
+
+
+#endif // TAG_PAINTER_H
@@ -0,0 +1,67 @@
+#ifndef TAR_WRITER_H
+#define TAR_WRITER_H
+
+#include <QString>
+#include <QByteArray>
+
+class QIODevice;
+
+// sequential writer of POSIX ustar archives
+// members are appended one after the other
+// so that readers get a single large sequential stream
+class TarWriter
+{
+public:
+    // the device must be open for writing
+    // it is not owned by the writer
+    TarWriter(
+        QIODevice* out
+    );
+
+    virtual ~TarWriter();
+
+    // appends a regular file member with the given name and content
+    // returns the offset of the member data in the archive
+    // returns -1 if the member cannot be written
+    qint64 add_file(
+        const QString& name,
+        const QByteArray& data
+    );
+
+    // moves back to the given size (e.g. the size before a member)
+    // so that the next members overwrite the following ones
+    // the device must be seekable
+    // returns false if the size is past the end or the device cannot seek
+    bool rewind(
+        qint64 size
+    );
+
+    // writes the end of archive marker
+    // no member can be added afterwards
+    bool finish();
+
+    // returns the number of bytes written so far
+    inline qint64 size() const;
+
+protected:
+    // fills the 512-byte ustar header of a member
+    static bool make_header(
+        const QString& name,
+        qint64 data_size,
+        char* header
+    );
+
+private:
+    QIODevice* out_;
+    qint64 pos_;
+};
+
+
+/************************* inline *************************/
+
+qint64 TarWriter::size() const
+{
+    return pos_;
+}
+
+#endif // TAR_WRITER_H
@@ -0,0 +1,105 @@
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <QObject>
+#include <QImage>
+#include <QStringList>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+// persistent thumbnail cache following the freedesktop.org
+// thumbnail specification (shared with the file managers):
+// $XDG_CACHE_HOME/thumbnails/<normal|large>/<md5 of file URI>.png
+// thumbnails of archive members use the same layout in the
+// application cache directory as their URIs are private to BBTag
+// a thumbnail is valid while the image file keeps the
+// modification time and size stored in the PNG text chunks
+// thumbnails are generated by a low priority background pool
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    // thumbnail sizes of the specification
+    static const int NORMAL_SIZE;
+    static const int LARGE_SIZE;
+
+public:
+    ThumbnailCache(
+        QObject* parent = 0
+    );
+
+    // cancels and waits for the background generation
+    virtual ~ThumbnailCache();
+
+    // returns the cached thumbnail if it is up to date
+    // returns a null image otherwise
+    // size is NORMAL_SIZE or LARGE_SIZE
+    static QImage lookup(
+        const QString& path,
+        int size
+    );
+
+    // decodes the image at reduced size and stores its thumbnail
+    // returns a null image if the image cannot be decoded
+    static QImage generate(
+        const QString& path,
+        int size
+    );
+
+    // returns the cached thumbnail or generates it
+    static QImage thumbnail(
+        const QString& path,
+        int size
+    );
+
+    // queues the images for background generation
+    // (thumbnails already cached are skipped)
+    // queued images of a higher priority are handled first
+    // thumbnail_ready is emitted for every available thumbnail
+    void prefetch(
+        const QStringList& paths,
+        int size,
+        int priority = 0
+    );
+
+    // drops the queued generations
+    void cancel();
+
+signals:
+    // emitted (from a worker thread) when the thumbnail is available
+    // the text Thumb::Image::Width/Height gives the size of the image
+    void thumbnail_ready(
+        const QString& path,
+        int size,
+        const QImage& thumb
+    );
+
+protected:
+    // returns the file path of the thumbnail of the image
+    // (in the shared cache for files, in the private one for archive members)
+    static QString thumbnail_path(
+        const QString& path,
+        int size
+    );
+
+    // returns the URI, modification time and size identifying the image
+    // (archive members are identified by their archive)
+    static bool identify(
+        const QString& path,
+        QByteArray& uri,
+        QString& mtime,
+        QString& file_size
+    );
+
+private:
+    friend class ThumbnailTask;
+
+    QThreadPool pool_;
+
+    // bumped to cancel the queued generations
+    QAtomicInt generation_;
+};
+
+
+#endif // THUMBNAIL_CACHE_H
@@ -0,0 +1,193 @@
+#ifndef TILE_PYRAMID_H
+#define TILE_PYRAMID_H
+
+#include <QObject>
+#include <QImage>
+#include <QCache>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+// multi-resolution tiles of a large image decoded on demand
+// level L is the image downscaled by 2^L, cut into TILE_SIZE square tiles
+// tiles are decoded by workers with region decoding when the decoder
+// supports it (only the tile is decoded), otherwise a whole level
+// is decoded once and kept, and the displayed tiles are cut from it
+// (only the levels fitting in half of the cache are used then)
+// decoded tiles are kept in a memory-bounded LRU cache
+// the cache is only accessed from the interface thread
+class TilePyramid : public QObject
+{
+    Q_OBJECT
+
+public:
+    // side of the tiles (in level pixels)
+    static const int TILE_SIZE;
+
+public:
+    // max_cost is the memory of the cached tiles (in KB)
+    TilePyramid(
+        int max_cost = 256 * 1024,
+        QObject* parent = 0
+    );
+
+    // waits for the decoding in progress
+    virtual ~TilePyramid();
+
+    // returns true if the image is large enough
+    // to be displayed through tiles
+    static bool needs_tiles(
+        const QSize& image_size
+    );
+
+    // sets the image of the pyramid
+    // the tiles of the previous image are dropped
+    // an empty path deactivates the pyramid
+    void set_image(
+        const QString& path,
+        const QSize& image_size
+    );
+
+    // returns true if an image is set
+    inline bool is_active() const;
+
+    // returns the size of the full resolution image
+    inline const QSize& image_size() const;
+
+    // returns the coarsest level with at least the given
+    // resolution (displayed pixels per image pixel)
+    // or the finest level that can be used if none
+    int level_for_scale(
+        float scale
+    ) const;
+
+    // returns the columns and rows of the level tiles
+    // covering the given area (in image coordinates)
+    QRect tile_range(
+        int level,
+        const QRect& image_rect
+    ) const;
+
+    // returns the area of the tile in image coordinates
+    QRect tile_rect(
+        int level,
+        int col,
+        int row
+    ) const;
+
+    // returns the cached tile or a null image
+    QImage tile(
+        int level,
+        int col,
+        int row
+    ) const;
+
+    // queues the decoding of the tiles of the range not cached yet
+    // tiles of a previous call not decoded yet are dropped
+    void request(
+        int level,
+        const QRect& tiles
+    );
+
+signals:
+    // emitted (in the interface thread) when a tile is cached
+    void tile_ready(
+        const QRect& image_rect
+    );
+
+    // emitted by the workers (internal)
+    void decoded(
+        int generation,
+        int level,
+        int col,
+        int row,
+        const QImage& tile
+    );
+
+protected slots:
+    // caches the tile decoded by a worker
+    // or keeps the level decoded by a worker (whole level column and row)
+    void add_tile(
+        int generation,
+        int level,
+        int col,
+        int row,
+        const QImage& tile
+    );
+
+protected:
+    // returns the size of the image at the given level
+    QSize level_size(
+        int level
+    ) const;
+
+    // returns the area of the tile in level coordinates
+    QRect level_tile_rect(
+        int level,
+        int col,
+        int row
+    ) const;
+
+    // returns the key of a tile (or of a whole level)
+    static quint64 tile_key(
+        int level,
+        int col,
+        int row
+    );
+
+    // returns true if the tile (or level) is still in view
+    // called by a worker before decoding: a tile scrolled out of view
+    // is skipped and can be queued again by a later request
+    bool take(
+        quint64 key
+    );
+
+private:
+    friend class TileTask;
+
+    int max_cost_;
+
+    QString path_;
+    QSize image_size_;
+
+    // decided from the format of the image (see set_image)
+    bool region_decoding_;
+    int level_count_;
+
+    // finest level that can be displayed
+    // and the level decoded at once (without region decoding)
+    int min_level_;
+    QImage level_image_;
+    int level_image_level_;
+
+    QCache<quint64, QImage> tiles_;
+
+    // tiles of the current view (last call to request)
+    // and tiles queued or being decoded (not queued twice)
+    // shared with the workers
+    QMutex mutex_;
+    QSet<quint64> wanted_;
+    QSet<quint64> in_flight_;
+
+    // latest requests are decoded first
+    int request_count_;
+
+    QAtomicInt generation_;
+    QThreadPool pool_;
+};
+
+
+/************************* inline *************************/
+
+bool TilePyramid::is_active() const
+{
+    return !path_.isEmpty();
+}
+
+const QSize& TilePyramid::image_size() const
+{
+    return image_size_;
+}
+
+#endif // TILE_PYRAMID_H
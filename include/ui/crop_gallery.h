@@ -0,0 +1,177 @@
+#ifndef CROP_GALLERY_H
+#define CROP_GALLERY_H
+
+#include <QStyledItemDelegate>
+#include <QVector>
+#include <QColor>
+
+#include <ui/lazy_list.h>
+#include <core/tag_item.h>
+#include <core/crop_loader.h>
+
+// list of all the boxes of a label with their crop
+// crops are decoded in the background (see LazyListModel)
+class CropGalleryModel : public LazyListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        FullpathRole = Qt::UserRole + 1,
+        BoxRole // bounding box in image coordinates (QRect)
+    };
+
+public:
+    CropGalleryModel(
+        QObject* parent = 0
+    );
+
+    virtual ~CropGalleryModel();
+
+    // shows the boxes of the given label elements
+    // pending crop requests are dropped
+    void set_boxes(
+        const QString& label,
+        const QColor& color,
+        const QList<TagItem::Elements>& elts
+    );
+
+    // returns the label of the boxes shown
+    inline const QString& label() const;
+
+    // returns the color of the label
+    inline const QColor& color() const;
+
+    virtual int rowCount(
+        const QModelIndex& parent = QModelIndex()
+    ) const Q_DECL_OVERRIDE;
+
+    // Returns:
+    // - the crop (QPixmap) for the decoration role
+    //   (null if not ready yet: it is requested in the background)
+    // - the file name and the box for the tooltip
+    // - the full path for FullpathRole
+    // - the box for BoxRole
+    virtual QVariant data(
+        const QModelIndex& index,
+        int role = Qt::DisplayRole
+    ) const Q_DECL_OVERRIDE;
+
+protected slots:
+    // stores the decoded crop and refreshes its tile
+    void add_crop(
+        const QString& fullpath,
+        const QRect& bbox,
+        const QImage& crop
+    );
+
+protected:
+    // returns the key of the box in the crop cache
+    static QString crop_key(
+        const QString& fullpath,
+        const QRect& bbox
+    );
+
+    virtual QString pixmap_key(
+        int row
+    ) const Q_DECL_OVERRIDE;
+
+    virtual void load_pixmaps(
+        const QList<int>& rows,
+        int priority
+    ) Q_DECL_OVERRIDE;
+
+    virtual void cancel_loading() Q_DECL_OVERRIDE;
+
+private:
+    // box of the gallery
+    struct Entry {
+        int _image; // index in images_
+        QRect _bbox;
+    };
+
+    QString label_;
+    QColor color_;
+
+    // paths are shared by the boxes of the same image
+    QStringList images_;
+    QVector<Entry> entries_;
+
+    CropLoader* crop_loader_;
+};
+
+// draws a tile: crop centered in a frame of the label color
+class CropDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    CropDelegate(
+        QObject* parent = 0
+    );
+
+    virtual ~CropDelegate();
+
+    virtual void paint(
+        QPainter* painter,
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index
+    ) const Q_DECL_OVERRIDE;
+
+    // all the tiles have the same size
+    virtual QSize sizeHint(
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index
+    ) const Q_DECL_OVERRIDE;
+};
+
+// virtualized gallery of the boxes of a label (see LazyListView)
+class CropGallery : public LazyListView
+{
+    Q_OBJECT
+
+public:
+    CropGallery(
+        QWidget* parent = 0
+    );
+
+    virtual ~CropGallery();
+
+    // shows the boxes of the label
+    void set_boxes(
+        const QString& label,
+        const QColor& color,
+        const QList<TagItem::Elements>& elts
+    );
+
+signals:
+    // emitted when a tile is double-clicked (or entered)
+    void box_activated(
+        const QString& fullpath,
+        const QString& label,
+        const QRect& bbox
+    );
+
+protected slots:
+    void activate(
+        const QModelIndex& index
+    );
+
+private:
+    CropGalleryModel* gallery_model_;
+};
+
+
+/************************* inline *************************/
+
+const QString& CropGalleryModel::label() const
+{
+    return label_;
+}
+
+const QColor& CropGalleryModel::color() const
+{
+    return color_;
+}
+
+#endif // CROP_GALLERY_H
@@ -0,0 +1,78 @@
+#ifndef DISPLAY_ADJUSTMENT_PANEL_H
+#define DISPLAY_ADJUSTMENT_PANEL_H
+
+#include <core/display_adjustment.h>
+
+#include <QWidget>
+
+class QSlider;
+class QComboBox;
+
+// sliders for choosing the display adjustment of the viewer
+// levels are set for one channel or for all of them at once
+class DisplayAdjustmentPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    DisplayAdjustmentPanel(
+        QWidget* parent = 0
+    );
+
+    virtual ~DisplayAdjustmentPanel();
+
+    inline const DisplayAdjustment& adjustment() const;
+
+    // shows the given adjustment
+    // (adjustment_changed is not emitted)
+    void set_adjustment(
+        const DisplayAdjustment& adjustment
+    );
+
+signals:
+    // emitted while a slider is moved
+    void adjustment_changed(
+        const DisplayAdjustment& adjustment
+    );
+
+    // emitted when the levels should be computed from the image
+    void auto_stretch_requested();
+
+protected slots:
+    // reads the adjustment from the sliders
+    void read_adjustment();
+
+    // shows the levels of the chosen channel
+    void show_levels();
+
+    // goes back to no adjustment
+    void reset();
+
+protected:
+    // returns the channels whose levels are edited
+    // (first and last + 1)
+    void edited_channels(
+        int& first,
+        int& last
+    ) const;
+
+private:
+    DisplayAdjustment adjustment_;
+
+    QSlider* brightness_;
+    QSlider* contrast_;
+    QSlider* gamma_;
+    QComboBox* channel_;
+    QSlider* black_;
+    QSlider* white_;
+};
+
+
+/************************* inline *************************/
+
+const DisplayAdjustment& DisplayAdjustmentPanel::adjustment() const
+{
+    return adjustment_;
+}
+
+#endif // DISPLAY_ADJUSTMENT_PANEL_H
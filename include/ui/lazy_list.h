@@ -0,0 +1,110 @@
+#ifndef LAZY_LIST_H
+#define LAZY_LIST_H
+
+#include <QListView>
+#include <QAbstractListModel>
+#include <QCache>
+#include <QPixmap>
+#include <QHash>
+#include <QList>
+
+class QTimer;
+
+// list model whose pixmaps are loaded in the background
+// only when the view asks for them (visible cells),
+// the latest requests first, and kept in a bounded memory cache
+// subclasses give the key of a row and run their loader
+class LazyListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    // pixmap_cache_size is in KB
+    LazyListModel(
+        int pixmap_cache_size,
+        QObject* parent = 0
+    );
+
+    virtual ~LazyListModel();
+
+    // drops the pending requests of the rows
+    // out of the given range (scrolled out of view)
+    void set_visible_rows(
+        int first,
+        int last
+    );
+
+protected:
+    // returns the cached pixmap of the row
+    // or a null pixmap after requesting it
+    QVariant decoration(
+        int row
+    ) const;
+
+    // stores the loaded pixmap and refreshes its row
+    // (ignored if it is no longer pending)
+    void add_pixmap(
+        const QString& key,
+        const QImage& image
+    );
+
+    // cancels the loader and drops the pending requests
+    // (before the rows change)
+    void drop_requests();
+
+    // returns the key of the pixmap of the row
+    virtual QString pixmap_key(
+        int row
+    ) const = 0;
+
+    // queues the loading of the pixmaps of the rows
+    // requests of a higher priority are served first
+    virtual void load_pixmaps(
+        const QList<int>& rows,
+        int priority
+    ) = 0;
+
+    // drops the queued loadings
+    virtual void cancel_loading() = 0;
+
+protected slots:
+    // requests the pixmaps asked since the last call in one go
+    void flush_requests();
+
+private:
+    // pixmaps of the recently shown rows
+    mutable QCache<QString, QPixmap> pixmaps_;
+
+    // rows of the pixmaps requested but not yet received,
+    // rows not yet sent to the loader
+    // and number of request batches (priority of the next one)
+    mutable QHash<QString, int> pending_;
+    mutable QList<int> requests_;
+    int request_count_;
+};
+
+// virtualized list of uniform cells laid out in rows
+// (list mode wrapped from left to right: no per-item layout)
+// only the visible cells are requested and drawn, and the requests
+// of the cells scrolled out of view are dropped once scrolling settles
+class LazyListView : public QListView
+{
+    Q_OBJECT
+
+public:
+    LazyListView(
+        QWidget* parent = 0
+    );
+
+    virtual ~LazyListView();
+
+protected slots:
+    // drops the requests of the cells scrolled out of view
+    void update_visible_rows();
+
+private:
+    QTimer* visible_rows_timer_;
+};
+
+
+#endif // LAZY_LIST_H
@@ -7,18 +7,43 @@
 #include <QModelIndex>
 #include <QFileDialog>
 
+#include <core/image_codec.h>
+#include <core/tag_io.h>
+#include <ui/tag_viewer.h>
+
 class QTreeView;
 class QFileSystemModel;
 class QComboBox;
 class QPushButton;
+class QDialog;
+class QLayout;
+class QTabWidget;
 class TagScrollView;
-class TagViewer;
 class TagModel;
+class ThumbnailCache;
+class ImageLoader;
+class TilePyramid;
+class ThumbnailGrid;
+class CropGallery;
+class DisplayAdjustmentPanel;
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
+public:
+    // settings chosen in the cropped images export dialog
+    struct ImageExportSettings {
+        ImageExportSettings();
+
+        QString _dirname;
+        TagIO::CropLayout _layout;
+        qint64 _shard_size;   // in bytes, for TAR_SHARDS layout
+        int _tensor_side;     // for NPY_TENSOR layout
+        int _tensor_channels; // for NPY_TENSOR layout
+        ImageCodec::Options _codec;
+    };
+
 public:
     MainWindow(
         QWidget* parent = 0
@@ -57,18 +82,58 @@ public slots:
     // open a XML file and merge it to the current tree
     void open_xml_and_merge();
 
+    // open a COCO JSON file (e.g. detector predictions)
+    void open_coco();
+
+    // open a COCO JSON file and merge it to the current tree
+    void open_coco_and_merge();
+
+    // open a directory of per-image annotation files (VOC or YOLO)
+    void open_annotation_dir();
+
+    // open a directory of per-image annotation files (VOC or YOLO)
+    // and merge it to the current tree
+    void open_annotation_dir_and_merge();
+
     // save tags as XML file
     void save_as_xml();
 
     // save selected tags as XML file
     void save_selection_as_xml();
 
+    // save tags as COCO, Pascal VOC or YOLO annotations
+    void save_as_annotations();
+
+    // save selected tags as COCO, Pascal VOC or YOLO annotations
+    void save_selection_as_annotations();
+
     // crop images per label and save them individually
     void save_as_images();
 
     // crop selected images per selected label and save them individually
     void save_selection_as_images();
 
+    // resize images, rescale their tags and save them with a new XML file
+    void save_as_resized_images();
+
+    // resize selected images, rescale their tags
+    // and save them with a new XML file
+    void save_selection_as_resized_images();
+
+    // cut images into overlapping tiles with their clipped tags
+    // and save them with a new XML file
+    void save_as_tiles();
+
+    // cut selected images into overlapping tiles with their clipped tags
+    // and save them with a new XML file
+    void save_selection_as_tiles();
+
+    // render tags on images and save them as JPEG files
+    void save_as_overlays();
+
+    // render tags on selected images and save them as JPEG files
+    void save_selection_as_overlays();
+
     // show the help contents
     void show_help();
 
@@ -78,8 +143,42 @@ public slots:
 protected slots:
     // internal slot for updating the viewer
     // with the current selected image
+    // if the image is already displayed, only its tags are updated
     void update_viewer();
 
+    // sets the display levels from the histogram of the displayed image
+    void auto_stretch_display();
+
+    // internal slot for updating the viewer
+    // when the selected image has been decoded
+    // (or its full resolution when zooming in)
+    void image_loaded(
+        const QString& fullpath
+    );
+
+    // internal slot for decoding the displayed image
+    // at full resolution when zooming past its decoded resolution
+    void load_full_resolution();
+
+    // internal slot for showing the images (resp. boxes) of
+    // the current selected label in the thumbnail grid (resp. crop gallery)
+    void update_grid();
+
+    // selects the image item under the given label
+    // and shows it in the viewer
+    void show_image(
+        const QString& fullpath,
+        const QString& label
+    );
+
+    // shows the image like show_image
+    // then scrolls to the box and highlights it
+    void show_box(
+        const QString& fullpath,
+        const QString& label,
+        const QRect& bbox
+    );
+
     // internal slot for updating the viewer tagging options
     // based on the current tag selection
     void set_viewer_tag_options();
@@ -109,6 +208,32 @@ protected slots:
         const QRect& bbox
     );
 
+    // replaces the bounding box of the given label
+    // of the current image (if valid selection)
+    // after it has been moved or resized in the viewer
+    void edit_tag(
+        const QString& label,
+        const QRect& bbox,
+        const QRect& new_bbox
+    );
+
+    // loads the given COCO JSON file
+    // keeping the annotations with a score of at least min_score
+    // if merge is off, clears the current tree first
+    void load_coco(
+        const QString& filename,
+        const QString& relative_dir,
+        double min_score,
+        bool merge
+    );
+
+    // pops up the directory and format selection
+    // then loads the per-image annotation files
+    // if merge is off, clears the current tree first
+    void load_annotation_dir(
+        bool merge
+    );
+
     // loads the given XML file
     // if merge is off, clears the current tree first
     void load_xml(
@@ -125,6 +250,41 @@ protected slots:
         const QModelIndexList& selection
     );
 
+    // pops up the annotation export dialog then writes the
+    // annotations in the chosen format
+    // if no selection is provided, save all items
+    void save_annotations(
+        const QModelIndexList& selection
+    );
+
+    // pops up the image export dialog then crops images
+    // and reports the export throughput
+    // if no selection is provided, save all items
+    void save_images(
+        const QModelIndexList& selection
+    );
+
+    // pops up the resized images export dialog then resizes images
+    // and reports the export throughput
+    // if no selection is provided, save all items
+    void save_resized_images(
+        const QModelIndexList& selection
+    );
+
+    // pops up the tiles export dialog then cuts images
+    // and reports the export throughput
+    // if no selection is provided, save all items
+    void save_tiles(
+        const QModelIndexList& selection
+    );
+
+    // pops up the annotated images export dialog then renders images
+    // and reports the export throughput
+    // if no selection is provided, save all items
+    void save_overlays(
+        const QModelIndexList& selection
+    );
+
 protected:
     // returns the list of supported image format files
     static QStringList valid_image_format();
@@ -138,12 +298,55 @@ protected:
         const QModelIndexList& index_list
     ) const;
 
+    // highlights the box picked in the crop gallery
+    // if its image is the one displayed
+    void show_highlighted_box();
+
+    // returns the tags of the given image to display
+    // for the labels or images of the selection
+    QList<TagViewer::TagDisplayElement> get_display_elements(
+        const QModelIndexList& selection,
+        const QString& fullpath
+    ) const;
+
+    // returns the images next to the first selected image item
+    // in the tag tree (closest first)
+    QStringList get_neighbor_images(
+        const QModelIndexList& selection
+    ) const;
+
     // build and popup the custom XML file dialog
     // use mode to choose whether it's a save or open file dialog
+    // file_type and suffix (optional) select another kind of file
     void pop_up_file_dialog(
         QString& filename,
         QString& relative_dir,
-        QFileDialog::AcceptMode mode
+        QFileDialog::AcceptMode mode,
+        const QString& file_type = "XML",
+        const QString& suffix = "xml"
+    );
+
+    // build and popup the cropped images export dialog
+    // to choose the output directory, layout and encoder options
+    // the directory is left empty if the dialog is canceled
+    void pop_up_image_export_dialog(
+        ImageExportSettings& settings
+    );
+
+    // adds a directory selector and OK/Cancel buttons around the given
+    // option layout (which widgets must be children of the dialog)
+    // then executes the dialog
+    // returns the selected directory or an empty string if canceled
+    QString pop_up_export_dialog(
+        QDialog& export_dialog,
+        QLayout* options_layout
+    );
+
+    // shows the number of files written and the export throughput
+    // unit is the name of the exported items (e.g. crops)
+    void show_export_stats(
+        const TagIO::ExportStats& stats,
+        const QString& unit
     );
 
     void pop_up_html_dialog(
@@ -160,14 +363,31 @@ private:
     TagModel* tag_model_;
     QTreeView* tag_view_;
 
+    // filled in the background after images are imported
+    ThumbnailCache* thumbnail_cache_;
+
+    // decodes the viewer images in the background
+    ImageLoader* image_loader_;
+    TilePyramid* tile_pyramid_;
+
     QMenu* context_menu_;
     QModelIndex selected_for_context_;
 
     QComboBox* label_selector_;
     TagViewer* tag_viewer_;
     TagScrollView* tag_scroll_view_;
+    DisplayAdjustmentPanel* display_panel_;
+
+    QTabWidget* viewer_tabs_;
+    ThumbnailGrid* thumbnail_grid_;
+    CropGallery* crop_gallery_;
 
     QString current_fullpath_;
+    QString requested_fullpath_;
+
+    // box picked in the crop gallery
+    QString highlighted_fullpath_;
+    QRect highlighted_box_;
 };
 
 #endif // MAIN_WINDOW_H
@@ -1,9 +1,15 @@
 #ifndef TAG_SCROLL_VIEW_H
 #define TAG_SCROLL_VIEW_H
 
-#include <QScrollArea>
+#include <QAbstractScrollArea>
 
-class TagScrollView : public QScrollArea
+class TagViewer;
+
+// scroll area of the tag viewer
+// the viewer is the viewport: zooming and scrolling only
+// change its view transform (the viewer is never resized)
+// so that their cost does not depend on the zoom
+class TagScrollView : public QAbstractScrollArea
 {
     Q_OBJECT
 
@@ -14,20 +20,44 @@ public:
 
     virtual ~TagScrollView();
 
+    // sets the viewer as the viewport
+    // the viewer is owned by the scroll area
+    void set_viewer(
+        TagViewer* viewer
+    );
+
+    // scrolls the view so that the box (in image coordinates)
+    // is visible with the given margin (in viewport pixels)
+    void ensure_visible(
+        const QRect& bbox,
+        int margin = 50
+    );
+
 public slots:
     void zoom_in();
     void zoom_out();
     void fit_to_view();
 
 protected:
+    // zooms by the given factor keeping the image point
+    // under the anchor (in viewport coordinates) in place
     void scale_by(
-        float factor
+        float factor,
+        const QPoint& anchor
     );
 
-    void adjust_scrollbars(
-        float factor
+    // sets the zoom keeping the image point under the anchor in place
+    void set_zoom(
+        float zoom,
+        const QPoint& anchor
     );
 
+    // updates the scrollbar ranges to the zoomed image size
+    void adjust_scrollbars();
+
+    // sends the view transform to the viewer
+    void update_view();
+
 // overloaded functions
 protected:
     // overload as shortcut for zooming in and out
@@ -35,6 +65,19 @@ protected:
         QWheelEvent* e
     ) Q_DECL_OVERRIDE;
 
+    virtual void scrollContentsBy(
+        int dx,
+        int dy
+    ) Q_DECL_OVERRIDE;
+
+    // paint and mouse events are left to the viewer
+    virtual bool viewportEvent(
+        QEvent* e
+    ) Q_DECL_OVERRIDE;
+
+private:
+    TagViewer* viewer_;
+    float zoom_;
 };
 
 #endif // TAG_SCROLL_VIEW_H
@@ -2,7 +2,27 @@
 #define TAG_VIEWER_H
 
 #include <QWidget>
+#include <QHash>
+#include <QStaticText>
 
+#include <core/box_index.h>
+#include <core/display_adjustment.h>
+
+class TilePyramid;
+
+// paints the image and its tags through a view transform:
+// zoom factor and offset of the view in the zoomed image
+// only the visible part of the image is painted
+// the view is driven by TagScrollView (the viewer is its viewport)
+// the image and its boxes are rendered into a layer the size of the widget
+// which is only re-rendered where it changed (see invalidate_layer)
+// so that the box being drawn is painted over it at the cost of a copy
+// boxes are picked (untag tool, hovering) through a spatial index
+// kept up to date with the displayed elements
+// outside of the tagging tools, the picked box can be moved or resized
+// with the mouse (see box_edited)
+// a display adjustment (brightness, contrast, etc.) can be applied
+// to the painted part of the image
 class TagViewer : public QWidget
 {
     Q_OBJECT
@@ -27,17 +47,67 @@ public:
 
     virtual ~TagViewer();
 
-    // set the background image
+    // set the background image and repaints the widget
     // if image cannot be loaded
     // error message will be displayed instead
-    inline void set_image(
-        const QPixmap& pix
+    // image_size is the size of the full resolution image
+    // (boxes coordinates) if pix is decoded at reduced size
+    // the view is left as is (see TagScrollView::fit_to_view)
+    void set_image(
+        const QPixmap& pix,
+        const QSize& image_size = QSize()
+    );
+
+    // returns the size of the full resolution image
+    inline const QSize& image_size() const;
+
+    // sets the view transform:
+    // zoom is the number of widget pixels per image pixel
+    // offset is the top-left corner of the widget in the zoomed image
+    // (negative to center an image smaller than the widget)
+    void set_view(
+        float zoom,
+        const QPoint& offset
     );
 
-    inline void set_overlay_elements(
+    inline float zoom() const;
+    inline const QPoint& offset() const;
+
+    // only repaints and re-indexes the boxes that changed
+    // (the whole widget is repainted if the image changes)
+    // clears the highlighted and hovered boxes
+    // and the selected box if it is no longer displayed
+    void set_overlay_elements(
         const QList<TagDisplayElement>& elements
     );
 
+    // outlines the given box (in image coordinates)
+    // e.g. to point at the box picked in the crop gallery
+    // an invalid box removes the highlight
+    void set_highlighted_box(
+        const QRect& bbox
+    );
+
+    // returns the given box in widget coordinates
+    QRect map_to_widget(
+        const QRect& bbox
+    ) const;
+
+    // returns the given widget point in image coordinates
+    QPoint map_to_image(
+        const QPoint& p
+    ) const;
+
+    // sets the tiles used for displaying large images
+    // above the resolution of the background image
+    // tiles are used while the pyramid image has the size of the image
+    // the pyramid is not owned by the viewer
+    void set_tile_pyramid(
+        TilePyramid* pyramid
+    );
+
+    inline const DisplayAdjustment& adjustment() const;
+
     // set the label and color for the current tag being drawn
     inline void set_tag_options(
         const QString& current_label,
@@ -45,6 +115,10 @@ public:
     );
 
 signals:
+    // emitted when the view is zoomed past the resolution
+    // of the background image (decoded at reduced size)
+    void resolution_needed();
+
     // emitted when left mouse button is released
     // while tagging was in progress
     void tagged(
@@ -57,6 +131,14 @@ signals:
         const QRect& bbox
     );
 
+    // emitted when the selected box has been moved or resized
+    // the box stays selected if new_bbox is displayed afterwards
+    void box_edited(
+        const QString& label,
+        const QRect& bbox,
+        const QRect& new_bbox
+    );
+
 public slots:
     // activate or deactivate the tagging tool
     void set_tagging_status(
@@ -68,16 +150,157 @@ public slots:
         bool activate
     );
 
+    // sets the adjustment of the displayed image
+    // only the painted pixels are adjusted (through lookup tables)
+    void set_adjustment(
+        const DisplayAdjustment& adjustment
+    );
+
+protected slots:
+    // repaints the given area (in image coordinates)
+    void update_image_rect(
+        const QRect& image_rect
+    );
+
 protected:
+    // box edges moved by the handles of the selected box
+    // (all of them for moving the box)
+    enum EditHandle {
+        NO_HANDLE = 0,
+        LEFT_EDGE = 1,
+        TOP_EDGE = 2,
+        RIGHT_EDGE = 4,
+        BOTTOM_EDGE = 8,
+        MOVE_HANDLE = 15
+    };
+
+    // handles drawn around the selected box
+    static const int HANDLE_COUNT = 8;
+    static const int HANDLES[HANDLE_COUNT];
+
+    // keeps the point within the displayed image
     void enforce_boundary_conditions(
         QPoint& p
-    );
+    ) const;
 
     float scale_factor() const;
 
-    static int shortest_distance(
+    // returns the displayed image area in widget coordinates
+    QRect image_area() const;
+
+    // draws the exposed area of the background image
+    // from the image scaled at the current zoom
+    // (cached if small enough, the exposed area is scaled otherwise)
+    void draw_background(
+        QPainter& p,
+        const QRect& exposed
+    );
+
+    // returns true if the image is displayed through tiles
+    bool uses_tiles() const;
+
+    // draws the pyramid tiles of the exposed area
+    // and requests the missing tiles of the widget
+    void draw_tiles(
+        QPainter& p,
+        const QRect& exposed
+    );
+
+    // returns the boxes of the elements
+    // that are not in the other elements
+    static QList<TagDisplayElement> changed_elements(
+        const QList<TagDisplayElement>& elements,
+        const QList<TagDisplayElement>& other_elements
+    );
+
+    // returns the widget area covering the boxes of the elements
+    QRegion painted_region(
+        const QList<TagDisplayElement>& elements
+    ) const;
+
+    // finds the box picked at the given widget point:
+    // the closest box when untagging, the box under the point otherwise
+    // returns false if there is none
+    bool pick_box(
         const QPoint& p,
-        const QRect& rect
+        BoxIndex::Box& found
+    ) const;
+
+    // highlights the box under the mouse (in image coordinates)
+    // an invalid box removes the highlight
+    void set_hovered_box(
+        const QRect& bbox
+    );
+
+    // returns the displayed element of the label
+    // returns null if there is none
+    const TagDisplayElement* find_element(
+        const QString& label
+    ) const;
+
+    // selects the box for editing
+    // an invalid box clears the selection
+    void select_box(
+        const QString& label,
+        const QRect& bbox
+    );
+
+    // returns the widget area covering the box and its handles
+    QRect selection_rect(
+        const QRect& bbox
+    ) const;
+
+    // returns the handle of the selected box at the given widget point
+    // (MOVE_HANDLE within the box, NO_HANDLE outside)
+    int handle_at(
+        const QPoint& p
+    ) const;
+
+    // returns the handle square of the given widget box
+    static QRect handle_rect(
+        const QRect& box,
+        int handle
+    );
+
+    // returns the selected box (in image coordinates)
+    // with the edges of the edit handle dragged to the given widget point
+    // the box is kept within the image
+    QRect dragged_box(
+        const QPoint& p
+    ) const;
+
+    // draws the exposed area of the image (background and tiles)
+    // with the display adjustment applied
+    void draw_adjusted_image(
+        QPainter& p,
+        const QRect& exposed
+    );
+
+    // draws the selected box being edited and its handles
+    void draw_selection(
+        QPainter& p
+    );
+
+    // returns the widget area covering the highlight of the box
+    QRect highlight_rect(
+        const QRect& bbox
+    ) const;
+
+    // returns the widget area covering the box being drawn and its label
+    // (empty if no box is being drawn)
+    QRect rubber_band_rect() const;
+
+    // marks the area (in widget coordinates) of the layer to be re-rendered
+    // and schedules its repaint
+    void invalidate_layer(
+        const QRegion& region
+    );
+
+    // renders the image, the boxes and the highlight within the area
+    // (the painter is the layer's)
+    void render_layer(
+        QPainter& p,
+        const QRect& area
     );
 
 // re-implementation from QWidget
@@ -98,6 +321,10 @@ protected:
         QMouseEvent* e
     ) Q_DECL_OVERRIDE;
 
+    virtual void leaveEvent(
+        QEvent* e
+    ) Q_DECL_OVERRIDE;
+
 private:
     bool tagging_;
     bool untagging_;
@@ -106,7 +333,42 @@ private:
     QPoint tag_end_;
 
     QPixmap pix_;
+    QSize image_size_;
+
+    float zoom_;
+    QPoint offset_;
+
+    // background image scaled at the current zoom
+    QPixmap scaled_pix_;
+    TilePyramid* pyramid_;
     QList<TagDisplayElement> elts_;
+    QRect highlighted_box_;
+
+    // label text of the elements laid out once per label
+    QHash<QString, QStaticText> label_texts_;
+
+    // boxes of the elements
+    BoxIndex box_index_;
+    QRect hovered_box_;
+
+    // box selected for editing and its edit in progress
+    // (handle, whether the mouse moved past the drag distance,
+    // press point in widget and image coordinates and edited box)
+    QString selected_label_;
+    QRect selected_box_;
+    int edit_handle_;
+    bool edit_dragged_;
+    QPoint edit_press_;
+    QPoint edit_start_;
+    QRect edited_box_;
+
+    // display adjustment and its lookup tables
+    DisplayAdjustment adjustment_;
+    DisplayAdjustment::Luts luts_;
+
+    // rendered image and boxes, and its area to be re-rendered
+    QPixmap layer_;
+    QRegion layer_dirty_;
 
     QString current_label_;
     QColor current_color_;
@@ -115,25 +377,24 @@ private:
 
 /************************* inline *************************/
 
-void TagViewer::set_image(
-        const QPixmap& pix
-    )
+const QSize& TagViewer::image_size() const
 {
-    QSize current_size = pix_.size();
-    pix_ = pix;
-
-    if( pix_.isNull() ) {
-        resize( 400, 100 );
-    } else if( current_size != pix.size() ) {
-        resize( pix.size() );
-    }
+    return image_size_;
 }
 
-void TagViewer::set_overlay_elements(
-        const QList<TagViewer::TagDisplayElement>& elements
-    )
+float TagViewer::zoom() const
+{
+    return zoom_;
+}
+
+const QPoint& TagViewer::offset() const
+{
+    return offset_;
+}
+
+const DisplayAdjustment& TagViewer::adjustment() const
 {
-    elts_ = elements;
+    return adjustment_;
 }
 
 void TagViewer::set_tag_options(
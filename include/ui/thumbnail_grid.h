@@ -0,0 +1,161 @@
+#ifndef THUMBNAIL_GRID_H
+#define THUMBNAIL_GRID_H
+
+#include <ui/lazy_list.h>
+
+#include <QStyledItemDelegate>
+#include <QStringList>
+#include <QHash>
+
+class TagModel;
+class ThumbnailCache;
+
+// list of the images of a label with their thumbnail
+// thumbnails are requested from the thumbnail cache (see LazyListModel)
+class ThumbnailGridModel : public LazyListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        FullpathRole = Qt::UserRole + 1,
+        ImageSizeRole  // size of the full image (QSize)
+    };
+
+public:
+    ThumbnailGridModel(
+        QObject* parent = 0
+    );
+
+    virtual ~ThumbnailGridModel();
+
+    // shows the given images of the label
+    // pending thumbnail requests are dropped
+    void set_images(
+        const QString& label,
+        const QStringList& paths
+    );
+
+    // returns the label of the images shown
+    inline const QString& label() const;
+
+    virtual int rowCount(
+        const QModelIndex& parent = QModelIndex()
+    ) const Q_DECL_OVERRIDE;
+
+    // Returns:
+    // - the thumbnail (QPixmap) for the decoration role
+    //   (null if not ready yet: it is requested in the background)
+    // - the file name for the display role
+    // - the full path for the tooltip and FullpathRole
+    // - the full image size for ImageSizeRole (if thumbnail is ready)
+    virtual QVariant data(
+        const QModelIndex& index,
+        int role = Qt::DisplayRole
+    ) const Q_DECL_OVERRIDE;
+
+protected:
+    // thumbnails are keyed by image path
+    virtual QString pixmap_key(
+        int row
+    ) const Q_DECL_OVERRIDE;
+
+    virtual void load_pixmaps(
+        const QList<int>& rows,
+        int priority
+    ) Q_DECL_OVERRIDE;
+
+    virtual void cancel_loading() Q_DECL_OVERRIDE;
+
+protected slots:
+    // stores the generated thumbnail and refreshes its cell
+    void add_thumbnail(
+        const QString& path,
+        int size,
+        const QImage& thumb
+    );
+
+private:
+    QString label_;
+    QStringList paths_;
+
+    ThumbnailCache* thumbnail_cache_;
+
+    // image sizes of the images whose thumbnail was received
+    QHash<QString, QSize> image_sizes_;
+};
+
+// draws a cell: thumbnail, boxes of the shown label and file name
+// boxes are drawn the way the viewer displays them
+class ThumbnailDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    ThumbnailDelegate(
+        TagModel* tag_model,
+        QObject* parent = 0
+    );
+
+    virtual ~ThumbnailDelegate();
+
+    virtual void paint(
+        QPainter* painter,
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index
+    ) const Q_DECL_OVERRIDE;
+
+    // all the cells have the same size
+    virtual QSize sizeHint(
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index
+    ) const Q_DECL_OVERRIDE;
+
+private:
+    TagModel* tag_model_;
+};
+
+// virtualized grid of thumbnails (see LazyListView)
+class ThumbnailGrid : public LazyListView
+{
+    Q_OBJECT
+
+public:
+    ThumbnailGrid(
+        TagModel* tag_model,
+        QWidget* parent = 0
+    );
+
+    virtual ~ThumbnailGrid();
+
+    // shows the images of the label
+    void set_images(
+        const QString& label,
+        const QStringList& paths
+    );
+
+signals:
+    // emitted when a thumbnail is double-clicked (or entered)
+    void image_activated(
+        const QString& fullpath,
+        const QString& label
+    );
+
+protected slots:
+    void activate(
+        const QModelIndex& index
+    );
+
+private:
+    ThumbnailGridModel* grid_model_;
+};
+
+
+/************************* inline *************************/
+
+const QString& ThumbnailGridModel::label() const
+{
+    return label_;
+}
+
+#endif // THUMBNAIL_GRID_H
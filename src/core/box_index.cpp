@@ -0,0 +1,257 @@
+#include <core/box_index.h>
+
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+    // cells along the longest side of the image
+    // (but no smaller than MIN_CELL_SIZE image pixels)
+    const int GRID_SIDE = 128;
+    const int MIN_CELL_SIZE = 32;
+
+    // boxes covering more cells are kept aside
+    // and visited by every query
+    const int LARGE_CELLS = 64;
+
+    // division rounded towards negative infinity
+    // (points may be picked outside of the image)
+    int floor_div(
+            int x,
+            int d
+        )
+    {
+        return x >= 0? x / d : -( ( -x - 1 ) / d ) - 1;
+    }
+}
+
+
+BoxIndex::BoxIndex(
+    ) : cell_size_( MIN_CELL_SIZE ), count_( 0 )
+{
+}
+
+BoxIndex::~BoxIndex()
+{
+}
+
+void BoxIndex::reset(
+        const QSize& image_size
+    )
+{
+    entries_.clear();
+    free_entries_.clear();
+    cells_.clear();
+    large_entries_.clear();
+    count_ = 0;
+
+    cell_size_ = qMax( MIN_CELL_SIZE, qMax( image_size.width(), image_size.height() ) / GRID_SIDE );
+}
+
+void BoxIndex::insert(
+        const QString& label,
+        const QRect& bbox
+    )
+{
+    Entry entry;
+    entry._label = label;
+    entry._bbox = bbox;
+    entry._used = true;
+
+    int index;
+    if( free_entries_.isEmpty() ) {
+        index = entries_.size();
+        entries_.append( entry );
+    } else {
+        index = free_entries_.takeLast();
+        entries_[index] = entry;
+    }
+    ++count_;
+
+    QRect cells = cell_range( bbox );
+    if( is_large( cells ) ) {
+        large_entries_.append( index );
+        return;
+    }
+
+    for( int row = cells.top(); row <= cells.bottom(); ++row ) {
+        for( int col = cells.left(); col <= cells.right(); ++col ) {
+            cells_[cell_key( col, row )].append( index );
+        }
+    }
+}
+
+bool BoxIndex::remove(
+        const QString& label,
+        const QRect& bbox
+    )
+{
+    // the box is in every cell it covers: looks for it in the first one
+    QRect cells = cell_range( bbox );
+    bool large = is_large( cells );
+    const QVector<int>& first_cell = large? large_entries_ : cells_.value( cell_key( cells.left(), cells.top() ) );
+
+    int index = -1;
+    for( QVector<int>::const_iterator index_itr = first_cell.begin(); index_itr != first_cell.end(); ++index_itr ) {
+        const Entry& entry = entries_[*index_itr];
+        if( entry._bbox == bbox && entry._label == label ) {
+            index = *index_itr;
+            break;
+        }
+    }
+
+    if( index < 0 ) {
+        return false;
+    }
+
+    if( large ) {
+        large_entries_.removeOne( index );
+
+    } else {
+        for( int row = cells.top(); row <= cells.bottom(); ++row ) {
+            for( int col = cells.left(); col <= cells.right(); ++col ) {
+                QHash<qint64, QVector<int> >::iterator cell_itr = cells_.find( cell_key( col, row ) );
+                if( cell_itr == cells_.end() ) {
+                    continue;
+                }
+
+                cell_itr->removeOne( index );
+                if( cell_itr->isEmpty() ) {
+                    cells_.erase( cell_itr );
+                }
+            }
+        }
+    }
+
+    entries_[index]._used = false;
+    entries_[index]._label.clear();
+    free_entries_.append( index );
+    --count_;
+
+    return true;
+}
+
+bool BoxIndex::nearest(
+        const QPoint& p,
+        int max_squared_distance,
+        Box& found
+    ) const
+{
+    // only the cells within the max distance are visited
+    int radius = int( std::ceil( std::sqrt( double( qMax( max_squared_distance, 0 ) ) ) ) );
+    QVector<int> indices = candidates( QRect( p.x() - radius, p.y() - radius, 2 * radius + 1, 2 * radius + 1 ) );
+
+    int distance_min = max_squared_distance;
+    qint64 area_min = 0;
+    int index_found = -1;
+
+    for( QVector<int>::const_iterator index_itr = indices.begin(); index_itr != indices.end(); ++index_itr ) {
+        const QRect& bbox = entries_[*index_itr]._bbox;
+        int d = squared_distance( p, bbox );
+        qint64 area = qint64( bbox.width() ) * bbox.height();
+
+        if( d < distance_min || ( index_found >= 0 && d == distance_min && area < area_min ) ) {
+            distance_min = d;
+            area_min = area;
+            index_found = *index_itr;
+        }
+    }
+
+    if( index_found < 0 ) {
+        return false;
+    }
+
+    found._label = entries_[index_found]._label;
+    found._bbox = entries_[index_found]._bbox;
+    return true;
+}
+
+bool BoxIndex::box_at(
+        const QPoint& p,
+        Box& found
+    ) const
+{
+    QVector<int> indices = candidates( QRect( p, QSize( 1, 1 ) ) );
+
+    qint64 area_min = 0;
+    int index_found = -1;
+
+    for( QVector<int>::const_iterator index_itr = indices.begin(); index_itr != indices.end(); ++index_itr ) {
+        const QRect& bbox = entries_[*index_itr]._bbox;
+        qint64 area = qint64( bbox.width() ) * bbox.height();
+
+        if( bbox.contains( p ) && ( index_found < 0 || area < area_min ) ) {
+            area_min = area;
+            index_found = *index_itr;
+        }
+    }
+
+    if( index_found < 0 ) {
+        return false;
+    }
+
+    found._label = entries_[index_found]._label;
+    found._bbox = entries_[index_found]._bbox;
+    return true;
+}
+
+int BoxIndex::squared_distance(
+        const QPoint& p,
+        const QRect& rect
+    )
+{
+    int top = rect.top();
+    int left = rect.left();
+    int bottom = rect.y() + rect.height(); // note from Qt doc --> retrieve the true y-coordinate
+    int right = rect.x() + rect.width(); // note from Qt doc --> retrieve the true x-coordinate
+
+    int x = p.x();
+    int y = p.y();
+
+    // if x (resp. y ) in between rectangle left & right (resp. top and bottom)
+    // --> count a distance of 0
+    int dx = ( x < right && x > left )? 0 : qMin( abs( left - x ), abs( right - x ) );
+    int dy = ( y < bottom && y > top )? 0 : qMin( abs( bottom - y ), abs( top - y ) );
+
+    return ( dx * dx + dy * dy );
+}
+
+QRect BoxIndex::cell_range(
+        const QRect& rect
+    ) const
+{
+    // degenerate boxes still cover a cell
+    QRect normalized = rect.normalized();
+    normalized.setWidth( qMax( normalized.width(), 1 ) );
+    normalized.setHeight( qMax( normalized.height(), 1 ) );
+
+    return QRect(
+        QPoint( floor_div( normalized.left(), cell_size_ ), floor_div( normalized.top(), cell_size_ ) ),
+        QPoint( floor_div( normalized.right(), cell_size_ ), floor_div( normalized.bottom(), cell_size_ ) )
+    );
+}
+
+bool BoxIndex::is_large(
+        const QRect& cells
+    )
+{
+    return qint64( cells.width() ) * cells.height() > LARGE_CELLS;
+}
+
+QVector<int> BoxIndex::candidates(
+        const QRect& rect
+    ) const
+{
+    QVector<int> indices = large_entries_;
+
+    QRect cells = cell_range( rect );
+    for( int row = cells.top(); row <= cells.bottom(); ++row ) {
+        for( int col = cells.left(); col <= cells.right(); ++col ) {
+            QHash<qint64, QVector<int> >::const_iterator cell_itr = cells_.find( cell_key( col, row ) );
+            if( cell_itr != cells_.end() ) {
+                indices += *cell_itr;
+            }
+        }
+    }
+
+    return indices;
+}
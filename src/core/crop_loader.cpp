@@ -0,0 +1,134 @@
+#include <core/crop_loader.h>
+#include <core/image_codec.h>
+
+#include <QRunnable>
+#include <QThread>
+
+namespace {
+
+// number of crops decoded by a single background task
+const int TASK_BATCH_SIZE = 16;
+
+// number of boxes of the same image in a task above which
+// the image is decoded once rather than once per box
+const int FULL_DECODE_THRESHOLD = 4;
+
+// returns the size of the box scaled to fit in a side x side square
+QSize tile_size(
+        const QRect& bbox,
+        int side
+    )
+{
+    QSize size = bbox.size();
+    size.scale( side, side, Qt::KeepAspectRatio );
+    return size.expandedTo( QSize( 1, 1 ) );
+}
+
+}
+
+
+// decodes a batch of crops
+// and drops them if the loader generation changed
+class CropTask : public QRunnable
+{
+public:
+    CropTask(
+            CropLoader* loader,
+            const QList<CropLoader::Request>& requests,
+            int side,
+            int generation
+        ) : loader_( loader ), requests_( requests ), side_( side ), generation_( generation )
+    {
+    }
+
+    virtual void run()
+    {
+        // requests of the same image are contiguous (gallery order)
+        int begin = 0;
+        while( begin < requests_.count() ) {
+            const QString& fullpath = requests_.at( begin )._fullpath;
+            int end = begin + 1;
+            while( end < requests_.count() && requests_.at( end )._fullpath == fullpath ) {
+                ++end;
+            }
+
+            QImage image;
+            if( end - begin >= FULL_DECODE_THRESHOLD ) {
+                image = ImageCodec::read( fullpath );
+            }
+
+            for( int r = begin; r < end; ++r ) {
+                if( loader_->generation_.load() != generation_ ) {
+                    return;
+                }
+
+                const QRect& bbox = requests_.at( r )._bbox;
+                QImage crop;
+                if( image.isNull() ) {
+                    crop = CropLoader::crop( fullpath, bbox, side_ );
+                } else {
+                    crop = image.copy( bbox ).scaled( tile_size( bbox, side_ ), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+                }
+
+                if( !crop.isNull() ) {
+                    emit loader_->crop_ready( fullpath, bbox, crop );
+                }
+            }
+
+            begin = end;
+        }
+    }
+
+private:
+    CropLoader* loader_;
+    QList<CropLoader::Request> requests_;
+    int side_;
+    int generation_;
+};
+
+
+CropLoader::CropLoader(
+        QObject* parent
+    ) : QObject( parent ), generation_( 0 )
+{
+    // crops are requested for the visible tiles only:
+    // they are decoded at normal priority as the user waits for them
+    pool_.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() / 2 ) );
+}
+
+CropLoader::~CropLoader()
+{
+    cancel();
+    pool_.waitForDone();
+}
+
+QImage CropLoader::crop(
+        const QString& fullpath,
+        const QRect& bbox,
+        int side
+    )
+{
+    if( !bbox.isValid() ) {
+        return QImage();
+    }
+
+    return ImageCodec::read( fullpath, tile_size( bbox, side ), bbox );
+}
+
+void CropLoader::request(
+        const QList<Request>& requests,
+        int side,
+        int priority
+    )
+{
+    int generation = generation_.load();
+    for( int r = 0; r < requests.count(); r += TASK_BATCH_SIZE ) {
+        pool_.start( new CropTask( this, requests.mid( r, TASK_BATCH_SIZE ), side, generation ), priority );
+    }
+}
+
+void CropLoader::cancel()
+{
+    generation_.ref();
+    pool_.clear();
+}
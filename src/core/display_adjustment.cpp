@@ -0,0 +1,145 @@
+#include <core/display_adjustment.h>
+
+#include <QtMath>
+
+namespace {
+    // number of pixels sampled for the histograms of auto_stretch
+    const qint64 HISTOGRAM_SAMPLES = 1024 * 1024;
+
+    // contrast slope is tan( ( contrast + 1 ) * pi / 4 ):
+    // 0 for -1, 1 for 0, and infinite for 1 (hence the bound)
+    const float MAX_CONTRAST = 0.99f;
+}
+
+
+DisplayAdjustment::DisplayAdjustment(
+    ) : _brightness( 0.f ), _contrast( 0.f ), _gamma( 1.f )
+{
+    for( int c = 0; c < CHANNEL_COUNT; ++c ) {
+        _black[c] = 0;
+        _white[c] = 255;
+    }
+}
+
+bool DisplayAdjustment::is_identity() const
+{
+    return *this == DisplayAdjustment();
+}
+
+bool DisplayAdjustment::operator == (
+        const DisplayAdjustment& other
+    ) const
+{
+    if( _brightness != other._brightness || _contrast != other._contrast || _gamma != other._gamma ) {
+        return false;
+    }
+
+    for( int c = 0; c < CHANNEL_COUNT; ++c ) {
+        if( _black[c] != other._black[c] || _white[c] != other._white[c] ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DisplayAdjustment::auto_stretch(
+        const QImage& image,
+        float clip_fraction
+    )
+{
+    if( image.isNull() ) {
+        return;
+    }
+
+    QImage rgb = image;
+    if( rgb.format() != QImage::Format_RGB32 && rgb.format() != QImage::Format_ARGB32 ) {
+        rgb = rgb.convertToFormat( QImage::Format_RGB32 );
+    }
+
+    // every step-th pixel of every step-th line
+    int step = qMax( 1, int( qSqrt( double( qint64( rgb.width() ) * rgb.height() ) / HISTOGRAM_SAMPLES ) ) );
+
+    qint64 histogram[CHANNEL_COUNT][256] = { { 0 } };
+    qint64 count = 0;
+    for( int y = 0; y < rgb.height(); y += step ) {
+        const QRgb* line = reinterpret_cast<const QRgb*>( rgb.constScanLine( y ) );
+        for( int x = 0; x < rgb.width(); x += step ) {
+            ++histogram[RED][qRed( line[x] )];
+            ++histogram[GREEN][qGreen( line[x] )];
+            ++histogram[BLUE][qBlue( line[x] )];
+            ++count;
+        }
+    }
+
+    qint64 clipped = qint64( count * qBound( 0.f, clip_fraction, 0.5f ) );
+    for( int c = 0; c < CHANNEL_COUNT; ++c ) {
+        // first values past the clipped pixels from each end
+        int black = 0;
+        qint64 sum = histogram[c][black];
+        while( black < 255 && sum <= clipped ) {
+            sum += histogram[c][++black];
+        }
+
+        int white = 255;
+        sum = histogram[c][white];
+        while( white > 0 && sum <= clipped ) {
+            sum += histogram[c][--white];
+        }
+
+        // flat channel: nothing to stretch
+        if( white <= black ) {
+            black = 0;
+            white = 255;
+        }
+
+        _black[c] = black;
+        _white[c] = white;
+    }
+}
+
+DisplayAdjustment::Luts DisplayAdjustment::make_luts() const
+{
+    Luts luts;
+
+    float gamma = qMax( _gamma, 0.01f );
+    float slope = float( qTan( ( qBound( -1.f, _contrast, MAX_CONTRAST ) + 1. ) * M_PI / 4. ) );
+
+    for( int c = 0; c < CHANNEL_COUNT; ++c ) {
+        int black = qBound( 0, _black[c], 254 );
+        int white = qBound( black + 1, _white[c], 255 );
+
+        for( int v = 0; v < 256; ++v ) {
+            float x = qBound( 0.f, float( v - black ) / ( white - black ), 1.f );
+            x = qPow( x, 1.f / gamma );
+            x = ( x - 0.5f ) * slope + 0.5f + _brightness;
+            luts._channel[c][v] = uchar( qBound( 0.f, x, 1.f ) * 255.f + 0.5f );
+        }
+    }
+
+    return luts;
+}
+
+void DisplayAdjustment::apply(
+        const Luts& luts,
+        QImage& image
+    )
+{
+    if( image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32 ) {
+        image = image.convertToFormat( QImage::Format_RGB32 );
+    }
+
+    const uchar* red = luts._channel[RED];
+    const uchar* green = luts._channel[GREEN];
+    const uchar* blue = luts._channel[BLUE];
+
+    // branchless: 3 table lookups per pixel
+    int width = image.width();
+    for( int y = 0; y < image.height(); ++y ) {
+        QRgb* line = reinterpret_cast<QRgb*>( image.scanLine( y ) );
+        for( int x = 0; x < width; ++x ) {
+            QRgb px = line[x];
+            line[x] = ( px & 0xff000000 ) | ( uint( red[( px >> 16 ) & 0xff] ) << 16 ) | ( uint( green[( px >> 8 ) & 0xff] ) << 8 ) | blue[px & 0xff];
+        }
+    }
+}
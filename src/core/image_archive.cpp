@@ -0,0 +1,641 @@
+#include <core/image_archive.h>
+
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QPair>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+// members are held in a QByteArray (at most INT_MAX bytes)
+// larger sizes are rejected: they also come from corrupted headers
+// and would make inflate allocate them up front
+const qint64 MAX_MEMBER_SIZE = 1024 * 1024 * 1024;
+
+// persisted index file header
+const quint32 INDEX_MAGIC = 0x42425441; // "BBTA"
+const quint32 INDEX_VERSION = 1;
+
+// little endian readers for zip structures
+inline quint16 read_u16(
+        const uchar* p
+    )
+{
+    return quint16( p[0] | ( p[1] << 8 ) );
+}
+
+inline quint32 read_u32(
+        const uchar* p
+    )
+{
+    return quint32( p[0] ) | ( quint32( p[1] ) << 8 ) | ( quint32( p[2] ) << 16 ) | ( quint32( p[3] ) << 24 );
+}
+
+inline quint64 read_u64(
+        const uchar* p
+    )
+{
+    return quint64( read_u32( p ) ) | ( quint64( read_u32( p + 4 ) ) << 32 );
+}
+
+// reads a tar numeric field: octal text or base-256 (GNU, large files)
+qint64 read_tar_number(
+        const char* field,
+        int length
+    )
+{
+    if( (uchar)field[0] & 0x80 ) {
+        qint64 value = (uchar)field[0] & 0x7F;
+        for( int i = 1; i < length; ++i ) {
+            value = ( value << 8 ) | (uchar)field[i];
+        }
+        return value;
+    }
+
+    qint64 value = 0;
+    for( int i = 0; i < length && field[i]; ++i ) {
+        if( field[i] >= '0' && field[i] <= '7' ) {
+            value = value * 8 + ( field[i] - '0' );
+        }
+    }
+    return value;
+}
+
+// reads a NUL-terminated tar text field
+QByteArray read_tar_text(
+        const char* field,
+        int length
+    )
+{
+    int end = 0;
+    while( end < length && field[end] ) {
+        ++end;
+    }
+    return QByteArray( field, end );
+}
+
+}
+
+
+const QString ImageArchive::SEPARATOR = "!/";
+
+
+ImageArchive::ImageArchive(
+        const QString& path,
+        qint64 max_size
+    ) : map_( 0 )
+{
+    QString archive_path;
+    QString member;
+    if( !split_path( path, archive_path, member ) ) {
+        return;
+    }
+
+    QSharedPointer<const Index> idx = index( archive_path );
+    if( !idx ) {
+        return;
+    }
+
+    Index::const_iterator entry_itr = idx->find( member );
+    if( entry_itr == idx->end() ) {
+        return;
+    }
+    const Entry& entry = entry_itr.value();
+
+    file_.setFileName( archive_path );
+    if( !file_.open( QFile::ReadOnly ) ) {
+        return;
+    }
+
+    // the local header of zip members is only read when needed
+    // as its extra field can differ from the central directory one
+    qint64 offset = entry._offset;
+    if( entry._local_header ) {
+        uchar header[30];
+        if( !file_.seek( offset ) || file_.read( (char*)header, 30 ) != 30 || read_u32( header ) != 0x04034b50 ) {
+            return;
+        }
+        offset += 30 + read_u16( header + 26 ) + read_u16( header + 28 );
+    }
+
+    if( entry._size <= 0 || entry._size > MAX_MEMBER_SIZE || entry._packed_size < 0 || entry._packed_size > MAX_MEMBER_SIZE ) {
+        return;
+    }
+
+    qint64 size = ( max_size > 0 )? qMin( entry._size, max_size ) : entry._size;
+
+    if( entry._method == 0 ) {
+        map_ = file_.map( offset, size );
+        if( map_ ) {
+            data_ = QByteArray::fromRawData( (const char*)map_, int( size ) );
+        } else if( file_.seek( offset ) ) {
+            // file systems without mmap support
+            data_ = file_.read( size );
+        }
+        return;
+    }
+
+    if( entry._method != 8 ) {
+        return;
+    }
+
+    uchar* packed = file_.map( offset, entry._packed_size );
+    QByteArray packed_copy;
+    if( !packed ) {
+        if( !file_.seek( offset ) ) {
+            return;
+        }
+        packed_copy = file_.read( entry._packed_size );
+        packed = (uchar*)packed_copy.data();
+    }
+
+    // raw deflate stream (no zlib header)
+    // inflating stops once the output is full: only the packed
+    // pages of the start of the member are read for a limited size
+    QByteArray inflated( int( size ), Qt::Uninitialized );
+    z_stream stream;
+    memset( &stream, 0, sizeof( stream ) );
+    if( inflateInit2( &stream, -MAX_WBITS ) == Z_OK ) {
+        stream.next_in = packed;
+        stream.avail_in = uInt( entry._packed_size );
+        stream.next_out = (Bytef*)inflated.data();
+        stream.avail_out = uInt( size );
+
+        int status = inflate( &stream, ( size == entry._size )? Z_FINISH : Z_SYNC_FLUSH );
+        if( status == Z_STREAM_END || ( size < entry._size && stream.avail_out == 0 && ( status == Z_OK || status == Z_BUF_ERROR ) ) ) {
+            data_ = inflated;
+        }
+        inflateEnd( &stream );
+    }
+
+    if( packed_copy.isEmpty() ) {
+        file_.unmap( packed );
+    }
+}
+
+ImageArchive::~ImageArchive()
+{
+    data_.clear();
+    if( map_ ) {
+        file_.unmap( map_ );
+    }
+}
+
+bool ImageArchive::is_member_path(
+        const QString& path
+    )
+{
+    QString archive_path;
+    QString member;
+    return split_path( path, archive_path, member );
+}
+
+bool ImageArchive::is_archive(
+        const QString& path
+    )
+{
+    QString suffix = QFileInfo( path ).suffix().toLower();
+    return suffix == "zip" || suffix == "tar";
+}
+
+QStringList ImageArchive::name_filters()
+{
+    QStringList filters;
+    filters << "*.zip" << "*.tar";
+
+    return filters;
+}
+
+bool ImageArchive::split_path(
+        const QString& path,
+        QString& archive_path,
+        QString& member
+    )
+{
+    int separator = path.indexOf( SEPARATOR );
+    if( separator <= 0 ) {
+        return false;
+    }
+
+    archive_path = path.left( separator );
+    member = path.mid( separator + SEPARATOR.length() );
+
+    return !member.isEmpty() && is_archive( archive_path );
+}
+
+bool ImageArchive::contains(
+        const QString& path
+    )
+{
+    return member_offset( path ) >= 0;
+}
+
+qint64 ImageArchive::member_offset(
+        const QString& path
+    )
+{
+    QString archive_path;
+    QString member;
+    if( !split_path( path, archive_path, member ) ) {
+        return -1;
+    }
+
+    QSharedPointer<const Index> idx = index( archive_path );
+    if( !idx ) {
+        return -1;
+    }
+
+    Index::const_iterator entry_itr = idx->find( member );
+    return ( entry_itr == idx->end() )? -1 : entry_itr.value()._offset;
+}
+
+QStringList ImageArchive::list_members(
+        const QString& archive_path,
+        const QStringList& name_filters
+    )
+{
+    QStringList members;
+
+    QSharedPointer<const Index> idx = index( archive_path );
+    if( !idx ) {
+        return members;
+    }
+
+    QList<QRegExp> patterns;
+    for( QStringList::const_iterator filter_itr = name_filters.begin(); filter_itr != name_filters.end(); ++filter_itr ) {
+        patterns.append( QRegExp( *filter_itr, Qt::CaseInsensitive, QRegExp::Wildcard ) );
+    }
+
+    QList< QPair<qint64, QString> > matches;
+    for( Index::const_iterator entry_itr = idx->begin(); entry_itr != idx->end(); ++entry_itr ) {
+        QString name = QFileInfo( entry_itr.key() ).fileName();
+        for( QList<QRegExp>::const_iterator pattern_itr = patterns.begin(); pattern_itr != patterns.end(); ++pattern_itr ) {
+            if( pattern_itr->exactMatch( name ) ) {
+                matches.append( qMakePair( entry_itr.value()._offset, entry_itr.key() ) );
+                break;
+            }
+        }
+    }
+
+    // archive order so that members are later read sequentially
+    std::sort( matches.begin(), matches.end() );
+
+    QString prefix = QFileInfo( archive_path ).absoluteFilePath() + SEPARATOR;
+    for( QList< QPair<qint64, QString> >::const_iterator match_itr = matches.begin(); match_itr != matches.end(); ++match_itr ) {
+        members.append( prefix + match_itr->second );
+    }
+
+    return members;
+}
+
+QSharedPointer<const ImageArchive::Index> ImageArchive::index(
+        const QString& archive_path
+    )
+{
+    // the cache is shared by the viewer and the export workers
+    static QMutex cache_mutex;
+    static QHash< QString, QPair< QPair<qint64, QDateTime>, QSharedPointer<const Index> > > cache;
+
+    QFileInfo fi( archive_path );
+    if( !fi.isFile() ) {
+        return QSharedPointer<const Index>();
+    }
+
+    QString key = fi.absoluteFilePath();
+    QPair<qint64, QDateTime> state( fi.size(), fi.lastModified() );
+
+    QMutexLocker locker( &cache_mutex );
+    if( cache.contains( key ) && cache.value( key ).first == state ) {
+        return cache.value( key ).second;
+    }
+
+    // the index of a previous session is reused if the archive is unchanged
+    qint64 mtime = state.second.toMSecsSinceEpoch();
+    Index* new_index = new Index();
+    if( !load_index( key, state.first, mtime, *new_index ) ) {
+        new_index->clear();
+
+        QFile file( key );
+        if( !file.open( QFile::ReadOnly ) ) {
+            delete new_index;
+            return QSharedPointer<const Index>();
+        }
+
+        bool ok = ( fi.suffix().toLower() == "zip" )? build_zip_index( file, *new_index ) : build_tar_index( file, *new_index );
+        file.close();
+
+        if( !ok ) {
+            delete new_index;
+            return QSharedPointer<const Index>();
+        }
+
+        save_index( key, state.first, mtime, *new_index );
+    }
+
+    QSharedPointer<const Index> shared_index( new_index );
+    cache.insert( key, qMakePair( state, shared_index ) );
+
+    return shared_index;
+}
+
+QString ImageArchive::index_path(
+        const QString& archive_path
+    )
+{
+    QString cache_dir = QStandardPaths::writableLocation( QStandardPaths::CacheLocation );
+    QByteArray hash = QCryptographicHash::hash( archive_path.toUtf8(), QCryptographicHash::Md5 ).toHex();
+
+    return cache_dir + "/archives/" + hash + ".idx";
+}
+
+bool ImageArchive::load_index(
+        const QString& archive_path,
+        qint64 size,
+        qint64 mtime,
+        Index& index
+    )
+{
+    QFile file( index_path( archive_path ) );
+    if( !file.open( QFile::ReadOnly ) ) {
+        return false;
+    }
+
+    QDataStream in( &file );
+    in.setVersion( QDataStream::Qt_5_0 );
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString path;
+    qint64 file_size = -1;
+    qint64 file_mtime = -1;
+    quint32 count = 0;
+    in >> magic >> version >> path >> file_size >> file_mtime >> count;
+    if( magic != INDEX_MAGIC || version != INDEX_VERSION || path != archive_path || file_size != size || file_mtime != mtime ) {
+        return false;
+    }
+
+    index.reserve( int( count ) );
+    for( quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i ) {
+        QString name;
+        Entry entry;
+        qint32 method = 0;
+        in >> name >> entry._offset >> entry._size >> entry._packed_size >> method >> entry._local_header;
+        entry._method = method;
+        index.insert( name, entry );
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+bool ImageArchive::save_index(
+        const QString& archive_path,
+        qint64 size,
+        qint64 mtime,
+        const Index& index
+    )
+{
+    QString filename = index_path( archive_path );
+    if( !QDir().mkpath( QFileInfo( filename ).path() ) ) {
+        return false;
+    }
+
+    QSaveFile file( filename );
+    if( !file.open( QFile::WriteOnly ) ) {
+        return false;
+    }
+
+    QDataStream out( &file );
+    out.setVersion( QDataStream::Qt_5_0 );
+    out << INDEX_MAGIC << INDEX_VERSION << archive_path << size << mtime << quint32( index.count() );
+
+    for( Index::const_iterator entry_itr = index.begin(); entry_itr != index.end(); ++entry_itr ) {
+        const Entry& entry = entry_itr.value();
+        out << entry_itr.key() << entry._offset << entry._size << entry._packed_size << qint32( entry._method ) << entry._local_header;
+    }
+
+    if( out.status() != QDataStream::Ok ) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
+
+bool ImageArchive::build_tar_index(
+        QFile& file,
+        Index& index
+    )
+{
+    const int BLOCK_SIZE = 512;
+    char header[BLOCK_SIZE];
+
+    QByteArray long_name;
+    qint64 pos = 0;
+    qint64 file_size = file.size();
+
+    // only headers are read: member data is skipped
+    while( pos + BLOCK_SIZE <= file_size ) {
+        if( !file.seek( pos ) || file.read( header, BLOCK_SIZE ) != BLOCK_SIZE ) {
+            return false;
+        }
+
+        // end of archive
+        if( header[0] == '\0' ) {
+            break;
+        }
+
+        qint64 size = read_tar_number( header + 124, 12 );
+        char type = header[156];
+        qint64 data_offset = pos + BLOCK_SIZE;
+        pos = data_offset + ( ( size + BLOCK_SIZE - 1 ) / BLOCK_SIZE ) * BLOCK_SIZE;
+
+        if( type == 'L' || type == 'x' ) {
+            // GNU long name or pax extended header for the next member
+            if( !file.seek( data_offset ) ) {
+                return false;
+            }
+            QByteArray data = file.read( size );
+
+            if( type == 'L' ) {
+                long_name = read_tar_text( data.constData(), data.size() );
+                continue;
+            }
+
+            // pax records: "<length> <key>=<value>\n"
+            int record = 0;
+            while( record < data.size() ) {
+                int space = data.indexOf( ' ', record );
+                if( space < 0 ) {
+                    break;
+                }
+                int length = data.mid( record, space - record ).toInt();
+                if( length <= 0 ) {
+                    break;
+                }
+                QByteArray field = data.mid( space + 1, length - ( space - record ) - 2 );
+                if( field.startsWith( "path=" ) ) {
+                    long_name = field.mid( 5 );
+                }
+                record += length;
+            }
+            continue;
+        }
+
+        QByteArray name;
+        if( !long_name.isEmpty() ) {
+            name = long_name;
+            long_name.clear();
+        } else {
+            name = read_tar_text( header, 100 );
+            // POSIX ustar only: the old GNU format ("ustar  ")
+            // uses the prefix field for other data
+            if( memcmp( header + 257, "ustar", 6 ) == 0 ) {
+                QByteArray prefix = read_tar_text( header + 345, 155 );
+                if( !prefix.isEmpty() ) {
+                    name = prefix + "/" + name;
+                }
+            }
+        }
+
+        // regular files only
+        if( type != '0' && type != '\0' ) {
+            continue;
+        }
+
+        if( name.startsWith( "./" ) ) {
+            name = name.mid( 2 );
+        }
+
+        Entry entry;
+        entry._offset = data_offset;
+        entry._size = size;
+        entry._packed_size = size;
+        entry._method = 0;
+        entry._local_header = false;
+        index.insert( QString::fromUtf8( name ), entry );
+    }
+
+    return true;
+}
+
+bool ImageArchive::build_zip_index(
+        QFile& file,
+        Index& index
+    )
+{
+    // the end of central directory record is in the last 64 KB + 22 bytes
+    qint64 file_size = file.size();
+    qint64 tail_size = qMin( file_size, qint64( 65536 + 22 ) );
+    if( tail_size < 22 || !file.seek( file_size - tail_size ) ) {
+        return false;
+    }
+    QByteArray tail = file.read( tail_size );
+    const uchar* tail_data = (const uchar*)tail.constData();
+
+    int eocd = tail.size() - 22;
+    while( eocd >= 0 && read_u32( tail_data + eocd ) != 0x06054b50 ) {
+        --eocd;
+    }
+    if( eocd < 0 ) {
+        return false;
+    }
+
+    quint64 entry_count = read_u16( tail_data + eocd + 10 );
+    quint64 directory_size = read_u32( tail_data + eocd + 12 );
+    quint64 directory_offset = read_u32( tail_data + eocd + 16 );
+
+    // zip64 end of central directory locator precedes the record
+    if( eocd >= 20 && read_u32( tail_data + eocd - 20 ) == 0x07064b50 ) {
+        uchar record[56];
+        quint64 record_offset = read_u64( tail_data + eocd - 20 + 8 );
+        if( !file.seek( record_offset ) || file.read( (char*)record, 56 ) != 56 || read_u32( record ) != 0x06064b50 ) {
+            return false;
+        }
+        entry_count = read_u64( record + 32 );
+        directory_size = read_u64( record + 40 );
+        directory_offset = read_u64( record + 48 );
+    }
+
+    if( !file.seek( directory_offset ) ) {
+        return false;
+    }
+    QByteArray directory = file.read( directory_size );
+    if( quint64( directory.size() ) != directory_size ) {
+        return false;
+    }
+
+    const uchar* data = (const uchar*)directory.constData();
+    quint64 pos = 0;
+    for( quint64 e = 0; e < entry_count; ++e ) {
+        if( pos + 46 > directory_size || read_u32( data + pos ) != 0x02014b50 ) {
+            return false;
+        }
+
+        const uchar* header = data + pos;
+        int method = read_u16( header + 10 );
+        quint64 packed_size = read_u32( header + 20 );
+        quint64 size = read_u32( header + 24 );
+        int name_length = read_u16( header + 28 );
+        int extra_length = read_u16( header + 30 );
+        int comment_length = read_u16( header + 32 );
+        quint64 offset = read_u32( header + 42 );
+
+        if( pos + 46 + name_length + extra_length > directory_size ) {
+            return false;
+        }
+
+        // zip64 extended information replaces the saturated fields
+        const uchar* extra = header + 46 + name_length;
+        int extra_pos = 0;
+        while( extra_pos + 4 <= extra_length ) {
+            int id = read_u16( extra + extra_pos );
+            int length = read_u16( extra + extra_pos + 2 );
+            if( id == 0x0001 ) {
+                const uchar* field = extra + extra_pos + 4;
+                const uchar* field_end = field + length;
+                if( size == 0xFFFFFFFF && field + 8 <= field_end ) {
+                    size = read_u64( field );
+                    field += 8;
+                }
+                if( packed_size == 0xFFFFFFFF && field + 8 <= field_end ) {
+                    packed_size = read_u64( field );
+                    field += 8;
+                }
+                if( offset == 0xFFFFFFFF && field + 8 <= field_end ) {
+                    offset = read_u64( field );
+                }
+            }
+            extra_pos += 4 + length;
+        }
+
+        QString name = QString::fromUtf8( (const char*)header + 46, name_length );
+        pos += 46 + name_length + extra_length + comment_length;
+
+        // directories end with a slash
+        if( name.endsWith( '/' ) ) {
+            continue;
+        }
+
+        Entry entry;
+        entry._offset = offset;
+        entry._size = size;
+        entry._packed_size = packed_size;
+        entry._method = method;
+        entry._local_header = true;
+        index.insert( name, entry );
+    }
+
+    return true;
+}
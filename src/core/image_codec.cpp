@@ -0,0 +1,335 @@
+#include <core/image_codec.h>
+#include <core/image_archive.h>
+
+#include <QImageWriter>
+#include <QImageReader>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QBuffer>
+#include <QScopedPointer>
+
+#include <cstring>
+
+namespace {
+
+// bytes of an archive member read by the header probes
+// (large enough for the metadata segments preceding a JPEG frame header)
+const qint64 HEADER_SIZE = 256 * 1024;
+
+// image reader of a file or of an archive member (see ImageArchive)
+// the member data is kept as long as the reader
+class PathReader
+{
+public:
+    // max_size (optional) limits the member data read (header probes)
+    PathReader(
+            const QString& path,
+            qint64 max_size = -1
+        )
+    {
+        if( !ImageArchive::is_member_path( path ) ) {
+            reader_.setFileName( path );
+            return;
+        }
+
+        member_.reset( new ImageArchive( path, max_size ) );
+        data_ = member_->data();
+        buffer_.setBuffer( &data_ );
+        buffer_.open( QBuffer::ReadOnly );
+
+        reader_.setDevice( &buffer_ );
+        reader_.setFormat( QFileInfo( path ).suffix().toLatin1() );
+    }
+
+    QImageReader& reader()
+    {
+        return reader_;
+    }
+
+private:
+    Q_DISABLE_COPY( PathReader )
+
+    QScopedPointer<ImageArchive> member_;
+    QByteArray data_;
+    QBuffer buffer_;
+    QImageReader reader_;
+};
+
+}
+
+
+ImageCodec::Options::Options() :
+    _format( SOURCE_FORMAT ),
+    _png_compression( -1 ),
+    _jpeg_quality( -1 ),
+    _jpeg_optimize( false )
+{
+}
+
+QSize ImageCodec::probe_size(
+        const QString& path
+    )
+{
+    QSize size = PathReader( path, HEADER_SIZE ).reader().size();
+    if( !size.isValid() && ImageArchive::is_member_path( path ) ) {
+        // header larger than the probed bytes
+        size = PathReader( path ).reader().size();
+    }
+
+    return size;
+}
+
+int ImageCodec::probe_channels(
+        const QString& path
+    )
+{
+    QImage::Format format = PathReader( path, HEADER_SIZE ).reader().imageFormat();
+    if( format == QImage::Format_Invalid && ImageArchive::is_member_path( path ) ) {
+        format = PathReader( path ).reader().imageFormat();
+    }
+
+    switch( format ) {
+    case QImage::Format_Mono:
+    case QImage::Format_MonoLSB:
+    case QImage::Format_Grayscale8:
+        return 1;
+    default:
+        return 3;
+    }
+}
+
+bool ImageCodec::supports_region_decoding(
+        const QString& path
+    )
+{
+    if( ImageArchive::is_member_path( path ) ) {
+        // the handler of the format is created without reading the device:
+        // an empty buffer avoids opening (and inflating) the member
+        QBuffer buffer;
+        buffer.open( QBuffer::ReadOnly );
+
+        QImageReader reader( &buffer, QFileInfo( path ).suffix().toLatin1() );
+        reader.setAutoDetectImageFormat( false );
+        return reader.supportsOption( QImageIOHandler::ClipRect );
+    }
+
+    QImageReader reader( path );
+    return reader.supportsOption( QImageIOHandler::ClipRect );
+}
+
+QImage ImageCodec::read(
+        const QString& path,
+        const QSize& scaled_size,
+        const QRect& clip
+    )
+{
+    PathReader path_reader( path );
+    return read( path_reader.reader(), scaled_size, clip );
+}
+
+QImage ImageCodec::read(
+        QImageReader& reader,
+        const QSize& scaled_size,
+        const QRect& clip
+    )
+{
+    if( clip.isValid() ) {
+        reader.setClipRect( clip );
+    }
+
+    if( scaled_size.isValid() ) {
+        reader.setScaledSize( scaled_size );
+    }
+
+    return reader.read();
+}
+
+QString ImageCodec::suffix(
+        const Options& options,
+        const QString& source_path
+    )
+{
+    switch( options._format ) {
+    case PNG:
+        return "png";
+    case JPEG:
+        return "jpg";
+    case PPM:
+        // a single extension per export: grayscale images
+        // are written as RGB too (binary P6 flavor)
+        return "ppm";
+    case QOI:
+        return "qoi";
+    default:
+        break;
+    }
+
+    return QFileInfo( source_path ).suffix();
+}
+
+bool ImageCodec::encode(
+        QIODevice* out,
+        const QImage& image,
+        const Options& options,
+        const QString& source_path
+    )
+{
+    if( !out || image.isNull() ) {
+        return false;
+    }
+
+    if( options._format == QOI ) {
+        return encode_qoi( out, image );
+    }
+
+    QImageWriter writer( out, suffix( options, source_path ).toLatin1() );
+
+    if( options._format == PPM ) {
+        return writer.write( image.convertToFormat( QImage::Format_RGB32 ) );
+    }
+
+    if( options._format == PNG && options._png_compression >= 0 ) {
+        // Qt maps the PNG quality [0,100] to the zlib level [9,0]
+        // with level = ( 100 - quality ) * 9 / 91
+        int level = qBound( 0, options._png_compression, 9 );
+        writer.setQuality( 100 - ( level * 91 + 8 ) / 9 );
+
+    } else if( options._format == JPEG ) {
+        if( options._jpeg_quality >= 0 ) {
+            writer.setQuality( qBound( 0, options._jpeg_quality, 100 ) );
+        }
+        // the single pass baseline encoding is the fastest
+        // libjpeg DCT method is not exposed by the Qt writer
+        writer.setOptimizedWrite( options._jpeg_optimize );
+        writer.setProgressiveScanWrite( false );
+    }
+
+    return writer.write( image );
+}
+
+bool ImageCodec::encode_qoi(
+        QIODevice* out,
+        const QImage& image
+    )
+{
+    if( !out || image.isNull() ) {
+        return false;
+    }
+
+    const bool has_alpha = image.hasAlphaChannel();
+    const QImage rgba = image.convertToFormat( QImage::Format_RGBA8888 );
+    const int w = rgba.width();
+    const int h = rgba.height();
+
+    // worst case is 5 bytes per pixel (QOI_OP_RGBA)
+    // + 14 bytes header + 8 bytes end marker
+    QByteArray data;
+    data.resize( 14 + w * h * ( has_alpha? 5 : 4 ) + 8 );
+    uchar* bytes = reinterpret_cast<uchar*>( data.data() );
+    int p = 0;
+
+    // header: magic, width, height (big endian), channels, colorspace (sRGB)
+    bytes[p++] = 'q';
+    bytes[p++] = 'o';
+    bytes[p++] = 'i';
+    bytes[p++] = 'f';
+    for( int shift = 24; shift >= 0; shift -= 8 ) {
+        bytes[p++] = uchar( w >> shift );
+    }
+    for( int shift = 24; shift >= 0; shift -= 8 ) {
+        bytes[p++] = uchar( h >> shift );
+    }
+    bytes[p++] = has_alpha? 4 : 3;
+    bytes[p++] = 0;
+
+    const uchar QOI_OP_INDEX = 0x00;
+    const uchar QOI_OP_DIFF = 0x40;
+    const uchar QOI_OP_LUMA = 0x80;
+    const uchar QOI_OP_RUN = 0xc0;
+    const uchar QOI_OP_RGB = 0xfe;
+    const uchar QOI_OP_RGBA = 0xff;
+
+    // pixels are handled as r, g, b, a bytes
+    // packed in a 32-bit value for comparison
+    quint32 index[64];
+    memset( index, 0, sizeof( index ) );
+
+    uchar prev[4] = { 0, 0, 0, 255 };
+    quint32 prev_px = 0;
+    memcpy( &prev_px, prev, 4 );
+    int run = 0;
+
+    for( int y = 0; y < h; ++y ) {
+        const uchar* line = rgba.constScanLine( y );
+        const bool last_line = ( y == h - 1 );
+
+        for( int x = 0; x < w; ++x ) {
+            const uchar* px = line + 4 * x;
+            quint32 cur_px;
+            memcpy( &cur_px, px, 4 );
+
+            if( cur_px == prev_px ) {
+                ++run;
+                if( run == 62 || ( last_line && x == w - 1 ) ) {
+                    bytes[p++] = QOI_OP_RUN | uchar( run - 1 );
+                    run = 0;
+                }
+                continue;
+            }
+
+            if( run > 0 ) {
+                bytes[p++] = QOI_OP_RUN | uchar( run - 1 );
+                run = 0;
+            }
+
+            int hash = ( px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11 ) % 64;
+
+            if( index[hash] == cur_px ) {
+                bytes[p++] = QOI_OP_INDEX | uchar( hash );
+
+            } else {
+                index[hash] = cur_px;
+
+                if( px[3] == prev[3] ) {
+                    signed char vr = static_cast<signed char>( px[0] - prev[0] );
+                    signed char vg = static_cast<signed char>( px[1] - prev[1] );
+                    signed char vb = static_cast<signed char>( px[2] - prev[2] );
+                    signed char vg_r = static_cast<signed char>( vr - vg );
+                    signed char vg_b = static_cast<signed char>( vb - vg );
+
+                    if( vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2 ) {
+                        bytes[p++] = QOI_OP_DIFF | uchar( ( vr + 2 ) << 4 | ( vg + 2 ) << 2 | ( vb + 2 ) );
+
+                    } else if( vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8 ) {
+                        bytes[p++] = QOI_OP_LUMA | uchar( vg + 32 );
+                        bytes[p++] = uchar( ( vg_r + 8 ) << 4 | ( vg_b + 8 ) );
+
+                    } else {
+                        bytes[p++] = QOI_OP_RGB;
+                        bytes[p++] = px[0];
+                        bytes[p++] = px[1];
+                        bytes[p++] = px[2];
+                    }
+
+                } else {
+                    bytes[p++] = QOI_OP_RGBA;
+                    bytes[p++] = px[0];
+                    bytes[p++] = px[1];
+                    bytes[p++] = px[2];
+                    bytes[p++] = px[3];
+                }
+            }
+
+            memcpy( prev, px, 4 );
+            prev_px = cur_px;
+        }
+    }
+
+    // end marker
+    for( int i = 0; i < 7; ++i ) {
+        bytes[p++] = 0;
+    }
+    bytes[p++] = 1;
+
+    return out->write( data.constData(), p ) == p;
+}
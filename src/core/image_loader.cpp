@@ -0,0 +1,242 @@
+#include <core/image_loader.h>
+#include <core/image_codec.h>
+#include <core/image_metadata.h>
+
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+
+namespace {
+
+// priorities of the pool queue
+const int CURRENT_PRIORITY = 2;
+const int FULL_RESOLUTION_PRIORITY = 1;
+const int NEIGHBOR_PRIORITY = 0;
+
+}
+
+
+// decodes a single image if it is still wanted
+class ImageLoadTask : public QRunnable
+{
+public:
+    ImageLoadTask(
+            ImageLoader* loader,
+            const QString& path,
+            const QSize& display_size
+        ) : loader_( loader ), path_( path ), display_size_( display_size )
+    {
+    }
+
+    virtual void run()
+    {
+        if( !loader_->take( ImageLoader::request_key( path_, display_size_ ) ) ) {
+            return;
+        }
+
+        // the header gives the size to decode at
+        // so that the decoder can directly decode at reduced size
+        QSize full_size = ImageMetadata::image_size( path_ );
+        QSize scaled_size;
+        if( display_size_.isValid() && full_size.isValid() &&
+            ( full_size.width() > display_size_.width() || full_size.height() > display_size_.height() )
+        ) {
+            scaled_size = full_size.scaled( display_size_, Qt::KeepAspectRatio ).expandedTo( QSize( 1, 1 ) );
+        }
+
+        QImage image = ImageCodec::read( path_, scaled_size );
+        if( !full_size.isValid() ) {
+            full_size = image.size();
+        }
+
+        // converted here so that the pixmap conversion
+        // in the interface thread is a plain copy
+        if( !image.isNull() ) {
+            image = image.convertToFormat( image.hasAlphaChannel()? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+        }
+
+        emit loader_->decoded( path_, display_size_, image, full_size );
+    }
+
+private:
+    ImageLoader* loader_;
+    QString path_;
+    QSize display_size_;
+};
+
+
+ImageLoader::ImageLoader(
+        int max_cost,
+        QObject* parent
+    ) : QObject( parent ), images_( max_cost ), hits_( 0 ), misses_( 0 )
+{
+    // the current image and a couple of neighbors at a time
+    pool_.setMaxThreadCount( qBound( 1, QThread::idealThreadCount() / 2, 4 ) );
+
+    connect(
+        this, SIGNAL( decoded(QString,QSize,QImage,QSize) ),
+        this, SLOT( add_image(QString,QSize,QImage,QSize) ),
+        Qt::QueuedConnection
+    );
+}
+
+ImageLoader::~ImageLoader()
+{
+    {
+        QMutexLocker locker( &mutex_ );
+        wanted_.clear();
+    }
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+QString ImageLoader::request_key(
+        const QString& path,
+        const QSize& display_size
+    )
+{
+    return display_size.isValid()? path : path + "#full";
+}
+
+bool ImageLoader::cached(
+        const QString& path,
+        QImage& image,
+        QSize& full_size
+    )
+{
+    const CachedImage* cached_image = images_.object( path );
+    if( !cached_image && !path.isEmpty() && path == oversized_path_ ) {
+        cached_image = &oversized_;
+    }
+
+    if( !cached_image ) {
+        ++misses_;
+        return false;
+    }
+
+    image = cached_image->_image;
+    full_size = cached_image->_full_size;
+    ++hits_;
+    return true;
+}
+
+void ImageLoader::load(
+        const QString& path,
+        const QStringList& neighbors,
+        const QSize& display_size
+    )
+{
+    {
+        QMutexLocker locker( &mutex_ );
+        wanted_.clear();
+        wanted_.insert( request_key( path, display_size ) );
+        for( QStringList::const_iterator path_itr = neighbors.begin(); path_itr != neighbors.end(); ++path_itr ) {
+            wanted_.insert( request_key( *path_itr, display_size ) );
+        }
+    }
+
+    enqueue( path, display_size, CURRENT_PRIORITY );
+    for( QStringList::const_iterator path_itr = neighbors.begin(); path_itr != neighbors.end(); ++path_itr ) {
+        enqueue( *path_itr, display_size, NEIGHBOR_PRIORITY );
+    }
+}
+
+void ImageLoader::load_full_resolution(
+        const QString& path
+    )
+{
+    {
+        QMutexLocker locker( &mutex_ );
+        wanted_.insert( request_key( path, QSize() ) );
+    }
+
+    enqueue( path, QSize(), FULL_RESOLUTION_PRIORITY );
+}
+
+void ImageLoader::enqueue(
+        const QString& path,
+        const QSize& display_size,
+        int priority
+    )
+{
+    if( path.isEmpty() ) {
+        return;
+    }
+
+    // any resolution is fine for display size requests
+    const CachedImage* cached_image = images_.object( path );
+    if( !cached_image && path == oversized_path_ ) {
+        cached_image = &oversized_;
+    }
+    if( cached_image && ( display_size.isValid() || cached_image->is_full_resolution() ) ) {
+        return;
+    }
+
+    QString key = request_key( path, display_size );
+    {
+        QMutexLocker locker( &mutex_ );
+        if( in_flight_.contains( key ) ) {
+            return;
+        }
+        in_flight_.insert( key );
+    }
+
+    pool_.start( new ImageLoadTask( this, path, display_size ), priority );
+}
+
+bool ImageLoader::take(
+        const QString& key
+    )
+{
+    QMutexLocker locker( &mutex_ );
+    if( wanted_.contains( key ) ) {
+        return true;
+    }
+
+    in_flight_.remove( key );
+    return false;
+}
+
+void ImageLoader::add_image(
+        const QString& path,
+        const QSize& display_size,
+        const QImage& image,
+        const QSize& full_size
+    )
+{
+    {
+        QMutexLocker locker( &mutex_ );
+        in_flight_.remove( request_key( path, display_size ) );
+    }
+
+    CachedImage decoded_image;
+    decoded_image._image = image;
+    decoded_image._full_size = full_size;
+
+    // a reduced image decoded after the full resolution one is dropped
+    const CachedImage* cached_image = images_.object( path );
+    if( cached_image && cached_image->is_full_resolution() && !decoded_image.is_full_resolution() ) {
+        return;
+    }
+
+    store( path, decoded_image );
+    emit image_ready( path );
+}
+
+void ImageLoader::store(
+        const QString& path,
+        const CachedImage& cached_image
+    )
+{
+    // images that cannot be decoded are cached as null images
+    // so that the viewer does not wait for them
+    // the cost is at least 1 so that they are evicted as well
+    int image_cost = qMax( 1, cached_image._image.byteCount() / 1024 );
+    if( image_cost > images_.maxCost() ) {
+        images_.remove( path );
+        oversized_path_ = path;
+        oversized_ = cached_image;
+    } else {
+        images_.insert( path, new CachedImage( cached_image ), image_cost );
+    }
+}
@@ -0,0 +1,321 @@
+#include <core/image_metadata.h>
+#include <core/image_codec.h>
+#include <core/image_archive.h>
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QProgressDialog>
+#include <QtConcurrent>
+
+namespace {
+
+// sidecar file header
+const quint32 SIDECAR_MAGIC = 0x4242544d; // "BBTM"
+const quint32 SIDECAR_VERSION = 2;
+
+// entries of the process
+// valid entries were checked against the file system in this session
+struct Store {
+    QMutex _mutex;
+    QHash<QString, ImageMetadata::Entry> _entries;
+    QSet<QString> _valid;
+};
+
+Store& store()
+{
+    static Store the_store;
+    return the_store;
+}
+
+// returns the file holding the image (the archive for archive members)
+QString backing_file(
+        const QString& path
+    )
+{
+    if( ImageArchive::is_member_path( path ) ) {
+        return path.left( path.indexOf( ImageArchive::SEPARATOR ) );
+    }
+    return path;
+}
+
+// entry of the store to validate
+struct RefreshJob {
+    QString _path;
+    ImageMetadata::Entry _entry;
+    bool _cached;
+    bool _exists;
+    bool _probed;
+};
+
+// validates an entry against the file system
+// only one stat is needed if the entry is up to date
+struct RefreshJobRunner {
+    typedef RefreshJob result_type;
+
+    RefreshJob operator()(
+            const RefreshJob& job
+        ) const
+    {
+        RefreshJob result = job;
+        result._probed = false;
+        result._exists = true;
+
+        if( result._cached && ImageMetadata::is_up_to_date( result._path, result._entry ) ) {
+            return result;
+        }
+
+        result._probed = true;
+        result._exists = ImageMetadata::probe( result._path, result._entry );
+        return result;
+    }
+};
+
+}
+
+
+ImageMetadata::Entry::Entry(
+    ) : _file_size( -1 ), _mtime( -1 )
+{
+}
+
+QString ImageMetadata::sidecar_path(
+        const QString& filename
+    )
+{
+    return filename + ".meta";
+}
+
+bool ImageMetadata::load(
+        const QString& sidecar
+    )
+{
+    QFile file( sidecar );
+    if( !file.open( QFile::ReadOnly ) ) {
+        return false;
+    }
+
+    QDataStream in( &file );
+    in.setVersion( QDataStream::Qt_5_0 );
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> count;
+    if( magic != SIDECAR_MAGIC || version != SIDECAR_VERSION ) {
+        return false;
+    }
+
+    // entries are read before taking the lock
+    // so that lookups are not blocked by the disk
+    QHash<QString, Entry> entries;
+    entries.reserve( int( count ) );
+    for( quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i ) {
+        QString path;
+        Entry entry;
+        in >> path >> entry._file_size >> entry._mtime >> entry._size;
+        entries.insert( path, entry );
+    }
+
+    if( in.status() != QDataStream::Ok ) {
+        return false;
+    }
+
+    Store& s = store();
+    QMutexLocker locker( &s._mutex );
+    for( QHash<QString, Entry>::const_iterator entry_itr = entries.begin(); entry_itr != entries.end(); ++entry_itr ) {
+        // entries checked in this session are more recent
+        if( !s._valid.contains( entry_itr.key() ) ) {
+            s._entries.insert( entry_itr.key(), entry_itr.value() );
+        }
+    }
+
+    return true;
+}
+
+bool ImageMetadata::save(
+        const QString& sidecar,
+        const QStringList& paths
+    )
+{
+    QHash<QString, Entry> entries;
+    {
+        Store& s = store();
+        QMutexLocker locker( &s._mutex );
+        for( QStringList::const_iterator path_itr = paths.begin(); path_itr != paths.end(); ++path_itr ) {
+            QHash<QString, Entry>::const_iterator entry_itr = s._entries.find( *path_itr );
+            if( entry_itr != s._entries.end() ) {
+                entries.insert( entry_itr.key(), entry_itr.value() );
+            }
+        }
+    }
+
+    QSaveFile file( sidecar );
+    if( !file.open( QFile::WriteOnly ) ) {
+        return false;
+    }
+
+    QDataStream out( &file );
+    out.setVersion( QDataStream::Qt_5_0 );
+    out << SIDECAR_MAGIC << SIDECAR_VERSION << quint32( entries.count() );
+
+    for( QHash<QString, Entry>::const_iterator entry_itr = entries.begin(); entry_itr != entries.end(); ++entry_itr ) {
+        const Entry& entry = entry_itr.value();
+        out << entry_itr.key() << entry._file_size << entry._mtime << entry._size;
+    }
+
+    if( out.status() != QDataStream::Ok ) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
+
+QStringList ImageMetadata::refresh(
+        const QStringList& paths,
+        int* changed,
+        QProgressDialog* progress
+    )
+{
+    QList<RefreshJob> jobs;
+    jobs.reserve( paths.count() );
+    {
+        Store& s = store();
+        QMutexLocker locker( &s._mutex );
+        for( QStringList::const_iterator path_itr = paths.begin(); path_itr != paths.end(); ++path_itr ) {
+            RefreshJob job;
+            job._path = *path_itr;
+            job._exists = false;
+            job._probed = false;
+
+            QHash<QString, Entry>::const_iterator entry_itr = s._entries.find( *path_itr );
+            job._cached = ( entry_itr != s._entries.end() );
+            if( job._cached ) {
+                job._entry = entry_itr.value();
+            }
+            jobs.append( job );
+        }
+    }
+
+    // stats are a metadata round trip each on network file systems
+    QFuture<RefreshJob> future = QtConcurrent::mapped( jobs, RefreshJobRunner() );
+    if( progress ) {
+        progress->setMaximum( jobs.count() );
+        while( !future.isFinished() ) {
+            // stay below maximum otherwise the dialog resets itself
+            progress->setValue( qMin( future.progressValue(), progress->maximum() - 1 ) );
+            if( progress->wasCanceled() ) {
+                future.cancel();
+            }
+            QThread::msleep( 50 );
+        }
+        progress->setValue( progress->maximum() );
+    }
+    future.waitForFinished();
+
+    // only the checked paths when canceled
+    QList<RefreshJob> results = future.results();
+
+    QStringList existing;
+    int probed = 0;
+
+    Store& s = store();
+    QMutexLocker locker( &s._mutex );
+    for( QList<RefreshJob>::const_iterator result_itr = results.begin(); result_itr != results.end(); ++result_itr ) {
+        if( result_itr->_probed ) {
+            ++probed;
+        }
+
+        if( !result_itr->_exists ) {
+            s._entries.remove( result_itr->_path );
+            s._valid.remove( result_itr->_path );
+            continue;
+        }
+
+        s._entries.insert( result_itr->_path, result_itr->_entry );
+        s._valid.insert( result_itr->_path );
+        existing.append( result_itr->_path );
+    }
+
+    if( changed ) {
+        *changed = probed;
+    }
+
+    return existing;
+}
+
+bool ImageMetadata::is_valid(
+        const QString& path
+    )
+{
+    Store& s = store();
+    QMutexLocker locker( &s._mutex );
+    return s._valid.contains( path );
+}
+
+QSize ImageMetadata::image_size(
+        const QString& path
+    )
+{
+    {
+        Store& s = store();
+        QMutexLocker locker( &s._mutex );
+        if( s._valid.contains( path ) ) {
+            return s._entries.value( path )._size;
+        }
+    }
+
+    Entry entry;
+    if( !probe( path, entry ) ) {
+        return QSize();
+    }
+
+    Store& s = store();
+    QMutexLocker locker( &s._mutex );
+    s._entries.insert( path, entry );
+    s._valid.insert( path );
+
+    return entry._size;
+}
+
+bool ImageMetadata::probe(
+        const QString& path,
+        Entry& entry
+    )
+{
+    QFileInfo fi( backing_file( path ) );
+    if( !fi.isFile() ) {
+        return false;
+    }
+
+    if( ImageArchive::is_member_path( path ) && !ImageArchive::contains( path ) ) {
+        return false;
+    }
+
+    entry._file_size = fi.size();
+    entry._mtime = fi.lastModified().toMSecsSinceEpoch();
+    entry._size = ImageCodec::probe_size( path );
+
+    return true;
+}
+
+bool ImageMetadata::is_up_to_date(
+        const QString& path,
+        const Entry& entry
+    )
+{
+    QFileInfo fi( backing_file( path ) );
+    if( !fi.isFile() ) {
+        return false;
+    }
+
+    return fi.size() == entry._file_size && fi.lastModified().toMSecsSinceEpoch() == entry._mtime;
+}
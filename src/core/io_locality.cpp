@@ -0,0 +1,186 @@
+#include <core/io_locality.h>
+#include <core/image_archive.h>
+
+#include <QFileInfo>
+#include <QFile>
+#include <QThread>
+#include <QProgressDialog>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <climits>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <cstring>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+namespace {
+
+// sort key of a file
+struct LocalityKey {
+    QString _dir;
+    quint64 _location;
+    QString _path;
+
+    bool operator < ( const LocalityKey& other ) const {
+        if( _dir != other._dir ) {
+            return _dir < other._dir;
+        }
+        if( _location != other._location ) {
+            return _location < other._location;
+        }
+        return _path < other._path;
+    }
+};
+
+// returns the physical location key of the file
+// only meaningful to compare files of the same directory
+quint64 location_key(
+        const QString& path
+    )
+{
+#ifdef Q_OS_UNIX
+    int fd = ::open( QFile::encodeName( path ).constData(), O_RDONLY );
+    if( fd < 0 ) {
+        return 0;
+    }
+
+    quint64 key = 0;
+
+#ifdef Q_OS_LINUX
+    // physical offset of the first extent
+    // (only supported by local file systems)
+    struct {
+        struct fiemap map;
+        struct fiemap_extent extent;
+    } fm;
+    memset( &fm, 0, sizeof( fm ) );
+    fm.map.fm_start = 0;
+    fm.map.fm_length = ~0ULL;
+    fm.map.fm_extent_count = 1;
+
+    if( ioctl( fd, FS_IOC_FIEMAP, &fm.map ) == 0 && fm.map.fm_mapped_extents > 0 ) {
+        key = fm.extent.fe_physical;
+    }
+#endif
+
+    // inode numbers roughly follow the creation order
+    // which is a good proxy of the disk layout (and of NFS server order)
+    if( key == 0 ) {
+        struct stat st;
+        if( fstat( fd, &st ) == 0 ) {
+            key = st.st_ino;
+        }
+    }
+
+    ::close( fd );
+    return key;
+#else
+    Q_UNUSED( path );
+    return 0;
+#endif
+}
+
+// computes the key of a file
+// keys are computed in parallel as each costs a metadata round trip
+struct LocalityKeyMaker {
+    typedef LocalityKey result_type;
+
+    LocalityKey operator()(
+            const QString& path
+        ) const;
+};
+
+}
+
+
+QStringList IOLocality::sort_by_locality(
+        const QStringList& paths,
+        QProgressDialog* progress
+    )
+{
+    QFuture<LocalityKey> future = QtConcurrent::mapped( paths, LocalityKeyMaker() );
+    if( progress ) {
+        progress->setMaximum( paths.count() );
+        while( !future.isFinished() ) {
+            // stay below maximum otherwise the dialog resets itself
+            progress->setValue( qMin( future.progressValue(), progress->maximum() - 1 ) );
+            if( progress->wasCanceled() ) {
+                future.cancel();
+                future.waitForFinished();
+                return paths;
+            }
+            QThread::msleep( 50 );
+        }
+    }
+    future.waitForFinished();
+
+    QList<LocalityKey> keys = future.results();
+    std::sort( keys.begin(), keys.end() );
+
+    QStringList sorted;
+    for( QList<LocalityKey>::const_iterator key_itr = keys.begin(); key_itr != keys.end(); ++key_itr ) {
+        sorted.append( key_itr->_path );
+    }
+
+    return sorted;
+}
+
+void IOLocality::will_need(
+        const QStringList& paths
+    )
+{
+#ifdef Q_OS_UNIX
+    for( QStringList::const_iterator path_itr = paths.begin(); path_itr != paths.end(); ++path_itr ) {
+        int fd = ::open( QFile::encodeName( *path_itr ).constData(), O_RDONLY );
+        if( fd < 0 ) {
+            continue;
+        }
+
+#if defined( POSIX_FADV_WILLNEED )
+        posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+#elif defined( F_RDADVISE )
+        struct stat st;
+        if( fstat( fd, &st ) == 0 ) {
+            struct radvisory advice;
+            advice.ra_offset = 0;
+            advice.ra_count = int( qMin( qint64( st.st_size ), qint64( INT_MAX ) ) );
+            fcntl( fd, F_RDADVISE, &advice );
+        }
+#endif
+        ::close( fd );
+    }
+#else
+    Q_UNUSED( paths );
+#endif
+}
+
+LocalityKey LocalityKeyMaker::operator()(
+        const QString& path
+    ) const
+{
+    LocalityKey key;
+    key._path = path;
+
+    // archive members are read in archive order
+    qint64 member_offset = ImageArchive::member_offset( path );
+    if( member_offset >= 0 ) {
+        key._dir = path.left( path.indexOf( ImageArchive::SEPARATOR ) );
+        key._location = quint64( member_offset );
+        return key;
+    }
+
+    key._dir = QFileInfo( path ).absolutePath();
+    key._location = location_key( path );
+
+    return key;
+}
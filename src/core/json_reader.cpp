@@ -0,0 +1,302 @@
+#include <core/json_reader.h>
+
+#include <QIODevice>
+
+namespace {
+    // size of the read buffer
+    const qint64 CHUNK_SIZE = 1 << 20;
+
+    // appends the UTF-8 encoding of a code point
+    void append_utf8(
+            QByteArray& text,
+            uint code
+        )
+    {
+        if( code < 0x80 ) {
+            text.append( char( code ) );
+        } else if( code < 0x800 ) {
+            text.append( char( 0xC0 | ( code >> 6 ) ) );
+            text.append( char( 0x80 | ( code & 0x3F ) ) );
+        } else if( code < 0x10000 ) {
+            text.append( char( 0xE0 | ( code >> 12 ) ) );
+            text.append( char( 0x80 | ( ( code >> 6 ) & 0x3F ) ) );
+            text.append( char( 0x80 | ( code & 0x3F ) ) );
+        } else {
+            text.append( char( 0xF0 | ( code >> 18 ) ) );
+            text.append( char( 0x80 | ( ( code >> 12 ) & 0x3F ) ) );
+            text.append( char( 0x80 | ( ( code >> 6 ) & 0x3F ) ) );
+            text.append( char( 0x80 | ( code & 0x3F ) ) );
+        }
+    }
+}
+
+
+JsonReader::JsonReader(
+        QIODevice* in
+    ) : in_( in ), pos_( 0 ), consumed_( 0 ), expect_key_( false ), number_( 0. ), boolean_( false )
+{
+}
+
+JsonReader::~JsonReader()
+{
+}
+
+bool JsonReader::fill()
+{
+    if( !in_ || in_->atEnd() ) {
+        return false;
+    }
+
+    consumed_ += buffer_.size();
+    buffer_ = in_->read( CHUNK_SIZE );
+    pos_ = 0;
+
+    return !buffer_.isEmpty();
+}
+
+JsonReader::Token JsonReader::next()
+{
+    while( true ) {
+        int c = peek();
+        if( c < 0 ) {
+            return stack_.isEmpty()? END : INVALID;
+        }
+        ++pos_;
+
+        switch( c ) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case ':':
+            continue;
+
+        case ',':
+            expect_key_ = ( !stack_.isEmpty() && stack_.last() == 'o' );
+            continue;
+
+        case '{':
+            stack_.append( 'o' );
+            expect_key_ = true;
+            return BEGIN_OBJECT;
+
+        case '}':
+            if( stack_.isEmpty() || stack_.last() != 'o' ) {
+                return INVALID;
+            }
+            stack_.removeLast();
+            expect_key_ = false;
+            return END_OBJECT;
+
+        case '[':
+            stack_.append( 'a' );
+            expect_key_ = false;
+            return BEGIN_ARRAY;
+
+        case ']':
+            if( stack_.isEmpty() || stack_.last() != 'a' ) {
+                return INVALID;
+            }
+            stack_.removeLast();
+            expect_key_ = false;
+            return END_ARRAY;
+
+        case '"':
+            if( !read_string() ) {
+                return INVALID;
+            }
+            if( expect_key_ ) {
+                expect_key_ = false;
+                return KEY;
+            }
+            return STRING;
+
+        case 't':
+        case 'f':
+        case 'n':
+            return read_literal( char( c ) );
+
+        default:
+            if( c == '-' || ( c >= '0' && c <= '9' ) ) {
+                return read_number( char( c ) )? NUMBER : INVALID;
+            }
+            return INVALID;
+        }
+    }
+}
+
+bool JsonReader::skip_value(
+        bool skip_current
+    )
+{
+    int depth = 0;
+    if( skip_current ) {
+        depth = 1;
+    } else {
+        Token token = next();
+        if( token == BEGIN_OBJECT || token == BEGIN_ARRAY ) {
+            depth = 1;
+        } else {
+            return token != INVALID && token != END && token != END_OBJECT && token != END_ARRAY;
+        }
+    }
+
+    while( depth > 0 ) {
+        Token token = next();
+        if( token == BEGIN_OBJECT || token == BEGIN_ARRAY ) {
+            ++depth;
+        } else if( token == END_OBJECT || token == END_ARRAY ) {
+            --depth;
+        } else if( token == INVALID || token == END ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool JsonReader::read_string()
+{
+    text_.clear();
+
+    while( true ) {
+        if( pos_ >= buffer_.size() && !fill() ) {
+            return false;
+        }
+
+        // copies the plain characters in one go
+        const char* data = buffer_.constData();
+        int end = pos_;
+        while( end < buffer_.size() && data[end] != '"' && data[end] != '\\' ) {
+            ++end;
+        }
+        text_.append( data + pos_, end - pos_ );
+        pos_ = end;
+
+        if( pos_ >= buffer_.size() ) {
+            continue;
+        }
+
+        char c = data[pos_++];
+        if( c == '"' ) {
+            return true;
+        }
+
+        // escape sequence
+        int e = peek();
+        if( e < 0 ) {
+            return false;
+        }
+        ++pos_;
+
+        switch( e ) {
+        case 'b': text_.append( '\b' ); break;
+        case 'f': text_.append( '\f' ); break;
+        case 'n': text_.append( '\n' ); break;
+        case 'r': text_.append( '\r' ); break;
+        case 't': text_.append( '\t' ); break;
+        case 'u': {
+            uint code = 0;
+            if( !read_code_unit( code ) ) {
+                return false;
+            }
+
+            // surrogate pairs are combined when the low half follows
+            if( code >= 0xD800 && code < 0xDC00 && peek() == '\\' ) {
+                ++pos_;
+                uint low = 0;
+                if( peek() != 'u' ) {
+                    return false;
+                }
+                ++pos_;
+                if( !read_code_unit( low ) ) {
+                    return false;
+                }
+                code = 0x10000 + ( ( code - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+            }
+            append_utf8( text_, code );
+            break;
+        }
+        default:
+            // \" \\ \/
+            text_.append( char( e ) );
+            break;
+        }
+    }
+}
+
+bool JsonReader::read_code_unit(
+        uint& code
+    )
+{
+    code = 0;
+    for( int i = 0; i < 4; ++i ) {
+        int h = peek();
+        if( h < 0 ) {
+            return false;
+        }
+        ++pos_;
+
+        code <<= 4;
+        if( h >= '0' && h <= '9' ) {
+            code |= h - '0';
+        } else if( h >= 'a' && h <= 'f' ) {
+            code |= h - 'a' + 10;
+        } else if( h >= 'A' && h <= 'F' ) {
+            code |= h - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool JsonReader::read_number(
+        char first
+    )
+{
+    char digits[64];
+    int count = 0;
+    digits[count++] = first;
+
+    while( true ) {
+        int c = peek();
+        if( !( ( c >= '0' && c <= '9' ) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-' ) ) {
+            break;
+        }
+        if( count >= int( sizeof( digits ) ) ) {
+            return false;
+        }
+        digits[count++] = char( c );
+        ++pos_;
+    }
+
+    // QByteArray conversion does not depend on the C locale
+    bool ok = false;
+    number_ = QByteArray::fromRawData( digits, count ).toDouble( &ok );
+
+    return ok;
+}
+
+JsonReader::Token JsonReader::read_literal(
+        char first
+    )
+{
+    QByteArray literal( 1, first );
+    while( true ) {
+        int c = peek();
+        if( c < 'a' || c > 'z' ) {
+            break;
+        }
+        literal.append( char( c ) );
+        ++pos_;
+    }
+
+    if( literal == "true" || literal == "false" ) {
+        boolean_ = ( literal == "true" );
+        return BOOLEAN;
+    }
+
+    return ( literal == "null" )? NULL_VALUE : INVALID;
+}
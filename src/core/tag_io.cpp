@@ -1,10 +1,39 @@
 #include <core/tag_io.h>
+#include <core/tar_writer.h>
+#include <core/io_locality.h>
+#include <core/tag_painter.h>
+#include <core/tag_model.h>
+#include <core/json_reader.h>
+#include <core/image_metadata.h>
 
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
 #include <QTextCodec>
+#include <QTextStream>
 #include <QDir>
+#include <QDirIterator>
+#include <QImageReader>
+#include <QPair>
 #include <QProgressDialog>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QFile>
+#include <QSet>
+#include <QVector>
+#include <QBuffer>
+#include <QThread>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QMap>
+#include <QScopedPointer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QtConcurrent>
+
+#include <cstring>
+#include <algorithm>
 
 
 const QString TagIO::DATASET = "dataset";
@@ -24,236 +53,2804 @@ const QString TagIO::WIDTH = "width";
 const QString TagIO::HEIGHT = "height";
 
 
-void TagIO::write_xml(
-        QIODevice* out,
-        const QString& relative_dir,
-        const QHash<QString, QColor>& tag_color_dict,
-        const QHash< QString, QList<TagItem::Elements> >& elts
+namespace {
+
+// a source image and the crops to extract from it
+struct CropSource {
+    QString _fullpath;
+    QList<TagItem::Elements> _tags;
+    int _first_sample; // global index of its first crop
+};
+
+// a contiguous range of sources packed by a single worker
+struct ShardJob {
+    QList<CropSource> _sources;
+    QMap<int, QString> _index; // index lines by sample number
+    TagIO::ExportStats _stats;
+};
+
+// a crop encoded in memory and the file it goes to
+// (named once its source is known to be decoded)
+struct EncodedCrop {
+    QString _label;
+    QString _suffix;
+    QString _path;
+    QByteArray _data;
+    bool _written;
+};
+
+// a source image and its encoded crops
+struct CropJob {
+    CropSource _source;
+    QList<EncodedCrop> _crops;
+    bool _loaded;
+};
+
+// number of sources decoded between two rounds of writes
+// the next batch is read ahead while the current one is processed
+const int CROP_BATCH_SIZE = 64;
+
+// sources with more pixels are cut into tiles by strips of tiles
+// when region decoding is supported (decoded whole otherwise)
+const qint64 TILE_WHOLE_DECODE_PIXELS = 64 * 1024 * 1024;
+
+// memory of the images decoded at once for cutting tiles
+const int TILE_MEMORY_MB = 1024;
+
+// sorts the paths in disk locality order behind a progress dialog
+// (each file is looked up, which takes long on network file systems)
+// returns false if the user canceled
+bool sort_paths(
+        const QStringList& paths,
+        QStringList& sorted
     )
 {
-    if( !out ) {
-        return;
-    }
+    QProgressDialog progress( "Sort images by disk location", "Cancel", 0, paths.count() );
+    progress.setWindowModality( Qt::WindowModal );
 
-    QDir dir;
-    if( !relative_dir.isEmpty() ) {
-        dir = QDir( relative_dir ).absolutePath();
+    sorted = IOLocality::sort_by_locality( paths, &progress );
+    return !progress.wasCanceled();
+}
+
+// lists the sources to crop in disk locality order
+// and numbers their crops so that crop names do not depend
+// on the parallel processing order
+// returns false if the user canceled
+bool make_crop_sources(
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        QList<CropSource>& sources,
+        int& crop_count
+    )
+{
+    sources.clear();
+    crop_count = 0;
+
+    // hash order would make the disk seek randomly
+    QStringList paths;
+    if( !sort_paths( elts.keys(), paths ) ) {
+        return false;
     }
 
-    QXmlStreamWriter xml;
-    xml.setAutoFormatting( true );
-    xml.setDevice( out );
+    for( QStringList::const_iterator path_itr = paths.begin(); path_itr != paths.end(); ++path_itr ) {
+        CropSource src;
+        src._fullpath = *path_itr;
+        src._tags = elts.value( *path_itr );
+        src._first_sample = crop_count;
 
-    xml.writeStartDocument();
-    xml.writeStartElement( DATASET );
-    xml.writeTextElement( NAME, "dataset containing bounding box labels on images" );
-    xml.writeTextElement( COMMENT, "created by BBTag" );
-    xml.writeStartElement( TAGS );
-    for( QHash<QString, QColor>::const_iterator c_itr = tag_color_dict.begin(); c_itr != tag_color_dict.end(); ++c_itr ) {
-        xml.writeEmptyElement( SINGLE_TAG );
-        xml.writeAttribute( NAME, c_itr.key() );
-        xml.writeAttribute( COLOR, c_itr.value().name() );
+        for( QList<TagItem::Elements>::const_iterator tag_itr = src._tags.begin(); tag_itr != src._tags.end(); ++tag_itr ) {
+            crop_count += tag_itr->_bbox.count();
+        }
+
+        sources.append( src );
     }
-    xml.writeEndElement();
 
-    xml.writeStartElement( IMAGES );
+    return true;
+}
 
-    QProgressDialog progress( "Saving as XML", QString(), 0, elts.count() );
-    progress.setWindowModality( Qt::WindowModal );
-    int c = 0;
+// runs the functor over every job on the global thread pool
+// and keeps the progress dialog updated until all jobs are done
+// progress is offset + number of jobs done, unless done is given
+// to report a finer progress than the number of jobs
+// canceled (optional) is raised for jobs that can stop early
+// returns false if the user canceled
+template <typename Job, typename Functor>
+bool run_jobs(
+        QProgressDialog& progress,
+        QList<Job>& jobs,
+        Functor functor,
+        int offset = 0,
+        QAtomicInt* done = 0,
+        QAtomicInt* canceled = 0
+    )
+{
+    if( jobs.isEmpty() ) {
+        return !progress.wasCanceled();
+    }
 
-    for( QHash< QString, QList<TagItem::Elements> >::const_iterator img_itr = elts.begin(); img_itr != elts.end(); ++img_itr ) {
-        progress.setValue( c++ );
+    QFuture<void> future = QtConcurrent::map( jobs, functor );
+    while( !future.isFinished() ) {
+        int value = offset + ( done? done->load() : future.progressValue() );
 
-        QString fullpath = img_itr.key();
-        const QList<TagItem::Elements>& tags = img_itr.value();
+        // stay below maximum otherwise the dialog resets itself
+        progress.setValue( qMin( value, progress.maximum() - 1 ) );
 
-        if( !relative_dir.isEmpty() && dir.exists() ) {
-            fullpath = dir.relativeFilePath( fullpath );
+        if( progress.wasCanceled() ) {
+            future.cancel();
+            if( canceled ) {
+                canceled->store( 1 );
+            }
         }
 
-        xml.writeStartElement( SINGLE_IMAGE );
-        xml.writeAttribute( PATH, fullpath );
+        QThread::msleep( 50 );
+    }
+    future.waitForFinished();
 
-        for( QList<TagItem::Elements>::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
+    return !progress.wasCanceled();
+}
+
+// decodes a source and encodes its crops in memory
+struct CropEncoder {
+    typedef void result_type;
+
+    CropEncoder(
+            const ImageCodec::Options& options
+        ) : options_( options )
+    {
+    }
+
+    void operator()(
+            CropJob& job
+        ) const
+    {
+        const CropSource& src = job._source;
+
+        QImage img = ImageCodec::read( src._fullpath );
+        job._loaded = !img.isNull();
+        if( !job._loaded ) {
+            return;
+        }
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = src._tags.begin(); tag_itr != src._tags.end(); ++tag_itr ) {
             const TagItem::Elements& elt = *tag_itr;
-            const QList<QRect>& bboxes = elt._bbox;
 
-            for( QList<QRect>::const_iterator bbox_itr = bboxes.begin(); bbox_itr != bboxes.end(); ++bbox_itr ) {
-                const QRect& bbox = *bbox_itr;
+            for( QList<QRect>::const_iterator bbox_itr = elt._bbox.begin(); bbox_itr != elt._bbox.end(); ++bbox_itr ) {
+                QImage cropped = img.copy( *bbox_itr );
 
-                xml.writeStartElement( BOX );
-                xml.writeAttribute( TOP, QString::number( bbox.top() ) );
-                xml.writeAttribute( LEFT, QString::number( bbox.left() ) );
-                xml.writeAttribute( WIDTH, QString::number( bbox.width() ) );
-                xml.writeAttribute( HEIGHT, QString::number( bbox.height() ) );
-                xml.writeTextElement( LABEL, elt._label );
-                xml.writeEndElement();
+                EncodedCrop crop;
+                crop._label = elt._label;
+                crop._suffix = ImageCodec::suffix( options_, src._fullpath );
+                crop._written = false;
+
+                QBuffer buffer( &crop._data );
+                buffer.open( QBuffer::WriteOnly );
+                if( ImageCodec::encode( &buffer, cropped, options_, src._fullpath ) ) {
+                    job._crops.append( crop );
+                }
             }
         }
-
-        xml.writeEndElement();
     }
 
-    progress.setValue( elts.count() );
+    ImageCodec::Options options_;
+};
 
-    xml.writeEndElement();
-    xml.writeEndElement();
-    xml.writeEndDocument();
+// orders crops by output directory
+bool crop_label_less_than(
+        const EncodedCrop& c1,
+        const EncodedCrop& c2
+    )
+{
+    return c1._label < c2._label;
 }
 
-bool TagIO::read_xml(
-        QIODevice* in,
-        const QString& relative_dir,
-        QHash< QString, QList<TagItem::Elements> >& elts
+// writes an encoded crop to its file
+struct CropFileWriter {
+    typedef void result_type;
+
+    void operator()(
+            EncodedCrop& crop
+        ) const
+    {
+        QFile file( crop._path );
+        if( !file.open( QFile::WriteOnly ) ) {
+            return;
+        }
+
+        crop._written = ( file.write( crop._data ) == crop._data.size() );
+        file.close();
+    }
+};
+
+// adds the crops written to the export statistics
+void add_written_crops(
+        const QList<EncodedCrop>& crops,
+        TagIO::ExportStats& stats
     )
 {
-    if( !in ) {
-        return false;
+    for( QList<EncodedCrop>::const_iterator crop_itr = crops.begin(); crop_itr != crops.end(); ++crop_itr ) {
+        if( crop_itr->_written ) {
+            ++stats._files;
+            stats._bytes += crop_itr->_data.size();
+        }
     }
+}
 
-    QDir dir;
-    if( !relative_dir.isEmpty() ) {
-        dir = QDir( relative_dir ).absolutePath();
+// sequence of tar shards written by a single worker
+// shards are filled one after the other: only the last one is not full
+// shard numbers are taken from a counter shared by the workers
+class ShardSequence
+{
+public:
+    ShardSequence(
+            const QDir& output_dir,
+            qint64 shard_size,
+            QAtomicInt* shard_counter
+        ) : output_dir_( output_dir ), shard_size_( shard_size ), shard_counter_( shard_counter ), files_( 0 ), bytes_( 0 )
+    {
     }
 
-    QXmlStreamReader xml;
-    xml.setDevice( in );
+    ~ShardSequence()
+    {
+        finish();
+    }
 
-    if( xml.readNext() == QXmlStreamReader::StartDocument && !xml.isStartDocument() ) {
-        return false;
+    // appends the crop and annotation members of a sample
+    // either both members are written or none
+    // returns false if the sample cannot be written
+    bool add_sample(
+            int sample,
+            const QString& label,
+            const QRect& bbox,
+            const QString& fullpath,
+            const QString& suffix,
+            const QByteArray& encoded,
+            const QByteArray& json
+        )
+    {
+        // rolls over to a new shard when the current one is full
+        // (2 headers + padding take at most 4 blocks)
+        if( tar_ && tar_->size() + encoded.size() + json.size() + 2048 > shard_size_ ) {
+            close_shard();
+        }
+
+        if( !tar_ ) {
+            shard_name_ = QString( "shard-%1.tar" ).arg( shard_counter_->fetchAndAddRelaxed( 1 ), 6, 10, QChar( '0' ) );
+            file_.setFileName( output_dir_.absoluteFilePath( shard_name_ ) );
+            if( !file_.open( QFile::WriteOnly ) ) {
+                return false;
+            }
+            tar_.reset( new TarWriter( &file_ ) );
+        }
+
+        QString key = QString( "%1" ).arg( sample, 9, 10, QChar( '0' ) );
+        QString member = key + "." + suffix;
+        qint64 start = tar_->size();
+        qint64 offset = tar_->add_file( member, encoded );
+        if( offset < 0 || tar_->add_file( key + ".json", json ) < 0 ) {
+            // no crop is left without its annotation
+            tar_->rewind( start );
+            file_.resize( start );
+            return false;
+        }
+        ++files_;
+
+        QStringList line;
+        line << shard_name_ << member << QString::number( offset ) << QString::number( encoded.size() )
+             << label << QString::number( bbox.left() ) << QString::number( bbox.top() )
+             << QString::number( bbox.width() ) << QString::number( bbox.height() ) << fullpath;
+        index_.insert( sample, line.join( '\t' ) );
+
+        return true;
     }
 
-    if( !xml.readNextStartElement() ) {
-        return false;
+    // closes the last shard
+    void finish()
+    {
+        if( tar_ ) {
+            close_shard();
+        }
     }
 
-    if( xml.name() != DATASET ) {
-        return false;
+    // returns the index lines of the samples written
+    // in their numbering order
+    const QMap<int, QString>& index() const
+    {
+        return index_;
     }
 
-    // skip info for user
-    while( xml.readNextStartElement() && ( xml.name() != IMAGES && xml.name() != TAGS ) ) {
-        xml.skipCurrentElement();
+    // returns the number of samples written
+    int files() const
+    {
+        return files_;
     }
 
-    QHash<QString, QColor> tag_color_dict;
-    if( xml.name() == TAGS ) {
-        while( xml.readNextStartElement() && xml.name() == SINGLE_TAG ) {
-            tag_color_dict[ xml.attributes().value( NAME ).toString() ] = QColor( xml.attributes().value( COLOR ).toString() );
-            // empty elements are directly followed by endElement
-            // so readNext must be called
-            xml.readNextStartElement();
-        }
+    // returns the number of bytes of the closed shards
+    qint64 bytes() const
+    {
+        return bytes_;
     }
 
-    // within the "images" element
-    while( !xml.atEnd() ) {
-        if( xml.name() == SINGLE_IMAGE ) {
-            QString fullpath = xml.attributes().value( PATH ).toString();
-            if( fullpath.isEmpty() ) {
-                xml.skipCurrentElement();
-                continue;
+private:
+    void close_shard()
+    {
+        tar_->finish();
+        bytes_ += tar_->size();
+        file_.close();
+        tar_.reset();
+    }
+
+    QDir output_dir_;
+    qint64 shard_size_;
+    QAtomicInt* shard_counter_;
+
+    QFile file_;
+    QScopedPointer<TarWriter> tar_;
+    QString shard_name_;
+
+    QMap<int, QString> index_;
+    int files_;
+    qint64 bytes_;
+};
+
+// packs the crops of a range of sources into its own sequence of shards
+// (workers write their shards in parallel)
+struct ShardWriter {
+    typedef void result_type;
+
+    ShardWriter(
+            const QDir& output_dir,
+            qint64 shard_size,
+            const ImageCodec::Options& options,
+            QAtomicInt* shard_counter,
+            QAtomicInt* done,
+            QAtomicInt* canceled
+        ) : output_dir_( output_dir ), shard_size_( shard_size ), options_( options ),
+            shard_counter_( shard_counter ), done_( done ), canceled_( canceled )
+    {
+    }
+
+    void operator()(
+            ShardJob& job
+        ) const
+    {
+        ShardSequence shards( output_dir_, shard_size_, shard_counter_ );
+
+        for( int s = 0; s < job._sources.count(); ++s ) {
+            if( canceled_->load() ) {
+                break;
             }
 
-            if( !relative_dir.isEmpty() && dir.exists() ) {
-                fullpath = dir.absoluteFilePath( fullpath );
+            // sources of a worker are contiguous on disk
+            // read the next ones ahead
+            if( s % CROP_BATCH_SIZE == 0 ) {
+                QStringList next_paths;
+                for( int n = s + CROP_BATCH_SIZE; n < qMin( s + 2 * CROP_BATCH_SIZE, job._sources.count() ); ++n ) {
+                    next_paths.append( job._sources.at( n )._fullpath );
+                }
+                IOLocality::will_need( next_paths );
             }
 
-            if( !xml.readNextStartElement() ) {
-                xml.skipCurrentElement();
+            const CropSource& src = job._sources.at( s );
+            QImage img = ImageCodec::read( src._fullpath );
+            bool loaded = !img.isNull();
+            done_->ref();
+            if( !loaded ) {
                 continue;
             }
+            ++job._stats._images;
 
-            while( xml.name() == BOX ) {
-                QXmlStreamAttributes att =  xml.attributes();
-                QStringRef top = att.value( TOP );
-                QStringRef left = att.value( LEFT );
-                QStringRef width = att.value( WIDTH );
-                QStringRef height = att.value( HEIGHT );
+            int sample = src._first_sample;
+            for( QList<TagItem::Elements>::const_iterator tag_itr = src._tags.begin(); tag_itr != src._tags.end(); ++tag_itr ) {
+                const TagItem::Elements& elt = *tag_itr;
 
-                bool skip = ( top.isEmpty() || left.isEmpty() || width.isEmpty() || height.isEmpty() );
-                xml.readNextStartElement();
-                skip = skip || ( xml.name() != LABEL );
-                QString label = xml.readElementText();
-                skip = skip || ( label.isEmpty() );
+                for( QList<QRect>::const_iterator bbox_itr = elt._bbox.begin(); bbox_itr != elt._bbox.end(); ++bbox_itr, ++sample ) {
+                    const QRect& bbox = *bbox_itr;
 
-                if( skip ) {
-                    xml.skipCurrentElement();
-                    xml.readNextStartElement();
-                    continue;
-                }
+                    QImage cropped = img.copy( bbox );
+                    QByteArray encoded;
+                    QBuffer buffer( &encoded );
+                    buffer.open( QBuffer::WriteOnly );
+                    if( !ImageCodec::encode( &buffer, cropped, options_, src._fullpath ) ) {
+                        continue;
+                    }
 
-                TagItem::Elements elt;
-                elt._fullpath = fullpath;
-                elt._label = label;
-                elt._color = tag_color_dict.value( label );
-                elt._bbox.append( QRect( left.toInt(), top.toInt(), width.toInt(), height.toInt() ) );
-                elts[ fullpath ].append( elt );
+                    QJsonArray box;
+                    box.append( bbox.left() );
+                    box.append( bbox.top() );
+                    box.append( bbox.width() );
+                    box.append( bbox.height() );
 
-                xml.readNextStartElement();
-                while( xml.isEndElement() ) {
-                    xml.readNextStartElement();
+                    QJsonObject annotation;
+                    annotation.insert( TagIO::LABEL, elt._label );
+                    annotation.insert( TagIO::BOX, box );
+                    annotation.insert( TagIO::PATH, src._fullpath );
+                    QByteArray json = QJsonDocument( annotation ).toJson( QJsonDocument::Compact );
+
+                    shards.add_sample(
+                        sample, elt._label, bbox, src._fullpath,
+                        ImageCodec::suffix( options_, src._fullpath ), encoded, json
+                    );
                 }
             }
-        } else {
-            xml.readNextStartElement();
         }
+
+        shards.finish();
+        job._index = shards.index();
+        job._stats._files = shards.files();
+        job._stats._bytes = shards.bytes();
     }
 
-    return true;
-}
+    QDir output_dir_;
+    qint64 shard_size_;
+    ImageCodec::Options options_;
+    QAtomicInt* shard_counter_;
+    QAtomicInt* done_;
+    QAtomicInt* canceled_;
+};
 
-void TagIO::write_images(
-        const QDir& output_dir,
-        const QHash< QString, QList<TagItem::Elements> >& elts
+
+// returns the header of a NumPy .npy file (format version 1.0)
+// padded so that the data is 64-byte aligned
+QByteArray npy_header(
+        const QString& descr,
+        const QList<qint64>& shape
     )
 {
-    if( !output_dir.exists() ) {
-        return;
+    QStringList dims;
+    for( QList<qint64>::const_iterator dim_itr = shape.begin(); dim_itr != shape.end(); ++dim_itr ) {
+        dims.append( QString::number( *dim_itr ) );
     }
+    // a 1-d shape is written as (n,)
+    QString shape_str = dims.join( ", " ) + ( dims.count() == 1? "," : "" );
 
-    QHash<QString, int> label_counter;
+    QByteArray dict = QString( "{'descr': '%1', 'fortran_order': False, 'shape': (%2), }" ).arg( descr ).arg( shape_str ).toLatin1();
 
-    QProgressDialog progress( "Crop and save images", "Cancel", 0, elts.count() );
-    progress.setWindowModality( Qt::WindowModal );
-    int c = 0;
+    // magic (6) + version (2) + header length (2) + dict + padding + \n
+    int unpadded = 10 + dict.size() + 1;
+    dict.append( QByteArray( ( 64 - unpadded % 64 ) % 64, ' ' ) );
+    dict.append( '\n' );
 
-    for( QHash< QString, QList<TagItem::Elements> >::const_iterator img_itr = elts.begin(); img_itr != elts.end(); ++img_itr ) {
-        progress.setValue( c++ );
+    QByteArray header( "\x93NUMPY\x01\x00", 8 );
+    header.append( char( dict.size() & 0xff ) );
+    header.append( char( ( dict.size() >> 8 ) & 0xff ) );
+    header.append( dict );
 
-        QString fullpath = img_itr.key();
-        const QList<TagItem::Elements>& tags = img_itr.value();
+    return header;
+}
 
-        for( QList<TagItem::Elements>::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
+// resamples the crops of one source into the mapped arrays
+// boxes outside of the image leave their sample zeroed
+// and their label at -1
+struct TensorWriter {
+    typedef void result_type;
+
+    TensorWriter(
+            uchar* crops,
+            qint32* labels,
+            int side,
+            int channels,
+            const QHash<QString, int>& label_ids,
+            QAtomicInt* images
+        ) : crops_( crops ), labels_( labels ), side_( side ), channels_( channels ), label_ids_( label_ids ), images_( images )
+    {
+    }
+
+    void operator()(
+            const CropSource& src
+        ) const
+    {
+        QImage img = ImageCodec::read( src._fullpath );
+        if( img.isNull() ) {
+            return;
+        }
+        images_->ref();
+
+        QImage::Format format = ( channels_ == 1 )? QImage::Format_Grayscale8 : QImage::Format_RGB888;
+        qint64 crop_bytes = qint64( side_ ) * side_ * channels_;
+        int sample = src._first_sample;
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = src._tags.begin(); tag_itr != src._tags.end(); ++tag_itr ) {
             const TagItem::Elements& elt = *tag_itr;
-            const QList<QRect>& bboxes = elt._bbox;
-            const QString& label = elt._label;
 
-            if( !label_counter.contains( label ) ) {
-                label_counter[ label ] = 0;
-                if( !output_dir.exists( label ) ) {
-                    output_dir.mkdir( label );
+            for( QList<QRect>::const_iterator bbox_itr = elt._bbox.begin(); bbox_itr != elt._bbox.end(); ++bbox_itr ) {
+                uchar* dst = crops_ + sample * crop_bytes;
+
+                // empty boxes or boxes outside of the image would give a null copy
+                if( ( bbox_itr->normalized() & img.rect() ).isEmpty() ) {
+                    memset( dst, 0, crop_bytes );
+                    ++sample;
+                    continue;
                 }
-            }
-            QDir subdir = output_dir.absoluteFilePath( label );
 
-            QString ext = QFileInfo( elt._fullpath ).suffix();
-            QPixmap pix;
-            if( !pix.load( elt._fullpath ) ) {
-                continue;
+                // Qt smooth scaling is an area-averaging filter
+                // with vectorized code paths
+                QImage resampled = img.copy( bbox_itr->normalized() )
+                    .scaled( side_, side_, Qt::IgnoreAspectRatio, Qt::SmoothTransformation )
+                    .convertToFormat( format );
+
+                for( int y = 0; y < side_; ++y ) {
+                    memcpy( dst + y * side_ * channels_, resampled.constScanLine( y ), side_ * channels_ );
+                }
+                labels_[ sample ] = label_ids_.value( elt._label, -1 );
+                ++sample;
             }
+        }
+    }
 
-            for( QList<QRect>::const_iterator bbox_itr = bboxes.begin(); bbox_itr != bboxes.end(); ++bbox_itr ) {
-                QPixmap cropped = pix.copy( *bbox_itr );
-                cropped.save( subdir.absoluteFilePath( label + "_" + QString::number( ++label_counter[ label ] ) + "." + ext ) );
+    uchar* crops_;
+    qint32* labels_;
+    int side_;
+    int channels_;
+    QHash<QString, int> label_ids_;
+    QAtomicInt* images_;  // number of sources decoded
+};
+
+// a source image to resize with its elements
+struct ResizeJob {
+    QString _fullpath;
+    QList<TagItem::Elements> _tags;
+    QString _basename;                        // unique output name without suffix
+    QString _output;                          // output file path (set when written)
+    QList<TagItem::Elements> _resized_tags;   // elements with rescaled boxes
+    qint64 _bytes;
+};
+
+// returns the bounding box in the coordinates of an image scaled by sx, sy
+// edges are scaled (not the size) so that adjacent boxes stay adjacent
+QRect scale_box(
+        const QRect& bbox,
+        double sx,
+        double sy
+    )
+{
+    int left = qRound( bbox.left() * sx );
+    int top = qRound( bbox.top() * sy );
+    int right = qRound( ( bbox.left() + bbox.width() ) * sx );
+    int bottom = qRound( ( bbox.top() + bbox.height() ) * sy );
+
+    return QRect( left, top, qMax( 1, right - left ), qMax( 1, bottom - top ) );
+}
+
+// resizes a source image and rescales its boxes
+struct ImageResizer {
+    typedef void result_type;
+
+    ImageResizer(
+            const QDir& output_dir,
+            int longest_side,
+            const ImageCodec::Options& options
+        ) : output_dir_( output_dir ), longest_side_( longest_side ), options_( options )
+    {
+    }
+
+    void operator()(
+            ResizeJob& job
+        ) const
+    {
+        // the target size is computed from the header
+        // so that the decoder can directly decode at reduced size
+        QSize full_size = ImageMetadata::image_size( job._fullpath );
+        QSize target_size;
+        if( full_size.isValid() && qMax( full_size.width(), full_size.height() ) > longest_side_ ) {
+            target_size = full_size.scaled( longest_side_, longest_side_, Qt::KeepAspectRatio );
+        }
+
+        QImage img = ImageCodec::read( job._fullpath, target_size );
+        if( img.isNull() ) {
+            return;
+        }
+
+        // header could not tell the size
+        if( !full_size.isValid() ) {
+            full_size = img.size();
+            if( qMax( full_size.width(), full_size.height() ) > longest_side_ ) {
+                img = img.scaled( longest_side_, longest_side_, Qt::KeepAspectRatio, Qt::SmoothTransformation );
             }
         }
 
-        if( progress.wasCanceled() ) {
-            break;
+        QString output = output_dir_.absoluteFilePath( job._basename + "." + ImageCodec::suffix( options_, job._fullpath ) );
+        QFile file( output );
+        if( !file.open( QFile::WriteOnly ) || !ImageCodec::encode( &file, img, options_, job._fullpath ) ) {
+            return;
+        }
+        job._bytes = file.size();
+        file.close();
+
+        double sx = double( img.width() ) / full_size.width();
+        double sy = double( img.height() ) / full_size.height();
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = job._tags.begin(); tag_itr != job._tags.end(); ++tag_itr ) {
+            TagItem::Elements elt = *tag_itr;
+            elt._fullpath = output;
+            elt._bbox.clear();
+
+            for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+                elt._bbox.append( scale_box( *bbox_itr, sx, sy ) );
+            }
+            job._resized_tags.append( elt );
         }
+
+        job._output = output;
     }
 
-    progress.setValue( elts.count() );
+    QDir output_dir_;
+    int longest_side_;
+    ImageCodec::Options options_;
+};
+
+// returns the file base name of the path
+// made unique by appending a number to duplicates
+// name_counter holds every name already given (lower case)
+// with the next number to try for it
+// (images from different directories can share a name, and a
+// numbered name can be the real name of another image)
+QString unique_basename(
+        const QString& path,
+        QHash<QString, int>& name_counter
+    )
+{
+    QString base = QFileInfo( path ).completeBaseName();
+    QString name = base;
+
+    if( name_counter.contains( base.toLower() ) ) {
+        int& count = name_counter[ base.toLower() ];
+        do {
+            name = base + "_" + QString::number( count++ );
+        } while( name_counter.contains( name.toLower() ) );
+    }
+    name_counter.insert( name.toLower(), 1 );
+
+    return name;
+}
+
+// returns a unique file base name for each path
+QStringList unique_basenames(
+        const QStringList& paths
+    )
+{
+    QStringList basenames;
+    QHash<QString, int> name_counter;
+
+    for( QStringList::const_iterator path_itr = paths.begin(); path_itr != paths.end(); ++path_itr ) {
+        basenames.append( unique_basename( *path_itr, name_counter ) );
+    }
+
+    return basenames;
+}
+
+// returns the size of a source image from the metadata store
+// (probed from its header if not known yet)
+struct SizeProber {
+    typedef QSize result_type;
+
+    QSize operator()(
+            const QString& path
+        ) const
+    {
+        return ImageMetadata::image_size( path );
+    }
+};
+
+// a tile of a source image with its clipped elements
+struct TileJob {
+    QString _fullpath;
+    QRect _tile;
+    QString _basename;                     // unique output name without suffix
+    QList<TagItem::Elements> _tags;        // boxes in tile coordinates
+    QString _output;                       // output file path (set when written)
+    qint64 _bytes;
+};
+
+// returns the tile origins along one dimension
+// the last tile is aligned on the image border
+// so that every tile has the full size when possible
+QList<int> tile_origins(
+        int length,
+        int tile_size,
+        int overlap
+    )
+{
+    QList<int> origins;
+    int step = qMax( 1, tile_size - overlap );
+
+    int origin = 0;
+    while( true ) {
+        if( origin + tile_size >= length ) {
+            origins.append( qMax( 0, length - tile_size ) );
+            break;
+        }
+        origins.append( origin );
+        origin += step;
+    }
+
+    return origins;
+}
+
+// the tiles of a source image
+struct TileSourceJob {
+    QString _fullpath;
+    QSize _size;
+    QList<TileJob> _tiles;  // in row order
+};
+
+// decodes a source once and saves its tiles
+// sources are decoded whole, or by strips of tiles (full width)
+// for very large images with region decoding
+// the memory of the decoded images in flight is capped
+struct TileWriter {
+    typedef void result_type;
+
+    TileWriter(
+            const QDir& output_dir,
+            const ImageCodec::Options& options,
+            QSemaphore* memory_mb,
+            QAtomicInt* done
+        ) : output_dir_( output_dir ), options_( options ), memory_mb_( memory_mb ), done_( done )
+    {
+    }
+
+    void operator()(
+            TileSourceJob& src
+        ) const
+    {
+        const QSize& size = src._size;
+        bool by_strips = qint64( size.width() ) * size.height() > TILE_WHOLE_DECODE_PIXELS && ImageCodec::supports_region_decoding( src._fullpath );
+
+        if( !by_strips ) {
+            int mb = reserve( qint64( size.width() ) * size.height() * 4 );
+            QImage img = ImageCodec::read( src._fullpath );
+            for( QList<TileJob>::iterator job_itr = src._tiles.begin(); job_itr != src._tiles.end(); ++job_itr ) {
+                if( !img.isNull() ) {
+                    write_tile( *job_itr, img.copy( job_itr->_tile ) );
+                }
+                done_->ref();
+            }
+            img = QImage();
+            memory_mb_->release( mb );
+            return;
+        }
+
+        // each strip is decoded once for the tiles of its row
+        QList<TileJob>::iterator job_itr = src._tiles.begin();
+        while( job_itr != src._tiles.end() ) {
+            QRect strip( 0, job_itr->_tile.y(), size.width(), job_itr->_tile.height() );
+            int mb = reserve( qint64( strip.width() ) * strip.height() * 4 );
+            QImage img = ImageCodec::read( src._fullpath, QSize(), strip );
+
+            for( ; job_itr != src._tiles.end() && job_itr->_tile.y() == strip.y(); ++job_itr ) {
+                if( !img.isNull() ) {
+                    write_tile( *job_itr, img.copy( job_itr->_tile.translated( 0, -strip.y() ) ) );
+                }
+                done_->ref();
+            }
+
+            img = QImage();
+            memory_mb_->release( mb );
+        }
+    }
+
+    // waits for the memory of the decoded image to be available
+    // returns the reserved memory (in MB)
+    int reserve(
+            qint64 bytes
+        ) const
+    {
+        int mb = int( qBound( qint64( 1 ), bytes / ( 1024 * 1024 ), qint64( TILE_MEMORY_MB ) ) );
+        memory_mb_->acquire( mb );
+        return mb;
+    }
+
+    void write_tile(
+            TileJob& job,
+            const QImage& img
+        ) const
+    {
+        QString output = output_dir_.absoluteFilePath( job._basename + "." + ImageCodec::suffix( options_, job._fullpath ) );
+        QFile file( output );
+        if( !file.open( QFile::WriteOnly ) || !ImageCodec::encode( &file, img, options_, job._fullpath ) ) {
+            return;
+        }
+        job._bytes = file.size();
+        file.close();
+
+        for( QList<TagItem::Elements>::iterator tag_itr = job._tags.begin(); tag_itr != job._tags.end(); ++tag_itr ) {
+            tag_itr->_fullpath = output;
+        }
+        job._output = output;
+    }
+
+    QDir output_dir_;
+    ImageCodec::Options options_;
+    QSemaphore* memory_mb_;
+    QAtomicInt* done_;
+};
+
+// a source image to render with its tags drawn on
+struct OverlayJob {
+    QString _fullpath;
+    QList<TagItem::Elements> _tags;
+    QString _basename;  // unique output name without suffix
+    QString _output;    // output file path (set when rendered)
+    qint64 _bytes;
+};
+
+// renders the tags on a downscaled source image
+// the way the viewer displays them
+struct OverlayRenderer {
+    typedef void result_type;
+
+    OverlayRenderer(
+            const QDir& output_dir,
+            double scale,
+            int jpeg_quality
+        ) : output_dir_( output_dir ), scale_( scale )
+    {
+        options_._format = ImageCodec::JPEG;
+        options_._jpeg_quality = jpeg_quality;
+    }
+
+    void operator()(
+            OverlayJob& job
+        ) const
+    {
+        QSize full_size = ImageMetadata::image_size( job._fullpath );
+        QSize scaled_size;
+        if( full_size.isValid() && scale_ < 1. ) {
+            scaled_size = QSize( qMax( 1, qRound( full_size.width() * scale_ ) ), qMax( 1, qRound( full_size.height() * scale_ ) ) );
+        }
+
+        QImage img = ImageCodec::read( job._fullpath, scaled_size );
+        if( img.isNull() ) {
+            return;
+        }
+
+        float scale_f = full_size.isValid()? float( img.width() ) / full_size.width() : 1.f;
+        img = img.convertToFormat( QImage::Format_RGB32 );
+
+        QPainter p( &img );
+        TagPainter::set_label_font( p );
+        for( QList<TagItem::Elements>::const_iterator tag_itr = job._tags.begin(); tag_itr != job._tags.end(); ++tag_itr ) {
+            TagPainter::draw_tags( p, tag_itr->_color, tag_itr->_label, tag_itr->_bbox, scale_f );
+        }
+        p.end();
+
+        QString output = output_dir_.absoluteFilePath( job._basename + ".jpg" );
+        QFile file( output );
+        if( !file.open( QFile::WriteOnly ) || !ImageCodec::encode( &file, img, options_, job._fullpath ) ) {
+            return;
+        }
+        job._bytes = file.size();
+        job._output = output;
+        file.close();
+    }
+
+    QDir output_dir_;
+    double scale_;
+    ImageCodec::Options options_;
+};
+
+// an image visited in the model and its annotations
+struct AnnotationJob {
+    QString _fullpath;
+    QList<TagItem::Elements> _tags;
+    QString _basename;  // unique output name without suffix
+    QString _output;    // output file path (set when written)
+    QByteArray _data;   // encoded annotations (for single file formats)
+    qint64 _bytes;
+};
+
+// number of images gathered before their annotations are processed
+// in parallel (each one costs at least a header read)
+const int ANNOTATION_BATCH_SIZE = 256;
+
+// returns the label names sorted alphabetically
+// the position of a label is its class index
+QStringList sorted_labels(
+        const QHash<QString, QColor>& tag_color_dict
+    )
+{
+    QStringList labels = tag_color_dict.keys();
+    std::sort( labels.begin(), labels.end() );
+
+    return labels;
+}
+
+// gathers the images visited in the model into batches
+// so that only one batch of elements is held at a time
+class AnnotationBatcher : public TagModel::ElementVisitor
+{
+public:
+    AnnotationBatcher(
+            QProgressDialog& progress,
+            int offset = 0
+        ) : progress_( progress ), done_( offset )
+    {
+    }
+
+    virtual ~AnnotationBatcher()
+    {
+    }
+
+    virtual bool visit(
+            const QString& fullpath,
+            const QList<TagItem::Elements>& elts
+        )
+    {
+        AnnotationJob job;
+        job._fullpath = fullpath;
+        job._tags = elts;
+        job._basename = unique_basename( fullpath, name_counter_ );
+        job._bytes = 0;
+        jobs_.append( job );
+
+        if( jobs_.count() < ANNOTATION_BATCH_SIZE ) {
+            return true;
+        }
+        return flush();
+    }
+
+    // processes the pending images
+    // returns false if the user canceled
+    bool flush()
+    {
+        bool ok = process( jobs_ );
+        done_ += jobs_.count();
+        jobs_.clear();
+
+        return ok;
+    }
+
+protected:
+    // processes a batch of images
+    // returns false if the user canceled
+    virtual bool process(
+        QList<AnnotationJob>& jobs
+    ) = 0;
+
+    QProgressDialog& progress_;
+    int done_;
+
+private:
+    QList<AnnotationJob> jobs_;
+    QHash<QString, int> name_counter_;
+};
+
+// writes one annotation file per image in parallel
+// and lists them in an index
+template <typename Writer>
+class AnnotationFileWriter : public AnnotationBatcher
+{
+public:
+    AnnotationFileWriter(
+            QProgressDialog& progress,
+            const Writer& writer
+        ) : AnnotationBatcher( progress ), writer_( writer )
+    {
+    }
+
+    QStringList index_;
+    TagIO::ExportStats stats_;
+
+protected:
+    virtual bool process(
+            QList<AnnotationJob>& jobs
+        )
+    {
+        bool ok = run_jobs( progress_, jobs, writer_, done_ );
+
+        for( QList<AnnotationJob>::const_iterator job_itr = jobs.begin(); job_itr != jobs.end(); ++job_itr ) {
+            if( job_itr->_output.isEmpty() ) {
+                continue;
+            }
+
+            QStringList line;
+            line << job_itr->_fullpath << QFileInfo( job_itr->_output ).fileName();
+            index_.append( line.join( '\t' ) );
+
+            ++stats_._images;
+            ++stats_._files;
+            stats_._bytes += job_itr->_bytes;
+        }
+
+        return ok;
+    }
+
+private:
+    Writer writer_;
+};
+
+// writes the Pascal VOC XML file of an image
+// the image size and channel count are read from the file header
+struct VocWriter {
+    typedef void result_type;
+
+    VocWriter(
+            const QDir& output_dir
+        ) : output_dir_( output_dir )
+    {
+    }
+
+    void operator()(
+            AnnotationJob& job
+        ) const
+    {
+        QSize size = ImageMetadata::image_size( job._fullpath );
+        if( !size.isValid() ) {
+            return;
+        }
+        QRect image_rect( QPoint( 0, 0 ), size );
+
+        QString output = output_dir_.absoluteFilePath( job._basename + ".xml" );
+        QFile file( output );
+        if( !file.open( QFile::WriteOnly | QFile::Text ) ) {
+            return;
+        }
+
+        QFileInfo fi( job._fullpath );
+
+        QXmlStreamWriter xml;
+        xml.setAutoFormatting( true );
+        xml.setDevice( &file );
+
+        xml.writeStartElement( "annotation" );
+        xml.writeTextElement( "folder", fi.absoluteDir().dirName() );
+        xml.writeTextElement( "filename", fi.fileName() );
+        xml.writeTextElement( "path", job._fullpath );
+        xml.writeStartElement( "size" );
+        xml.writeTextElement( "width", QString::number( size.width() ) );
+        xml.writeTextElement( "height", QString::number( size.height() ) );
+        xml.writeTextElement( "depth", QString::number( ImageCodec::probe_channels( job._fullpath ) ) );
+        xml.writeEndElement();
+        xml.writeTextElement( "segmented", "0" );
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = job._tags.begin(); tag_itr != job._tags.end(); ++tag_itr ) {
+            const TagItem::Elements& elt = *tag_itr;
+
+            for( QList<QRect>::const_iterator bbox_itr = elt._bbox.begin(); bbox_itr != elt._bbox.end(); ++bbox_itr ) {
+                // boxes drawn past the border are clipped and flagged as truncated
+                QRect box = bbox_itr->normalized() & image_rect;
+                if( box.isEmpty() ) {
+                    continue;
+                }
+
+                // VOC pixel coordinates start at 1 and are inclusive
+                xml.writeStartElement( "object" );
+                xml.writeTextElement( "name", elt._label );
+                xml.writeTextElement( "pose", "Unspecified" );
+                xml.writeTextElement( "truncated", box == bbox_itr->normalized()? "0" : "1" );
+                xml.writeTextElement( "difficult", "0" );
+                xml.writeStartElement( "bndbox" );
+                xml.writeTextElement( "xmin", QString::number( box.left() + 1 ) );
+                xml.writeTextElement( "ymin", QString::number( box.top() + 1 ) );
+                xml.writeTextElement( "xmax", QString::number( box.right() + 1 ) );
+                xml.writeTextElement( "ymax", QString::number( box.bottom() + 1 ) );
+                xml.writeEndElement();
+                xml.writeEndElement();
+            }
+        }
+
+        xml.writeEndElement();
+        xml.writeEndDocument();
+
+        job._bytes = file.size();
+        job._output = output;
+        file.close();
+    }
+
+    QDir output_dir_;
+};
+
+// writes the YOLO text file of an image:
+// one "class x_center y_center width height" line per box
+// coordinates are normalized by the image size read from the file header
+struct YoloWriter {
+    typedef void result_type;
+
+    YoloWriter(
+            const QDir& output_dir,
+            const QStringList& labels
+        ) : output_dir_( output_dir )
+    {
+        for( int i = 0; i < labels.count(); ++i ) {
+            class_ids_.insert( labels.at( i ), i );
+        }
+    }
+
+    void operator()(
+            AnnotationJob& job
+        ) const
+    {
+        QSize size = ImageMetadata::image_size( job._fullpath );
+        if( !size.isValid() ) {
+            return;
+        }
+        QRect image_rect( QPoint( 0, 0 ), size );
+        double w = size.width();
+        double h = size.height();
+
+        QByteArray data;
+        for( QList<TagItem::Elements>::const_iterator tag_itr = job._tags.begin(); tag_itr != job._tags.end(); ++tag_itr ) {
+            const TagItem::Elements& elt = *tag_itr;
+            int class_id = class_ids_.value( elt._label, -1 );
+            if( class_id < 0 ) {
+                continue;
+            }
+
+            for( QList<QRect>::const_iterator bbox_itr = elt._bbox.begin(); bbox_itr != elt._bbox.end(); ++bbox_itr ) {
+                QRect box = bbox_itr->normalized() & image_rect;
+                if( box.isEmpty() ) {
+                    continue;
+                }
+
+                data += QString( "%1 %2 %3 %4 %5\n" )
+                    .arg( class_id )
+                    .arg( ( box.x() + box.width() / 2. ) / w, 0, 'f', 6 )
+                    .arg( ( box.y() + box.height() / 2. ) / h, 0, 'f', 6 )
+                    .arg( box.width() / w, 0, 'f', 6 )
+                    .arg( box.height() / h, 0, 'f', 6 )
+                    .toLatin1();
+            }
+        }
+
+        // an empty file marks an image without object
+        QString output = output_dir_.absoluteFilePath( job._basename + ".txt" );
+        QFile file( output );
+        if( !file.open( QFile::WriteOnly ) || file.write( data ) != data.size() ) {
+            return;
+        }
+
+        job._bytes = file.size();
+        job._output = output;
+        file.close();
+    }
+
+    QDir output_dir_;
+    QHash<QString, int> class_ids_;
+};
+
+// encodes the COCO "images" entry of an image
+// the image size is read from the file header
+// the file name is relative to the given directory (if any)
+struct CocoImageEncoder {
+    typedef void result_type;
+
+    CocoImageEncoder(
+            const QString& relative_dir
+        ) : relative_dir_( relative_dir )
+    {
+    }
+
+    void operator()(
+            AnnotationJob& job
+        ) const
+    {
+        QSize size = ImageMetadata::image_size( job._fullpath );
+        if( !size.isValid() ) {
+            return;
+        }
+
+        QString file_name = job._fullpath;
+        if( !relative_dir_.isEmpty() ) {
+            file_name = QDir( relative_dir_ ).relativeFilePath( file_name );
+        }
+
+        QJsonObject image;
+        image.insert( "file_name", file_name );
+        image.insert( "width", size.width() );
+        image.insert( "height", size.height() );
+        job._data = QJsonDocument( image ).toJson( QJsonDocument::Compact );
+    }
+
+    QString relative_dir_;
+};
+
+// streams the COCO "images" entries
+// image ids follow the visit order starting at 1
+// images whose size cannot be read are skipped
+class CocoImageWriter : public AnnotationBatcher
+{
+public:
+    CocoImageWriter(
+            QIODevice* out,
+            QProgressDialog& progress,
+            const QString& relative_dir
+        ) : AnnotationBatcher( progress ), written_( 0 ), out_( out ), relative_dir_( relative_dir )
+    {
+    }
+
+    QSet<int> skipped_ids_;
+    int written_;
+
+protected:
+    virtual bool process(
+            QList<AnnotationJob>& jobs
+        )
+    {
+        bool ok = run_jobs( progress_, jobs, CocoImageEncoder( relative_dir_ ), done_ );
+
+        for( int i = 0; i < jobs.count(); ++i ) {
+            int id = done_ + i + 1;
+            QByteArray& data = jobs[i]._data;
+            if( data.isEmpty() ) {
+                skipped_ids_.insert( id );
+                continue;
+            }
+
+            // the id goes first: "{" is replaced
+            data.replace( 0, 1, "{\"id\":" + QByteArray::number( id ) + "," );
+            out_->write( written_ > 0? ",\n" : "\n" );
+            out_->write( data );
+            ++written_;
+        }
+
+        return ok;
+    }
+
+private:
+    QIODevice* out_;
+    QString relative_dir_;
+};
+
+// streams the COCO "annotations" entries
+// images are visited in the same order as for the "images" entries
+// boxes are clipped to the image (size known from the images pass)
+class CocoAnnotationWriter : public TagModel::ElementVisitor
+{
+public:
+    CocoAnnotationWriter(
+            QIODevice* out,
+            QProgressDialog& progress,
+            const QStringList& labels,
+            const QSet<int>& skipped_ids
+        ) : out_( out ), progress_( progress ), skipped_ids_( skipped_ids ), image_id_( 0 ), written_( 0 )
+    {
+        for( int i = 0; i < labels.count(); ++i ) {
+            category_ids_.insert( labels.at( i ), i + 1 );
+        }
+    }
+
+    virtual bool visit(
+            const QString& fullpath,
+            const QList<TagItem::Elements>& elts
+        )
+    {
+        ++image_id_;
+        if( image_id_ % ANNOTATION_BATCH_SIZE == 0 ) {
+            progress_.setValue( qMin( progress_.value() + ANNOTATION_BATCH_SIZE, progress_.maximum() - 1 ) );
+            if( progress_.wasCanceled() ) {
+                return false;
+            }
+        }
+
+        if( skipped_ids_.contains( image_id_ ) ) {
+            return true;
+        }
+        QRect image_rect( QPoint( 0, 0 ), ImageMetadata::image_size( fullpath ) );
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = elts.begin(); tag_itr != elts.end(); ++tag_itr ) {
+            int category_id = category_ids_.value( tag_itr->_label, 0 );
+            if( category_id == 0 ) {
+                continue;
+            }
+
+            for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+                QRect box = bbox_itr->normalized() & image_rect;
+                if( box.isEmpty() ) {
+                    continue;
+                }
+
+                QJsonArray bbox;
+                bbox << box.x() << box.y() << box.width() << box.height();
+
+                QJsonObject annotation;
+                annotation.insert( "id", ++written_ );
+                annotation.insert( "image_id", image_id_ );
+                annotation.insert( "category_id", category_id );
+                annotation.insert( "bbox", bbox );
+                annotation.insert( "area", double( box.width() ) * box.height() );
+                annotation.insert( "iscrowd", 0 );
+
+                out_->write( written_ > 1? ",\n" : "\n" );
+                out_->write( QJsonDocument( annotation ).toJson( QJsonDocument::Compact ) );
+            }
+        }
+
+        return true;
+    }
+
+private:
+    QIODevice* out_;
+    QProgressDialog& progress_;
+    const QSet<int>& skipped_ids_;
+    QHash<QString, int> category_ids_;
+    int image_id_;
+    int written_;
+};
+
+// adds the box to the element of the given label
+// (one element per label and image)
+void append_box(
+        QList<TagItem::Elements>& tags,
+        const QString& fullpath,
+        const QString& label,
+        const QRect& bbox
+    )
+{
+    QList<TagItem::Elements>::iterator tag_itr = tags.begin();
+    while( tag_itr != tags.end() && tag_itr->_label != label ) {
+        ++tag_itr;
+    }
+
+    if( tag_itr == tags.end() ) {
+        TagItem::Elements elt;
+        elt._label = label;
+        elt._fullpath = fullpath;
+        tags.append( elt );
+        tag_itr = tags.end() - 1;
+    }
+    tag_itr->_bbox.append( bbox );
+}
+
+// a box read from a COCO file
+// kept compact as files can hold millions of them
+struct CocoBox {
+    int _image_id;
+    int _category_id;
+    QRect _bbox;
+};
+
+// number of COCO entries read between two progress updates
+const int COCO_PROGRESS_STEP = 4096;
+
+// reads the members of a COCO "images" or "categories" entry
+// id and the given text member (file_name or name) are kept
+bool read_coco_entry(
+        JsonReader& json,
+        const char* text_key,
+        int& id,
+        QString& text
+    )
+{
+    JsonReader::Token token;
+    while( ( token = json.next() ) == JsonReader::KEY ) {
+        if( json.utf8() == "id" ) {
+            if( json.next() != JsonReader::NUMBER ) {
+                return false;
+            }
+            id = int( json.number() );
+
+        } else if( json.utf8() == text_key ) {
+            if( json.next() != JsonReader::STRING ) {
+                return false;
+            }
+            text = json.string();
+
+        } else if( !json.skip_value() ) {
+            return false;
+        }
+    }
+
+    return token == JsonReader::END_OBJECT;
+}
+
+// reads the members of a COCO "annotations" entry
+// keep is off if the score is below min_score
+bool read_coco_annotation(
+        JsonReader& json,
+        double min_score,
+        CocoBox& box,
+        bool& keep
+    )
+{
+    box._image_id = -1;
+    box._category_id = -1;
+    keep = true;
+
+    double coords[4];
+    int coord_count = 0;
+
+    JsonReader::Token token;
+    while( ( token = json.next() ) == JsonReader::KEY ) {
+        const QByteArray& key = json.utf8();
+
+        if( key == "image_id" || key == "category_id" || key == "score" ) {
+            int& id = ( key == "image_id" )? box._image_id : box._category_id;
+            bool is_score = ( key == "score" );
+            if( json.next() != JsonReader::NUMBER ) {
+                return false;
+            }
+            if( is_score ) {
+                keep = keep && json.number() >= min_score;
+            } else {
+                id = int( json.number() );
+            }
+
+        } else if( key == "bbox" ) {
+            if( json.next() != JsonReader::BEGIN_ARRAY ) {
+                return false;
+            }
+            while( ( token = json.next() ) == JsonReader::NUMBER ) {
+                if( coord_count < 4 ) {
+                    coords[coord_count] = json.number();
+                }
+                ++coord_count;
+            }
+            if( token != JsonReader::END_ARRAY ) {
+                return false;
+            }
+
+        } else if( !json.skip_value() ) {
+            // segmentation polygons and masks are skipped as well
+            return false;
+        }
+    }
+
+    if( coord_count != 4 ) {
+        keep = false;
+    } else {
+        box._bbox = QRect( qRound( coords[0] ), qRound( coords[1] ), qRound( coords[2] ), qRound( coords[3] ) );
+        keep = keep && box._bbox.isValid();
+    }
+
+    return token == JsonReader::END_OBJECT;
+}
+
+// a batch of annotation files parsed by a single worker
+// so that the many small files are opened one after the other
+// instead of paying the scheduling cost for each of them
+struct ParseJob {
+    QStringList _files;
+    QStringList _images; // image paired with each file (may be empty)
+    QHash< QString, QList<TagItem::Elements> > _elts;
+};
+
+// number of annotation files parsed by a worker at once
+const int PARSE_BATCH_SIZE = 64;
+
+// reads a Pascal VOC file
+// image_path is set from the path or filename members
+// if it is not already known
+bool read_voc_file(
+        const QString& filename,
+        QString& image_path,
+        QList<TagItem::Elements>& tags
+    )
+{
+    QFile file( filename );
+    if( !file.open( QFile::ReadOnly | QFile::Text ) ) {
+        return false;
+    }
+
+    QXmlStreamReader xml( &file );
+    if( !xml.readNextStartElement() || xml.name() != "annotation" ) {
+        return false;
+    }
+
+    QString path;
+    QString name;
+    QList< QPair<QString, QRect> > boxes;
+
+    while( xml.readNextStartElement() ) {
+        if( xml.name() == "path" ) {
+            path = xml.readElementText();
+
+        } else if( xml.name() == "filename" ) {
+            name = xml.readElementText();
+
+        } else if( xml.name() == "object" ) {
+            QString label;
+            double xmin = 0., ymin = 0., xmax = -1., ymax = -1.;
+
+            while( xml.readNextStartElement() ) {
+                if( xml.name() == "name" ) {
+                    label = xml.readElementText();
+
+                } else if( xml.name() == "bndbox" ) {
+                    while( xml.readNextStartElement() ) {
+                        QString coord = xml.name().toString();
+                        double value = xml.readElementText().toDouble();
+                        if( coord == "xmin" ) {
+                            xmin = value;
+                        } else if( coord == "ymin" ) {
+                            ymin = value;
+                        } else if( coord == "xmax" ) {
+                            xmax = value;
+                        } else if( coord == "ymax" ) {
+                            ymax = value;
+                        }
+                    }
+
+                } else {
+                    xml.skipCurrentElement();
+                }
+            }
+
+            // VOC pixel coordinates start at 1 and are inclusive
+            if( !label.isEmpty() && xmax >= xmin && ymax >= ymin ) {
+                QRect box( qRound( xmin ) - 1, qRound( ymin ) - 1, qRound( xmax - xmin ) + 1, qRound( ymax - ymin ) + 1 );
+                boxes.append( qMakePair( label, box ) );
+            }
+
+        } else {
+            xml.skipCurrentElement();
+        }
+    }
+
+    if( xml.hasError() ) {
+        return false;
+    }
+
+    if( image_path.isEmpty() ) {
+        if( !path.isEmpty() && QFileInfo( path ).exists() ) {
+            image_path = path;
+        } else if( !name.isEmpty() ) {
+            image_path = QFileInfo( filename ).absoluteDir().absoluteFilePath( name );
+        }
+    }
+
+    for( QList< QPair<QString, QRect> >::const_iterator box_itr = boxes.begin(); box_itr != boxes.end(); ++box_itr ) {
+        append_box( tags, image_path, box_itr->first, box_itr->second );
+    }
+
+    return !image_path.isEmpty();
+}
+
+// reads a YOLO file: one "class x_center y_center width height" line per box
+// (a trailing confidence is ignored), coordinates being normalized
+// by the image size read from the image header
+bool read_yolo_file(
+        const QString& filename,
+        const QString& image_path,
+        const QStringList& class_names,
+        QList<TagItem::Elements>& tags
+    )
+{
+    if( image_path.isEmpty() ) {
+        return false;
+    }
+
+    QFile file( filename );
+    if( !file.open( QFile::ReadOnly | QFile::Text ) ) {
+        return false;
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    // the image header is only read if there is a box
+    QSize size;
+
+    QList<QByteArray> lines = data.split( '\n' );
+    for( QList<QByteArray>::const_iterator line_itr = lines.begin(); line_itr != lines.end(); ++line_itr ) {
+        QList<QByteArray> fields = line_itr->simplified().split( ' ' );
+        if( fields.count() < 5 ) {
+            continue;
+        }
+
+        bool ok = true;
+        bool field_ok = false;
+        int class_id = fields.at( 0 ).toInt( &field_ok );
+        ok = ok && field_ok;
+        double coords[4];
+        for( int i = 0; i < 4; ++i ) {
+            coords[i] = fields.at( i + 1 ).toDouble( &field_ok );
+            ok = ok && field_ok;
+        }
+        if( !ok || class_id < 0 ) {
+            continue;
+        }
+
+        if( !size.isValid() ) {
+            size = ImageMetadata::image_size( image_path );
+            if( !size.isValid() ) {
+                return false;
+            }
+        }
+
+        double w = coords[2] * size.width();
+        double h = coords[3] * size.height();
+        QRect box( qRound( coords[0] * size.width() - w / 2. ), qRound( coords[1] * size.height() - h / 2. ), qRound( w ), qRound( h ) );
+
+        QString label = ( class_id < class_names.count() )? class_names.at( class_id ) : QString::number( class_id );
+        append_box( tags, image_path, label, box );
+    }
+
+    return true;
+}
+
+// parses a batch of annotation files
+struct AnnotationParser {
+    typedef void result_type;
+
+    AnnotationParser(
+            TagIO::AnnotationFormat format,
+            const QStringList& class_names
+        ) : format_( format ), class_names_( class_names )
+    {
+    }
+
+    void operator()(
+            ParseJob& job
+        ) const
+    {
+        for( int i = 0; i < job._files.count(); ++i ) {
+            QString image_path = job._images.at( i );
+            QList<TagItem::Elements> tags;
+
+            bool ok = false;
+            if( format_ == TagIO::PASCAL_VOC ) {
+                ok = read_voc_file( job._files.at( i ), image_path, tags );
+            } else {
+                ok = read_yolo_file( job._files.at( i ), image_path, class_names_, tags );
+            }
+
+            if( ok ) {
+                job._elts[ image_path ].append( tags );
+            }
+        }
+    }
+
+    TagIO::AnnotationFormat format_;
+    QStringList class_names_;
+};
+
+// writes the index of the annotation files
+void write_annotation_index(
+        const QDir& output_dir,
+        const QStringList& index,
+        TagIO::ExportStats& stats
+    )
+{
+    QFile index_file( output_dir.absoluteFilePath( "index.tsv" ) );
+    if( index_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        QTextStream ts( &index_file );
+        ts.setCodec( "UTF-8" );
+        ts << "image\tannotation\n";
+        for( QStringList::const_iterator line_itr = index.begin(); line_itr != index.end(); ++line_itr ) {
+            ts << *line_itr << "\n";
+        }
+        ts.flush();
+        stats._bytes += index_file.size();
+        ++stats._files;
+        index_file.close();
+    }
+}
+}
+
+
+TagIO::ExportStats::ExportStats() :
+    _images( 0 ),
+    _files( 0 ),
+    _bytes( 0 ),
+    _elapsed( 0 )
+{
+}
+
+
+void TagIO::write_xml(
+        QIODevice* out,
+        const QString& relative_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts
+    )
+{
+    if( !out ) {
+        return;
+    }
+
+    QDir dir;
+    if( !relative_dir.isEmpty() ) {
+        dir = QDir( relative_dir ).absolutePath();
+    }
+
+    QXmlStreamWriter xml;
+    xml.setAutoFormatting( true );
+    xml.setDevice( out );
+
+    xml.writeStartDocument();
+    xml.writeStartElement( DATASET );
+    xml.writeTextElement( NAME, "dataset containing bounding box labels on images" );
+    xml.writeTextElement( COMMENT, "created by BBTag" );
+    xml.writeStartElement( TAGS );
+    for( QHash<QString, QColor>::const_iterator c_itr = tag_color_dict.begin(); c_itr != tag_color_dict.end(); ++c_itr ) {
+        xml.writeEmptyElement( SINGLE_TAG );
+        xml.writeAttribute( NAME, c_itr.key() );
+        xml.writeAttribute( COLOR, c_itr.value().name() );
+    }
+    xml.writeEndElement();
+
+    xml.writeStartElement( IMAGES );
+
+    QProgressDialog progress( "Saving as XML", QString(), 0, elts.count() );
+    progress.setWindowModality( Qt::WindowModal );
+    int c = 0;
+
+    for( QHash< QString, QList<TagItem::Elements> >::const_iterator img_itr = elts.begin(); img_itr != elts.end(); ++img_itr ) {
+        progress.setValue( c++ );
+
+        QString fullpath = img_itr.key();
+        const QList<TagItem::Elements>& tags = img_itr.value();
+
+        if( !relative_dir.isEmpty() && dir.exists() ) {
+            fullpath = dir.relativeFilePath( fullpath );
+        }
+
+        xml.writeStartElement( SINGLE_IMAGE );
+        xml.writeAttribute( PATH, fullpath );
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
+            const TagItem::Elements& elt = *tag_itr;
+            const QList<QRect>& bboxes = elt._bbox;
+
+            for( QList<QRect>::const_iterator bbox_itr = bboxes.begin(); bbox_itr != bboxes.end(); ++bbox_itr ) {
+                const QRect& bbox = *bbox_itr;
+
+                xml.writeStartElement( BOX );
+                xml.writeAttribute( TOP, QString::number( bbox.top() ) );
+                xml.writeAttribute( LEFT, QString::number( bbox.left() ) );
+                xml.writeAttribute( WIDTH, QString::number( bbox.width() ) );
+                xml.writeAttribute( HEIGHT, QString::number( bbox.height() ) );
+                xml.writeTextElement( LABEL, elt._label );
+                xml.writeEndElement();
+            }
+        }
+
+        xml.writeEndElement();
+    }
+
+    progress.setValue( elts.count() );
+
+    xml.writeEndElement();
+    xml.writeEndElement();
+    xml.writeEndDocument();
+}
+
+bool TagIO::read_xml(
+        QIODevice* in,
+        const QString& relative_dir,
+        QHash< QString, QList<TagItem::Elements> >& elts
+    )
+{
+    if( !in ) {
+        return false;
+    }
+
+    QDir dir;
+    if( !relative_dir.isEmpty() ) {
+        dir = QDir( relative_dir ).absolutePath();
+    }
+
+    QXmlStreamReader xml;
+    xml.setDevice( in );
+
+    if( xml.readNext() == QXmlStreamReader::StartDocument && !xml.isStartDocument() ) {
+        return false;
+    }
+
+    if( !xml.readNextStartElement() ) {
+        return false;
+    }
+
+    if( xml.name() != DATASET ) {
+        return false;
+    }
+
+    // skip info for user
+    while( xml.readNextStartElement() && ( xml.name() != IMAGES && xml.name() != TAGS ) ) {
+        xml.skipCurrentElement();
+    }
+
+    QHash<QString, QColor> tag_color_dict;
+    if( xml.name() == TAGS ) {
+        while( xml.readNextStartElement() && xml.name() == SINGLE_TAG ) {
+            tag_color_dict[ xml.attributes().value( NAME ).toString() ] = QColor( xml.attributes().value( COLOR ).toString() );
+            // empty elements are directly followed by endElement
+            // so readNext must be called
+            xml.readNextStartElement();
+        }
+    }
+
+    // within the "images" element
+    while( !xml.atEnd() ) {
+        if( xml.name() == SINGLE_IMAGE ) {
+            QString fullpath = xml.attributes().value( PATH ).toString();
+            if( fullpath.isEmpty() ) {
+                xml.skipCurrentElement();
+                continue;
+            }
+
+            if( !relative_dir.isEmpty() && dir.exists() ) {
+                fullpath = dir.absoluteFilePath( fullpath );
+            }
+
+            if( !xml.readNextStartElement() ) {
+                xml.skipCurrentElement();
+                continue;
+            }
+
+            while( xml.name() == BOX ) {
+                QXmlStreamAttributes att =  xml.attributes();
+                QStringRef top = att.value( TOP );
+                QStringRef left = att.value( LEFT );
+                QStringRef width = att.value( WIDTH );
+                QStringRef height = att.value( HEIGHT );
+
+                bool skip = ( top.isEmpty() || left.isEmpty() || width.isEmpty() || height.isEmpty() );
+                xml.readNextStartElement();
+                skip = skip || ( xml.name() != LABEL );
+                QString label = xml.readElementText();
+                skip = skip || ( label.isEmpty() );
+
+                if( skip ) {
+                    xml.skipCurrentElement();
+                    xml.readNextStartElement();
+                    continue;
+                }
+
+                TagItem::Elements elt;
+                elt._fullpath = fullpath;
+                elt._label = label;
+                elt._color = tag_color_dict.value( label );
+                elt._bbox.append( QRect( left.toInt(), top.toInt(), width.toInt(), height.toInt() ) );
+                elts[ fullpath ].append( elt );
+
+                xml.readNextStartElement();
+                while( xml.isEndElement() ) {
+                    xml.readNextStartElement();
+                }
+            }
+        } else {
+            xml.readNextStartElement();
+        }
+    }
+
+    return true;
+}
+
+void TagIO::write_images(
+        const QDir& output_dir,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        const ImageCodec::Options& options,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    int crop_count = 0;
+    QList<CropSource> sources;
+    if( !make_crop_sources( elts, sources, crop_count ) ) {
+        return;
+    }
+
+    QList<CropJob> jobs;
+    for( QList<CropSource>::const_iterator src_itr = sources.begin(); src_itr != sources.end(); ++src_itr ) {
+        CropJob job;
+        job._source = *src_itr;
+        job._loaded = false;
+        jobs.append( job );
+    }
+
+    QProgressDialog progress( "Crop and save images", "Cancel", 0, jobs.count() );
+    progress.setWindowModality( Qt::WindowModal );
+
+    // crops are numbered per label from 1 following the source order
+    // (sources that cannot be decoded take no number)
+    QHash<QString, int> label_counter;
+
+    // batches are decoded and encoded in parallel
+    // while the next batch is read ahead
+    // and the crops of the previous batch are written
+    QList<EncodedCrop> crops;
+    QFuture<void> writing;
+    for( int first = 0; first < jobs.count(); first += CROP_BATCH_SIZE ) {
+        QList<CropJob> batch = jobs.mid( first, CROP_BATCH_SIZE );
+
+        QStringList next_paths;
+        for( int n = first + CROP_BATCH_SIZE; n < qMin( first + 2 * CROP_BATCH_SIZE, jobs.count() ); ++n ) {
+            next_paths.append( jobs.at( n )._source._fullpath );
+        }
+        IOLocality::will_need( next_paths );
+
+        if( !run_jobs( progress, batch, CropEncoder( options ), first ) ) {
+            break;
+        }
+
+        QList<EncodedCrop> batch_crops;
+        for( QList<CropJob>::const_iterator job_itr = batch.begin(); job_itr != batch.end(); ++job_itr ) {
+            if( !job_itr->_loaded ) {
+                continue;
+            }
+            ++local_stats._images;
+
+            for( QList<EncodedCrop>::const_iterator crop_itr = job_itr->_crops.begin(); crop_itr != job_itr->_crops.end(); ++crop_itr ) {
+                EncodedCrop crop = *crop_itr;
+                if( !label_counter.contains( crop._label ) ) {
+                    label_counter[ crop._label ] = 0;
+                    if( !output_dir.exists( crop._label ) ) {
+                        output_dir.mkdir( crop._label );
+                    }
+                }
+
+                int number = ++label_counter[ crop._label ];
+                crop._path = output_dir.absoluteFilePath( crop._label + "/" + crop._label + "_" + QString::number( number ) + "." + crop._suffix );
+                batch_crops.append( crop );
+            }
+        }
+
+        // writes are grouped by label directory
+        // (numbers are already given in source order)
+        std::stable_sort( batch_crops.begin(), batch_crops.end(), crop_label_less_than );
+
+        // the crops being written are kept until they are done
+        writing.waitForFinished();
+        add_written_crops( crops, local_stats );
+        crops = batch_crops;
+        writing = QtConcurrent::map( crops, CropFileWriter() );
+    }
+
+    writing.waitForFinished();
+    add_written_crops( crops, local_stats );
+
+    progress.setValue( jobs.count() );
+
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_shards(
+        const QDir& output_dir,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        qint64 shard_size,
+        const ImageCodec::Options& options,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() || shard_size <= 0 ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    int crop_count = 0;
+    QList<CropSource> sources;
+    if( !make_crop_sources( elts, sources, crop_count ) ) {
+        return;
+    }
+
+    // one contiguous range of sources per worker
+    // each worker writes its own sequence of shards
+    // (so up to one shard per worker is not full)
+    int worker_count = qBound( 1, QThread::idealThreadCount(), qMax( 1, sources.count() ) );
+    QList<ShardJob> jobs;
+    for( int w = 0; w < worker_count; ++w ) {
+        int first = sources.count() * w / worker_count;
+        int last = sources.count() * ( w + 1 ) / worker_count;
+
+        ShardJob job;
+        job._sources = sources.mid( first, last - first );
+        jobs.append( job );
+    }
+
+    QAtomicInt shard_counter( 0 );
+    QAtomicInt done( 0 );
+    QAtomicInt canceled( 0 );
+
+    QProgressDialog progress( "Crop and pack images into shards", "Cancel", 0, sources.count() );
+    progress.setWindowModality( Qt::WindowModal );
+
+    run_jobs(
+        progress,
+        jobs,
+        ShardWriter( output_dir, shard_size, options, &shard_counter, &done, &canceled ),
+        0,
+        &done,
+        &canceled
+    );
+    progress.setValue( sources.count() );
+
+    // the index lines of the workers are merged by sample number
+    QMap<int, QString> lines;
+    for( QList<ShardJob>::const_iterator job_itr = jobs.begin(); job_itr != jobs.end(); ++job_itr ) {
+        lines.unite( job_itr->_index );
+        local_stats._images += job_itr->_stats._images;
+        local_stats._files += job_itr->_stats._files;
+        local_stats._bytes += job_itr->_stats._bytes;
+    }
+
+    // the index lists the crops in their numbering order
+    QFile index_file( output_dir.absoluteFilePath( "index.tsv" ) );
+    if( index_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        QTextStream index( &index_file );
+        index.setCodec( "UTF-8" );
+        index << "shard\tmember\toffset\tsize\t" << LABEL << "\t" << LEFT << "\t" << TOP << "\t" << WIDTH << "\t" << HEIGHT << "\t" << PATH << "\n";
+
+        for( QMap<int, QString>::const_iterator line_itr = lines.begin(); line_itr != lines.end(); ++line_itr ) {
+            index << line_itr.value() << "\n";
+        }
+        index_file.close();
+    }
+
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_tensor(
+        const QDir& output_dir,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        int side,
+        int channels,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() || side <= 0 || ( channels != 1 && channels != 3 ) ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    int crop_count = 0;
+    QList<CropSource> sources;
+    if( !make_crop_sources( elts, sources, crop_count ) || crop_count == 0 ) {
+        return;
+    }
+
+    // label indices follow the alphabetical order of label names
+    QSet<QString> label_set;
+    QFile crop_list_file( output_dir.absoluteFilePath( "crops.tsv" ) );
+    if( crop_list_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        QTextStream crop_list( &crop_list_file );
+        crop_list.setCodec( "UTF-8" );
+        crop_list << "index\t" << LABEL << "\t" << LEFT << "\t" << TOP << "\t" << WIDTH << "\t" << HEIGHT << "\t" << PATH << "\n";
+
+        for( QList<CropSource>::const_iterator src_itr = sources.begin(); src_itr != sources.end(); ++src_itr ) {
+            int sample = src_itr->_first_sample;
+            for( QList<TagItem::Elements>::const_iterator tag_itr = src_itr->_tags.begin(); tag_itr != src_itr->_tags.end(); ++tag_itr ) {
+                label_set.insert( tag_itr->_label );
+                for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+                    crop_list << sample++ << "\t" << tag_itr->_label << "\t" << bbox_itr->left() << "\t" << bbox_itr->top()
+                              << "\t" << bbox_itr->width() << "\t" << bbox_itr->height() << "\t" << src_itr->_fullpath << "\n";
+                }
+            }
+        }
+        crop_list_file.close();
+    }
+
+    QStringList label_names = label_set.toList();
+    label_names.sort();
+    QHash<QString, int> label_ids;
+    QFile label_names_file( output_dir.absoluteFilePath( "labels.txt" ) );
+    if( label_names_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        QTextStream names( &label_names_file );
+        names.setCodec( "UTF-8" );
+        for( int l = 0; l < label_names.count(); ++l ) {
+            label_ids[ label_names.at( l ) ] = l;
+            names << label_names.at( l ) << "\n";
+        }
+        label_names_file.close();
+    }
+
+    // both arrays are preallocated then mapped in memory
+    // so that each worker writes its crops at their final offset
+    QList<qint64> crops_shape;
+    crops_shape << crop_count << side << side << channels;
+    QByteArray crops_header = npy_header( "|u1", crops_shape );
+    qint64 crops_size = crops_header.size() + qint64( crop_count ) * side * side * channels;
+
+    QList<qint64> labels_shape;
+    labels_shape << crop_count;
+    QByteArray labels_header = npy_header( "<i4", labels_shape );
+    qint64 labels_size = labels_header.size() + qint64( crop_count ) * sizeof( qint32 );
+
+    QFile crops_file( output_dir.absoluteFilePath( "crops.npy" ) );
+    QFile labels_file( output_dir.absoluteFilePath( "labels.npy" ) );
+    if( !crops_file.open( QFile::ReadWrite | QFile::Truncate ) || !labels_file.open( QFile::ReadWrite | QFile::Truncate ) ) {
+        return;
+    }
+
+    if( !crops_file.resize( crops_size ) || !labels_file.resize( labels_size ) ) {
+        return;
+    }
+
+    uchar* crops_data = crops_file.map( 0, crops_size );
+    uchar* labels_data = labels_file.map( 0, labels_size );
+    if( !crops_data || !labels_data ) {
+        return;
+    }
+
+    memcpy( crops_data, crops_header.constData(), crops_header.size() );
+    memcpy( labels_data, labels_header.constData(), labels_header.size() );
+
+    // the array is little endian int32
+    // Q_LITTLE_ENDIAN is assumed for the platforms BBTag targets
+    qint32* labels = reinterpret_cast<qint32*>( labels_data + labels_header.size() );
+    for( int i = 0; i < crop_count; ++i ) {
+        labels[i] = -1;
+    }
+
+    QProgressDialog progress( "Resample crops into NumPy array", "Cancel", 0, sources.count() );
+    progress.setWindowModality( Qt::WindowModal );
+
+    QAtomicInt images( 0 );
+    run_jobs(
+        progress,
+        sources,
+        TensorWriter( crops_data + crops_header.size(), labels, side, channels, label_ids, &images )
+    );
+    progress.setValue( sources.count() );
+
+    for( int i = 0; i < crop_count; ++i ) {
+        if( labels[i] >= 0 ) {
+            ++local_stats._files;
+        }
+    }
+    local_stats._images = images.load();
+    local_stats._bytes = crops_size + labels_size;
+
+    crops_file.unmap( crops_data );
+    labels_file.unmap( labels_data );
+    crops_file.close();
+    labels_file.close();
+
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_resized(
+        const QDir& output_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        int longest_side,
+        const ImageCodec::Options& options,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() || longest_side <= 0 ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    QStringList paths;
+    if( !sort_paths( elts.keys(), paths ) ) {
+        return;
+    }
+    QStringList basenames = unique_basenames( paths );
+
+    QList<ResizeJob> jobs;
+    for( int i = 0; i < paths.count(); ++i ) {
+        ResizeJob job;
+        job._fullpath = paths.at( i );
+        job._tags = elts.value( paths.at( i ) );
+        job._basename = basenames.at( i );
+        job._bytes = 0;
+        jobs.append( job );
+    }
+
+    QProgressDialog progress( "Resize images", "Cancel", 0, jobs.count() );
+    progress.setWindowModality( Qt::WindowModal );
+    run_jobs( progress, jobs, ImageResizer( output_dir, longest_side, options ) );
+    progress.setValue( jobs.count() );
+
+    QHash< QString, QList<TagItem::Elements> > resized_elts;
+    for( QList<ResizeJob>::const_iterator job_itr = jobs.begin(); job_itr != jobs.end(); ++job_itr ) {
+        if( job_itr->_output.isEmpty() ) {
+            continue;
+        }
+
+        resized_elts[ job_itr->_output ] = job_itr->_resized_tags;
+        ++local_stats._images;
+        ++local_stats._files;
+        local_stats._bytes += job_itr->_bytes;
+    }
+
+    // image paths are relative to the output directory
+    // so that the resized dataset can be moved around
+    QFile xml_file( output_dir.absoluteFilePath( "dataset.xml" ) );
+    if( xml_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        write_xml( &xml_file, output_dir.absolutePath(), tag_color_dict, resized_elts );
+        local_stats._bytes += xml_file.size();
+        xml_file.close();
+    }
+
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_tiles(
+        const QDir& output_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        int tile_size,
+        int overlap,
+        double min_visible,
+        bool keep_empty_tiles,
+        const ImageCodec::Options& options,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() || tile_size <= 0 || overlap < 0 || overlap >= tile_size ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    // tiles are planned from the image headers
+    QStringList paths;
+    if( !sort_paths( elts.keys(), paths ) ) {
+        return;
+    }
+    QStringList basenames = unique_basenames( paths );
+    QList<QSize> sizes = QtConcurrent::blockingMapped< QList<QSize> >( paths, SizeProber() );
+
+    QList<TileSourceJob> sources;
+    int tile_count = 0;
+    for( int i = 0; i < paths.count(); ++i ) {
+        const QSize& size = sizes.at( i );
+        if( !size.isValid() ) {
+            continue;
+        }
+
+        TileSourceJob src;
+        src._fullpath = paths.at( i );
+        src._size = size;
+
+        const QList<TagItem::Elements>& tags = elts[ paths.at( i ) ];
+        QList<int> x_origins = tile_origins( size.width(), tile_size, overlap );
+        QList<int> y_origins = tile_origins( size.height(), tile_size, overlap );
+
+        for( QList<int>::const_iterator y_itr = y_origins.begin(); y_itr != y_origins.end(); ++y_itr ) {
+            for( QList<int>::const_iterator x_itr = x_origins.begin(); x_itr != x_origins.end(); ++x_itr ) {
+                TileJob job;
+                job._fullpath = paths.at( i );
+                job._tile = QRect( *x_itr, *y_itr, qMin( tile_size, size.width() ), qMin( tile_size, size.height() ) );
+                job._basename = basenames.at( i ) + "_" + QString::number( *x_itr ) + "_" + QString::number( *y_itr );
+                job._bytes = 0;
+
+                // boxes are clipped to the tile
+                // and kept if enough of them is visible
+                for( QList<TagItem::Elements>::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
+                    TagItem::Elements elt = *tag_itr;
+                    elt._bbox.clear();
+
+                    for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+                        const QRect& bbox = *bbox_itr;
+                        QRect visible = bbox.intersected( job._tile );
+                        if( visible.isEmpty() ) {
+                            continue;
+                        }
+
+                        double visible_fraction = double( visible.width() ) * visible.height() / ( double( bbox.width() ) * bbox.height() );
+                        if( visible_fraction < min_visible ) {
+                            continue;
+                        }
+
+                        elt._bbox.append( visible.translated( -job._tile.topLeft() ) );
+                    }
+
+                    if( !elt._bbox.isEmpty() ) {
+                        job._tags.append( elt );
+                    }
+                }
+
+                if( job._tags.isEmpty() && !keep_empty_tiles ) {
+                    continue;
+                }
+                src._tiles.append( job );
+            }
+        }
+
+        if( !src._tiles.isEmpty() ) {
+            tile_count += src._tiles.count();
+            sources.append( src );
+        }
+    }
+
+    QSemaphore memory_mb( TILE_MEMORY_MB );
+    QAtomicInt done( 0 );
+    QProgressDialog progress( "Cut images into tiles", "Cancel", 0, tile_count );
+    progress.setWindowModality( Qt::WindowModal );
+    run_jobs( progress, sources, TileWriter( output_dir, options, &memory_mb, &done ), 0, &done );
+    progress.setValue( tile_count );
+
+    QList<TileJob> jobs;
+    for( QList<TileSourceJob>::const_iterator src_itr = sources.begin(); src_itr != sources.end(); ++src_itr ) {
+        jobs += src_itr->_tiles;
+    }
+
+    QHash< QString, QList<TagItem::Elements> > tile_elts;
+    QSet<QString> tiled_sources;
+    for( QList<TileJob>::const_iterator job_itr = jobs.begin(); job_itr != jobs.end(); ++job_itr ) {
+        if( job_itr->_output.isEmpty() ) {
+            continue;
+        }
+
+        // empty tiles are saved but not listed in the XML
+        // as BBTag sessions only list tagged images
+        if( !job_itr->_tags.isEmpty() ) {
+            tile_elts[ job_itr->_output ] = job_itr->_tags;
+        }
+        tiled_sources.insert( job_itr->_fullpath );
+        ++local_stats._files;
+        local_stats._bytes += job_itr->_bytes;
+    }
+    local_stats._images = tiled_sources.count();
+
+    QFile xml_file( output_dir.absoluteFilePath( "dataset.xml" ) );
+    if( xml_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        write_xml( &xml_file, output_dir.absolutePath(), tag_color_dict, tile_elts );
+        local_stats._bytes += xml_file.size();
+        xml_file.close();
+    }
+
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_overlays(
+        const QDir& output_dir,
+        const QHash<QString, QColor>& tag_color_dict,
+        const QHash< QString, QList<TagItem::Elements> >& elts,
+        double scale,
+        int jpeg_quality,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() || scale <= 0. ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    QStringList paths;
+    if( !sort_paths( elts.keys(), paths ) ) {
+        return;
+    }
+    QStringList basenames = unique_basenames( paths );
+
+    QList<OverlayJob> jobs;
+    for( int i = 0; i < paths.count(); ++i ) {
+        OverlayJob job;
+        job._fullpath = paths.at( i );
+        job._tags = elts.value( paths.at( i ) );
+        job._basename = basenames.at( i );
+        job._bytes = 0;
+
+        // use the current label colors
+        for( QList<TagItem::Elements>::iterator tag_itr = job._tags.begin(); tag_itr != job._tags.end(); ++tag_itr ) {
+            if( tag_color_dict.contains( tag_itr->_label ) ) {
+                tag_itr->_color = tag_color_dict.value( tag_itr->_label );
+            }
+        }
+        jobs.append( job );
+    }
+
+    QProgressDialog progress( "Render tags on images", "Cancel", 0, jobs.count() );
+    progress.setWindowModality( Qt::WindowModal );
+    run_jobs( progress, jobs, OverlayRenderer( output_dir, qMin( scale, 1. ), jpeg_quality ) );
+    progress.setValue( jobs.count() );
+
+    for( QList<OverlayJob>::const_iterator job_itr = jobs.begin(); job_itr != jobs.end(); ++job_itr ) {
+        if( !job_itr->_output.isEmpty() ) {
+            ++local_stats._images;
+            ++local_stats._files;
+            local_stats._bytes += job_itr->_bytes;
+        }
+    }
+
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_coco(
+        QIODevice* out,
+        const QString& relative_dir,
+        const TagModel& model,
+        const QModelIndexList& selection,
+        ExportStats* stats
+    )
+{
+    if( !out ) {
+        return;
+    }
+
+    ExportStats local_stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    // category ids follow the label order starting at 1
+    QStringList labels = sorted_labels( model.get_all_tags() );
+
+    QJsonArray categories;
+    for( int i = 0; i < labels.count(); ++i ) {
+        QJsonObject category;
+        category.insert( "id", i + 1 );
+        category.insert( "name", labels.at( i ) );
+        category.insert( "supercategory", "none" );
+        categories.append( category );
+    }
+
+    QJsonObject info;
+    info.insert( "description", "created by BBTag" );
+
+    out->write( "{\"info\":" );
+    out->write( QJsonDocument( info ).toJson( QJsonDocument::Compact ) );
+    out->write( ",\n\"categories\":" );
+    out->write( QJsonDocument( categories ).toJson( QJsonDocument::Compact ) );
+
+    // images and annotations are two separate arrays:
+    // the model is visited twice so that entries are streamed
+    // instead of building the whole document in memory
+    QProgressDialog progress( "Saving as COCO JSON", "Cancel", 0, 2 * model.image_count() );
+    progress.setWindowModality( Qt::WindowModal );
+
+    out->write( ",\n\"images\":[" );
+    CocoImageWriter image_writer( out, progress, relative_dir );
+    bool ok = model.visit_elements( selection, image_writer ) && image_writer.flush();
+    out->write( "\n]" );
+
+    out->write( ",\n\"annotations\":[" );
+    if( ok ) {
+        progress.setValue( model.image_count() );
+        CocoAnnotationWriter annotation_writer( out, progress, labels, image_writer.skipped_ids_ );
+        model.visit_elements( selection, annotation_writer );
+    }
+    out->write( "\n]}\n" );
+
+    progress.setValue( progress.maximum() );
+
+    local_stats._images = image_writer.written_;
+    local_stats._files = 1;
+    local_stats._bytes = out->pos();
+    local_stats._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = local_stats;
+    }
+}
+
+void TagIO::write_voc(
+        const QDir& output_dir,
+        const TagModel& model,
+        const QModelIndexList& selection,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() ) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QProgressDialog progress( "Saving as Pascal VOC", "Cancel", 0, model.image_count() );
+    progress.setWindowModality( Qt::WindowModal );
+
+    AnnotationFileWriter<VocWriter> writer( progress, VocWriter( output_dir ) );
+    if( model.visit_elements( selection, writer ) ) {
+        writer.flush();
+    }
+    progress.setValue( progress.maximum() );
+
+    write_annotation_index( output_dir, writer.index_, writer.stats_ );
+
+    writer.stats_._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = writer.stats_;
+    }
+}
+
+void TagIO::write_yolo(
+        const QDir& output_dir,
+        const TagModel& model,
+        const QModelIndexList& selection,
+        ExportStats* stats
+    )
+{
+    if( !output_dir.exists() ) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QStringList labels = sorted_labels( model.get_all_tags() );
+
+    QProgressDialog progress( "Saving as YOLO", "Cancel", 0, model.image_count() );
+    progress.setWindowModality( Qt::WindowModal );
+
+    AnnotationFileWriter<YoloWriter> writer( progress, YoloWriter( output_dir, labels ) );
+    if( model.visit_elements( selection, writer ) ) {
+        writer.flush();
+    }
+    progress.setValue( progress.maximum() );
+
+    // class names, one per line in class index order
+    QFile classes_file( output_dir.absoluteFilePath( "classes.txt" ) );
+    if( classes_file.open( QFile::WriteOnly | QFile::Text ) ) {
+        QTextStream ts( &classes_file );
+        ts.setCodec( "UTF-8" );
+        for( QStringList::const_iterator label_itr = labels.begin(); label_itr != labels.end(); ++label_itr ) {
+            ts << *label_itr << "\n";
+        }
+        ts.flush();
+        writer.stats_._bytes += classes_file.size();
+        ++writer.stats_._files;
+        classes_file.close();
+    }
+
+    write_annotation_index( output_dir, writer.index_, writer.stats_ );
+
+    writer.stats_._elapsed = timer.elapsed();
+    if( stats ) {
+        *stats = writer.stats_;
+    }
+}
+
+bool TagIO::read_coco(
+        QIODevice* in,
+        const QString& relative_dir,
+        double min_score,
+        QHash< QString, QList<TagItem::Elements> >& elts
+    )
+{
+    if( !in ) {
+        return false;
+    }
+
+    QDir dir;
+    if( !relative_dir.isEmpty() ) {
+        dir = QDir( relative_dir ).absolutePath();
+    }
+
+    // progress is given in KB as the file can exceed the int range in bytes
+    QProgressDialog progress( "Reading COCO JSON", "Cancel", 0, int( qMax( in->size() / 1024, qint64( 1 ) ) ) );
+    progress.setWindowModality( Qt::WindowModal );
+
+    JsonReader json( in );
+    if( json.next() != JsonReader::BEGIN_OBJECT ) {
+        return false;
+    }
+
+    // members can come in any order so boxes are resolved at the end
+    QHash<int, QString> image_paths;
+    QHash<int, QString> category_names;
+    QVector<CocoBox> boxes;
+    int entry_count = 0;
+
+    JsonReader::Token token;
+    while( ( token = json.next() ) == JsonReader::KEY ) {
+        QByteArray member = json.utf8();
+        bool is_images = ( member == "images" );
+        bool is_categories = ( member == "categories" );
+        bool is_annotations = ( member == "annotations" );
+
+        if( !is_images && !is_categories && !is_annotations ) {
+            if( !json.skip_value() ) {
+                return false;
+            }
+            continue;
+        }
+
+        if( json.next() != JsonReader::BEGIN_ARRAY ) {
+            return false;
+        }
+
+        while( ( token = json.next() ) == JsonReader::BEGIN_OBJECT ) {
+            if( ++entry_count % COCO_PROGRESS_STEP == 0 ) {
+                progress.setValue( qMin( int( json.position() / 1024 ), progress.maximum() - 1 ) );
+                if( progress.wasCanceled() ) {
+                    return false;
+                }
+            }
+
+            if( is_annotations ) {
+                CocoBox box;
+                bool keep = false;
+                if( !read_coco_annotation( json, min_score, box, keep ) ) {
+                    return false;
+                }
+                if( keep ) {
+                    boxes.append( box );
+                }
+                continue;
+            }
+
+            int id = -1;
+            QString text;
+            if( !read_coco_entry( json, is_images? "file_name" : "name", id, text ) ) {
+                return false;
+            }
+            if( id < 0 || text.isEmpty() ) {
+                continue;
+            }
+
+            if( is_categories ) {
+                category_names.insert( id, text );
+                continue;
+            }
+
+            if( !relative_dir.isEmpty() && dir.exists() ) {
+                text = dir.absoluteFilePath( text );
+            }
+            image_paths.insert( id, text );
+        }
+
+        if( token != JsonReader::END_ARRAY ) {
+            return false;
+        }
+    }
+
+    if( token != JsonReader::END_OBJECT ) {
+        return false;
+    }
+
+    // images without box are listed as well (untagged)
+    for( QHash<int, QString>::const_iterator img_itr = image_paths.begin(); img_itr != image_paths.end(); ++img_itr ) {
+        elts.insert( img_itr.value(), QList<TagItem::Elements>() );
+    }
+
+    for( QVector<CocoBox>::const_iterator box_itr = boxes.begin(); box_itr != boxes.end(); ++box_itr ) {
+        QHash<int, QString>::const_iterator path_itr = image_paths.find( box_itr->_image_id );
+        if( path_itr == image_paths.end() ) {
+            continue;
+        }
+
+        QString label = category_names.value( box_itr->_category_id );
+        if( label.isEmpty() ) {
+            label = QString::number( box_itr->_category_id );
+        }
+
+        append_box( elts[ path_itr.value() ], path_itr.value(), label, box_itr->_bbox );
+    }
+
+    progress.setValue( progress.maximum() );
+
+    return true;
+}
+
+bool TagIO::read_annotation_dir(
+        const QDir& input_dir,
+        AnnotationFormat format,
+        QHash< QString, QList<TagItem::Elements> >& elts
+    )
+{
+    if( !input_dir.exists() || format == COCO_JSON ) {
+        return false;
+    }
+
+    QString suffix = ( format == PASCAL_VOC )? "xml" : "txt";
+
+    QSet<QString> image_suffixes;
+    QList<QByteArray> supported_img_format = QImageReader::supportedImageFormats();
+    for( QList<QByteArray>::const_iterator fmt_itr = supported_img_format.begin(); fmt_itr != supported_img_format.end(); ++fmt_itr ) {
+        image_suffixes.insert( QString::fromLatin1( *fmt_itr ).toLower() );
+    }
+
+    // a single walk lists the annotation files and indexes the images
+    // by directory and base name so that pairing needs no file check
+    QStringList files;
+    QHash<QString, QString> images;
+    QDirIterator dir_itr( input_dir.absolutePath(), QDir::Files, QDirIterator::Subdirectories );
+    while( dir_itr.hasNext() ) {
+        dir_itr.next();
+        QFileInfo fi = dir_itr.fileInfo();
+        QString file_suffix = fi.suffix().toLower();
+
+        if( file_suffix == suffix ) {
+            files.append( fi.absoluteFilePath() );
+        } else if( image_suffixes.contains( file_suffix ) ) {
+            images.insert( fi.absolutePath() + "/" + fi.completeBaseName(), fi.absoluteFilePath() );
+        }
+    }
+
+    // annotation files exported by BBTag are listed in index.tsv
+    // with the image they belong to
+    QHash<QString, QString> indexed_images;
+    QFile index_file( input_dir.absoluteFilePath( "index.tsv" ) );
+    if( index_file.open( QFile::ReadOnly | QFile::Text ) ) {
+        QTextStream ts( &index_file );
+        ts.setCodec( "UTF-8" );
+        while( !ts.atEnd() ) {
+            QStringList fields = ts.readLine().split( '\t' );
+            if( fields.count() == 2 ) {
+                indexed_images.insert( input_dir.absoluteFilePath( fields.at( 1 ) ), fields.at( 0 ) );
+            }
+        }
+        index_file.close();
+    }
+
+    // YOLO class names (darknet and BBTag layouts)
+    QStringList class_names;
+    if( format == YOLO_TXT ) {
+        QStringList names_files;
+        names_files << "classes.txt" << "obj.names";
+        for( QStringList::const_iterator name_itr = names_files.begin(); name_itr != names_files.end() && class_names.isEmpty(); ++name_itr ) {
+            QFile names_file( input_dir.absoluteFilePath( *name_itr ) );
+            if( !names_file.open( QFile::ReadOnly | QFile::Text ) ) {
+                continue;
+            }
+            QTextStream ts( &names_file );
+            ts.setCodec( "UTF-8" );
+            while( !ts.atEnd() ) {
+                class_names.append( ts.readLine().trimmed() );
+            }
+            files.removeAll( names_file.fileName() );
+            names_file.close();
+        }
+    }
+
+    QList<ParseJob> jobs;
+    int paired = 0;
+    for( int i = 0; i < files.count(); ++i ) {
+        const QString& file = files.at( i );
+        QFileInfo fi( file );
+        QString key = fi.absolutePath() + "/" + fi.completeBaseName();
+
+        // image next to its annotation file, or in the sibling images
+        // directory for the <root>/labels/ and <root>/images/ layout
+        QString image = indexed_images.value( file );
+        if( image.isEmpty() ) {
+            image = images.value( key );
+        }
+        if( image.isEmpty() ) {
+            int labels_pos = key.lastIndexOf( "/labels/" );
+            if( labels_pos >= 0 ) {
+                image = images.value( key.left( labels_pos ) + "/images/" + key.mid( labels_pos + 8 ) );
+            }
+        }
+
+        // other text files (READMEs, train.txt lists...) have no image
+        // and YOLO boxes cannot be scaled without one
+        if( format == YOLO_TXT && image.isEmpty() ) {
+            continue;
+        }
+
+        if( paired++ % PARSE_BATCH_SIZE == 0 ) {
+            jobs.append( ParseJob() );
+        }
+        jobs.last()._files.append( file );
+        jobs.last()._images.append( image );
+    }
+
+    QProgressDialog progress( "Reading annotation files", "Cancel", 0, jobs.count() );
+    progress.setWindowModality( Qt::WindowModal );
+    bool ok = run_jobs( progress, jobs, AnnotationParser( format, class_names ) );
+    progress.setValue( jobs.count() );
+
+    if( !ok ) {
+        return false;
+    }
+
+    for( QList<ParseJob>::const_iterator job_itr = jobs.begin(); job_itr != jobs.end(); ++job_itr ) {
+        for( QHash< QString, QList<TagItem::Elements> >::const_iterator elt_itr = job_itr->_elts.begin(); elt_itr != job_itr->_elts.end(); ++elt_itr ) {
+            elts[ elt_itr.key() ].append( elt_itr.value() );
+        }
+    }
+
+    return true;
 }
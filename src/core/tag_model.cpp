@@ -1,8 +1,41 @@
 #include <core/tag_model.h>
 #include <core/tag_item.h>
+#include <core/image_archive.h>
+#include <core/image_metadata.h>
 
 #include <QStandardItemModel>
 
+namespace {
+
+// returns true if the image file or archive member exists
+// images validated by the metadata store are not checked again
+bool image_exists(
+        const QFileInfo& image_file
+    )
+{
+    QString fullpath = image_file.absoluteFilePath();
+    return ImageMetadata::is_valid( fullpath ) || image_file.exists() || ImageArchive::contains( fullpath );
+}
+
+// gathers the visited elements in a table
+class ElementCollector : public TagModel::ElementVisitor
+{
+public:
+    virtual bool visit(
+            const QString& fullpath,
+            const QList<TagItem::Elements>& elts
+        )
+    {
+        elts_.insert( fullpath, elts );
+        return true;
+    }
+
+    QHash< QString, QList<TagItem::Elements> > elts_;
+};
+
+}
+
+
 QString TagModel::ALL = "<ALL>";
 QString TagModel::UNTAGGED = "<UNTAGGED>";
 
@@ -188,7 +221,7 @@ TagItem* TagModel::add_image_to_label(
         const QFileInfo& image_file
     )
 {
-    if( !label_item || !image_file.exists() ) {
+    if( !label_item || !image_exists( image_file ) ) {
         return 0;
     }
 
@@ -342,6 +375,88 @@ TagItem::Elements TagModel::get_element(
     return image->elements();
 }
 
+QList<TagItem::Elements> TagModel::get_image_elements(
+        const QString& fullpath
+    ) const
+{
+    QList<TagItem::Elements> elts;
+
+    QHash<QString, TagItemList>::const_iterator ref_itr = image_image_ref_.find( fullpath );
+    if( ref_itr == image_image_ref_.end() ) {
+        return elts;
+    }
+
+    const TagItemList& items = ref_itr.value();
+    for( TagItemList::const_iterator item_itr = items.begin(); item_itr != items.end(); ++item_itr ) {
+        QStandardItem* parent_item = (*item_itr)->QStandardItem::parent();
+        if( parent_item == untagged_item_ || parent_item == all_item_ ) {
+            continue;
+        }
+
+        elts.append( (*item_itr)->elements() );
+    }
+
+    return elts;
+}
+
+QStringList TagModel::get_image_paths(
+        const QModelIndex& label_index
+    ) const
+{
+    QStringList paths;
+    if( !label_index.isValid() || label_index.parent().isValid() ) {
+        return paths;
+    }
+
+    TagItem* label_item = dynamic_cast<TagItem*>(model_->itemFromIndex( label_index ));
+    if( !label_item ) {
+        return paths;
+    }
+
+    for( int r = 0; r < label_item->rowCount(); ++r ) {
+        TagItem* image_item = dynamic_cast<TagItem*>(label_item->child( r ));
+        if( image_item ) {
+            paths.append( image_item->fullpath() );
+        }
+    }
+
+    return paths;
+}
+
+QList<TagItem::Elements> TagModel::get_label_elements(
+        const QModelIndex& label_index
+    ) const
+{
+    QList<TagItem::Elements> elts;
+    if( !label_index.isValid() || label_index.parent().isValid() ) {
+        return elts;
+    }
+
+    TagItem* label_item = dynamic_cast<TagItem*>(model_->itemFromIndex( label_index ));
+    if( !label_item ) {
+        return elts;
+    }
+
+    elts.reserve( label_item->rowCount() );
+    for( int r = 0; r < label_item->rowCount(); ++r ) {
+        TagItem* image_item = dynamic_cast<TagItem*>(label_item->child( r ));
+        if( image_item ) {
+            elts.append( image_item->elements() );
+        }
+    }
+
+    return elts;
+}
+
+QModelIndex TagModel::get_index(
+        const QString& fullpath,
+        const QString& label
+    )
+{
+    TagItem* image = get_tag_item( fullpath, label );
+    return image? image->index() : QModelIndex();
+}
+
 QList<TagItem::Elements> TagModel::get_elements(
         const QModelIndexList& index_list
     ) const
@@ -383,14 +498,23 @@ QList<TagItem::Elements> TagModel::get_elements(
 QHash< QString, QList<TagItem::Elements> > TagModel::get_all_elements(
         const QModelIndexList& selection
     ) const
+{
+    ElementCollector collector;
+    visit_elements( selection, collector );
+
+    return collector.elts_;
+}
+
+bool TagModel::visit_elements(
+        const QModelIndexList& selection,
+        ElementVisitor& visitor
+    ) const
 {
     // if selection contains <ALL> returns, all items regardless of selection
     if( selection.contains( all_item_->index() ) ) {
-        return get_all_elements( QModelIndexList() );
+        return visit_elements( QModelIndexList(), visitor );
     }
 
-    QHash< QString, QList<TagItem::Elements> > elts;
-
     // special treatment for items under <ALL> selected
     QSet<QString> bypass_selection;
     for( QModelIndexList::const_iterator s_itr = selection.begin(); s_itr != selection.end(); ++s_itr ) {
@@ -406,11 +530,14 @@ QHash< QString, QList<TagItem::Elements> > TagModel::get_all_elements(
         bypass_selection.insert( item->fullpath() );
     }
 
+    // only the elements of one image are held at a time
+    QList<TagItem::Elements> elts;
 
     for( QHash<QString, TagItemList>::const_iterator elt_itr = image_image_ref_.begin(); elt_itr != image_image_ref_.end(); ++elt_itr ) {
         const QString& fullpath = elt_itr.key();
         const TagItemList& tags = elt_itr.value();
 
+        elts.clear();
         for( TagItemList::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
             TagItem* item = *tag_itr;
             QStandardItem* parent_item = item->QStandardItem::parent();
@@ -428,11 +555,15 @@ QHash< QString, QList<TagItem::Elements> > TagModel::get_all_elements(
                 continue;
             }
 
-            elts[ fullpath ].append( item->elements() );
+            elts.append( item->elements() );
+        }
+
+        if( !elts.isEmpty() && !visitor.visit( fullpath, elts ) ) {
+            return false;
         }
     }
 
-    return elts;
+    return true;
 }
 
 void TagModel::init_from_elements(
@@ -444,17 +575,25 @@ void TagModel::init_from_elements(
         init();
     }
 
+    // label items by name so that the tree is not searched for every tag
+    QHash<QString, TagItem*> label_items;
+    for( int r = 0; r < model_->rowCount(); ++r ) {
+        TagItem* item = dynamic_cast<TagItem*>(model_->item( r ));
+        if( !item || item == untagged_item_ || item == all_item_ ) {
+            continue;
+        }
+        label_items.insert( item->label(), item );
+    }
+
     for( QHash< QString, QList<TagItem::Elements> >::const_iterator elt_itr = elts.begin(); elt_itr != elts.end(); ++elt_itr ) {
-        const QString& fullpath = elt_itr.key();
         const QList<TagItem::Elements>& tags = elt_itr.value();
 
-        QFileInfoList fi;
-        fi.append( QFileInfo( fullpath ) );
-        import_images( fi );
-
+        // labels are created even if the image is missing
         for( QList<TagItem::Elements>::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
             const TagItem::Elements& elt = *tag_itr;
-            const QList<QRect>& bbox = elt._bbox;
+            if( elt._label.isEmpty() || label_items.contains( elt._label ) ) {
+                continue;
+            }
 
             QColor color = elt._color;
             if( !color.isValid() ) {
@@ -464,12 +603,54 @@ void TagModel::init_from_elements(
 
                 color = QColor::fromRgb( r, g, b );
             }
-            add_new_label( color, elt._label );
 
+            TagItem* label_item = new TagItem( color, elt._label );
+            model_->invisibleRootItem()->appendRow( label_item );
+            label_items.insert( elt._label, label_item );
+        }
+
+        // the file is checked once per image
+        QFileInfo fi( elt_itr.key() );
+        if( !image_exists( fi ) ) {
+            continue;
+        }
+        QString fullpath = fi.absoluteFilePath();
+
+        add_image_to_label( all_item_, fi );
+
+        for( QList<TagItem::Elements>::const_iterator tag_itr = tags.begin(); tag_itr != tags.end(); ++tag_itr ) {
+            const TagItem::Elements& elt = *tag_itr;
+            if( elt._bbox.isEmpty() || elt._label.isEmpty() ) {
+                continue;
+            }
+
+            TagItem* image = get_tag_item( fullpath, elt._label );
+            if( !image ) {
+                image = add_image_to_label( label_items.value( elt._label ), fi );
+                if( !image ) {
+                    continue;
+                }
+            }
+
+            const QList<QRect>& bbox = elt._bbox;
             for( QList<QRect>::const_iterator bbox_itr = bbox.begin(); bbox_itr != bbox.end(); ++bbox_itr ) {
-                add_tag_to_label( fullpath, elt._label, *bbox_itr );
+                image->add_tag( *bbox_itr );
             }
         }
+
+        // image is only referenced by ALL (and maybe UNTAGGED)
+        // if none of its labels has a tag
+        TagItem* item_as_untagged = get_tag_item( fullpath, UNTAGGED );
+        bool tagged = ( image_label_ref_[ fullpath ].count() > ( item_as_untagged? 2 : 1 ) );
+
+        if( !tagged && !item_as_untagged ) {
+            add_image_to_label( untagged_item_, fi );
+
+        } else if( tagged && item_as_untagged ) {
+            image_label_ref_[ fullpath ].removeAll( untagged_item_ );
+            image_image_ref_[ fullpath ].removeAll( item_as_untagged );
+            model_->removeRow( item_as_untagged->index().row(), untagged_item_->index() );
+        }
     }
 }
 
@@ -550,3 +731,18 @@ QModelIndex TagModel::remove_tag_from_label(
 
     return index;
 }
+
+bool TagModel::update_tag(
+        const QString& fullpath,
+        const QString& label,
+        const QRect& tag,
+        const QRect& new_tag
+    )
+{
+    TagItem* image = get_tag_item( fullpath, label );
+    if( !image ) {
+        return false;
+    }
+
+    return image->replace_tag( tag, new_tag );
+}
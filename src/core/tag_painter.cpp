@@ -0,0 +1,124 @@
+#include <core/tag_painter.h>
+
+#include <QPainter>
+#include <QFontMetrics>
+#include <QStaticText>
+#include <QVector>
+
+const int TagPainter::PEN_WIDTH = 2;
+const int TagPainter::FONT_SIZE = 10;
+
+
+QFont TagPainter::label_font()
+{
+    QFont font;
+    font.setPointSize( FONT_SIZE );
+    return font;
+}
+
+void TagPainter::set_label_font(
+        QPainter& p
+    )
+{
+    p.setFont( label_font() );
+}
+
+QRect TagPainter::painted_rect(
+        const QFont& font,
+        const QString& label,
+        const QRect& bbox,
+        float scale_factor
+    )
+{
+    QRect scaled_box( scale_factor * bbox.topLeft(), scale_factor * bbox.bottomRight() );
+    QRect painted = scaled_box.adjusted( -PEN_WIDTH, -PEN_WIDTH, PEN_WIDTH, PEN_WIDTH );
+
+    // label text is drawn from the top-left corner (baseline)
+    if( !label.isEmpty() ) {
+        QFontMetrics metrics( font );
+        QRect text( scaled_box.x(), scaled_box.y() - metrics.ascent(), metrics.width( label ), metrics.height() );
+        painted |= text.adjusted( -1, -1, 1, 1 );
+    }
+
+    return painted;
+}
+
+void TagPainter::draw_tags(
+        QPainter& p,
+        const QColor& color,
+        const QString& label,
+        const QList<QRect>& bbox,
+        float scale_factor
+    )
+{
+    p.setPen( QPen( color, PEN_WIDTH ) );
+
+    for( QList<QRect>::const_iterator bbox_itr = bbox.begin(); bbox_itr != bbox.end(); ++bbox_itr ) {
+        const QRect& box_rect = *bbox_itr;
+        QRect scaled_box( scale_factor * box_rect.topLeft(), scale_factor * box_rect.bottomRight() );
+        p.drawRect( scaled_box );
+        p.drawText( scaled_box.x(), scaled_box.y(), label );
+    }
+}
+
+QStaticText TagPainter::label_text(
+        const QString& label
+    )
+{
+    QStaticText text( label );
+    text.setTextFormat( Qt::PlainText );
+    text.setPerformanceHint( QStaticText::AggressiveCaching );
+    text.prepare( QTransform(), label_font() );
+    return text;
+}
+
+void TagPainter::draw_tags(
+        QPainter& p,
+        const QColor& color,
+        const QStaticText& label,
+        const QList<QRect>& bbox,
+        float scale_factor,
+        const QRect& clip
+    )
+{
+    // static text is drawn from its top-left corner
+    // instead of the baseline
+    int ascent = p.fontMetrics().ascent();
+    QSize text_size = label.text().isEmpty()? QSize() : label.size().toSize();
+
+    QVector<QRect> rects;
+    QVector<QPoint> text_pos;
+    rects.reserve( bbox.size() );
+
+    for( QList<QRect>::const_iterator bbox_itr = bbox.begin(); bbox_itr != bbox.end(); ++bbox_itr ) {
+        const QRect& box_rect = *bbox_itr;
+        QRect scaled_box( scale_factor * box_rect.topLeft(), scale_factor * box_rect.bottomRight() );
+
+        QRect painted = scaled_box.adjusted( -PEN_WIDTH, -PEN_WIDTH, PEN_WIDTH, PEN_WIDTH );
+        QRect text( QPoint( scaled_box.x(), scaled_box.y() - ascent ), text_size );
+        if( !text.isEmpty() ) {
+            painted |= text.adjusted( -1, -1, 1, 1 );
+        }
+
+        if( !painted.intersects( clip ) ) {
+            continue;
+        }
+
+        rects.append( scaled_box );
+        if( !text.isEmpty() ) {
+            text_pos.append( text.topLeft() );
+        }
+    }
+
+    if( rects.isEmpty() ) {
+        return;
+    }
+
+    p.setPen( QPen( color, PEN_WIDTH ) );
+    p.setBrush( Qt::NoBrush );
+    p.drawRects( rects );
+
+    for( QVector<QPoint>::const_iterator pos_itr = text_pos.begin(); pos_itr != text_pos.end(); ++pos_itr ) {
+        p.drawStaticText( *pos_itr, label );
+    }
+}
@@ -0,0 +1,131 @@
+#include <core/tar_writer.h>
+
+#include <QIODevice>
+#include <QDateTime>
+
+#include <cstring>
+#include <cstdio>
+
+namespace {
+    const int BLOCK_SIZE = 512;
+}
+
+
+TarWriter::TarWriter(
+        QIODevice* out
+    ) : out_( out ), pos_( 0 )
+{
+}
+
+TarWriter::~TarWriter()
+{
+}
+
+bool TarWriter::make_header(
+        const QString& name,
+        qint64 data_size,
+        char* header
+    )
+{
+    memset( header, 0, BLOCK_SIZE );
+
+    // ustar stores up to 100 bytes of name
+    // and 155 bytes of prefix (split on a '/')
+    QByteArray utf8_name = name.toUtf8();
+    QByteArray prefix;
+    if( utf8_name.size() > 100 ) {
+        int split = utf8_name.lastIndexOf( '/', 155 );
+        if( split <= 0 || utf8_name.size() - split - 1 > 100 ) {
+            return false;
+        }
+        prefix = utf8_name.left( split );
+        utf8_name = utf8_name.mid( split + 1 );
+    }
+
+    memcpy( header, utf8_name.constData(), utf8_name.size() );
+    memcpy( header + 100, "0000644", 7 );                          // mode
+    memcpy( header + 108, "0000000", 7 );                          // uid
+    memcpy( header + 116, "0000000", 7 );                          // gid
+    sprintf( header + 124, "%011llo", (unsigned long long)data_size ); // size
+    sprintf( header + 136, "%011llo", (unsigned long long)QDateTime::currentDateTime().toTime_t() ); // mtime
+    header[156] = '0';                                             // regular file
+    memcpy( header + 257, "ustar", 6 );                            // magic
+    memcpy( header + 263, "00", 2 );                               // version
+    memcpy( header + 345, prefix.constData(), prefix.size() );
+
+    // checksum is computed with the checksum field filled with spaces
+    memset( header + 148, ' ', 8 );
+    unsigned int checksum = 0;
+    for( int i = 0; i < BLOCK_SIZE; ++i ) {
+        checksum += (unsigned char)header[i];
+    }
+    sprintf( header + 148, "%06o", checksum );
+    header[155] = ' ';
+
+    return true;
+}
+
+qint64 TarWriter::add_file(
+        const QString& name,
+        const QByteArray& data
+    )
+{
+    if( !out_ ) {
+        return -1;
+    }
+
+    char header[BLOCK_SIZE];
+    if( !make_header( name, data.size(), header ) ) {
+        return -1;
+    }
+
+    if( out_->write( header, BLOCK_SIZE ) != BLOCK_SIZE ) {
+        return -1;
+    }
+    pos_ += BLOCK_SIZE;
+
+    qint64 data_offset = pos_;
+    if( out_->write( data ) != data.size() ) {
+        return -1;
+    }
+    pos_ += data.size();
+
+    // members are padded to a whole number of blocks
+    int padding = ( BLOCK_SIZE - data.size() % BLOCK_SIZE ) % BLOCK_SIZE;
+    if( padding > 0 ) {
+        QByteArray zeros( padding, '\0' );
+        if( out_->write( zeros ) != padding ) {
+            return -1;
+        }
+        pos_ += padding;
+    }
+
+    return data_offset;
+}
+
+bool TarWriter::rewind(
+        qint64 size
+    )
+{
+    if( !out_ || size < 0 || size > pos_ || !out_->seek( size ) ) {
+        return false;
+    }
+    pos_ = size;
+
+    return true;
+}
+
+bool TarWriter::finish()
+{
+    if( !out_ ) {
+        return false;
+    }
+
+    // end of archive is marked by 2 empty blocks
+    QByteArray zeros( 2 * BLOCK_SIZE, '\0' );
+    bool ok = ( out_->write( zeros ) == zeros.size() );
+    pos_ += zeros.size();
+    out_ = 0;
+
+    return ok;
+}
@@ -0,0 +1,266 @@
+#include <core/thumbnail_cache.h>
+#include <core/image_codec.h>
+#include <core/image_archive.h>
+
+#include <QRunnable>
+#include <QThread>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QUrl>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QImageReader>
+#include <QSaveFile>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+const int ThumbnailCache::NORMAL_SIZE = 128;
+const int ThumbnailCache::LARGE_SIZE = 256;
+
+namespace {
+
+// number of images handled by a single background task
+const int TASK_BATCH_SIZE = 32;
+
+// lowers the CPU priority of the calling worker
+// so that the generation does not slow down the interface
+void lower_thread_priority()
+{
+#ifdef Q_OS_LINUX
+    // threads have their own nice value on Linux
+    // (QThread priorities are ignored by the default scheduler)
+    setpriority( PRIO_PROCESS, id_t( syscall( SYS_gettid ) ), 19 );
+#else
+    QThread::currentThread()->setPriority( QThread::IdlePriority );
+#endif
+}
+
+}
+
+
+// generates the thumbnails of a batch of images
+// and drops them if the cache generation changed
+class ThumbnailTask : public QRunnable
+{
+public:
+    ThumbnailTask(
+            ThumbnailCache* cache,
+            const QStringList& paths,
+            int size,
+            int generation
+        ) : cache_( cache ), paths_( paths ), size_( size ), generation_( generation )
+    {
+    }
+
+    virtual void run()
+    {
+        lower_thread_priority();
+
+        for( QStringList::const_iterator path_itr = paths_.begin(); path_itr != paths_.end(); ++path_itr ) {
+            if( cache_->generation_.load() != generation_ ) {
+                return;
+            }
+
+            QImage thumb = ThumbnailCache::thumbnail( *path_itr, size_ );
+            if( thumb.isNull() ) {
+                continue;
+            }
+
+            // thumbnails made by other programs may miss the image size
+            if( thumb.text( "Thumb::Image::Width" ).isEmpty() ) {
+                QSize image_size = ImageCodec::probe_size( *path_itr );
+                thumb.setText( "Thumb::Image::Width", QString::number( image_size.width() ) );
+                thumb.setText( "Thumb::Image::Height", QString::number( image_size.height() ) );
+            }
+
+            emit cache_->thumbnail_ready( *path_itr, size_, thumb );
+        }
+    }
+
+private:
+    ThumbnailCache* cache_;
+    QStringList paths_;
+    int size_;
+    int generation_;
+};
+
+
+ThumbnailCache::ThumbnailCache(
+        QObject* parent
+    ) : QObject( parent ), generation_( 0 )
+{
+    // leave half of the cores to the interface and the exporters
+    pool_.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() / 2 ) );
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    cancel();
+    pool_.waitForDone();
+}
+
+bool ThumbnailCache::identify(
+        const QString& path,
+        QByteArray& uri,
+        QString& mtime,
+        QString& file_size
+    )
+{
+    QString file = path;
+    if( ImageArchive::is_member_path( path ) ) {
+        file = path.left( path.indexOf( ImageArchive::SEPARATOR ) );
+    }
+
+    QFileInfo fi( file );
+    if( !fi.isFile() ) {
+        return false;
+    }
+
+    uri = QUrl::fromLocalFile( QFileInfo( path ).absoluteFilePath() ).toEncoded();
+    mtime = QString::number( fi.lastModified().toTime_t() );
+    file_size = QString::number( fi.size() );
+
+    return true;
+}
+
+QString ThumbnailCache::thumbnail_path(
+        const QString& path,
+        int size
+    )
+{
+    QByteArray uri;
+    QString mtime;
+    QString file_size;
+    if( !identify( path, uri, mtime, file_size ) ) {
+        return QString();
+    }
+
+    // archive members have no URI the other applications understand:
+    // their thumbnails are kept out of the shared cache
+    QString cache_dir = QStandardPaths::writableLocation(
+        ImageArchive::is_member_path( path )? QStandardPaths::CacheLocation : QStandardPaths::GenericCacheLocation
+    );
+    QString flavor = ( size > NORMAL_SIZE )? "large" : "normal";
+    QString hash = QCryptographicHash::hash( uri, QCryptographicHash::Md5 ).toHex();
+
+    return cache_dir + "/thumbnails/" + flavor + "/" + hash + ".png";
+}
+
+QImage ThumbnailCache::lookup(
+        const QString& path,
+        int size
+    )
+{
+    QByteArray uri;
+    QString mtime;
+    QString file_size;
+    if( !identify( path, uri, mtime, file_size ) ) {
+        return QImage();
+    }
+
+    QString thumb_path = thumbnail_path( path, size );
+    if( thumb_path.isEmpty() ) {
+        return QImage();
+    }
+
+    // text chunks are read before the pixels
+    QImageReader reader( thumb_path, "png" );
+    if( reader.text( "Thumb::URI" ) != QString::fromLatin1( uri ) || reader.text( "Thumb::MTime" ) != mtime ) {
+        return QImage();
+    }
+
+    QString thumb_size = reader.text( "Thumb::Size" );
+    if( !thumb_size.isEmpty() && thumb_size != file_size ) {
+        return QImage();
+    }
+
+    return reader.read();
+}
+
+QImage ThumbnailCache::generate(
+        const QString& path,
+        int size
+    )
+{
+    QByteArray uri;
+    QString mtime;
+    QString file_size;
+    if( !identify( path, uri, mtime, file_size ) ) {
+        return QImage();
+    }
+
+    // decoders supporting it (e.g. JPEG) directly decode at reduced size
+    QSize image_size = ImageCodec::probe_size( path );
+    QSize scaled_size;
+    if( image_size.isValid() && ( image_size.width() > size || image_size.height() > size ) ) {
+        scaled_size = image_size.scaled( size, size, Qt::KeepAspectRatio );
+    }
+
+    QImage thumb = ImageCodec::read( path, scaled_size );
+    if( thumb.isNull() ) {
+        return QImage();
+    }
+
+    thumb.setText( "Thumb::URI", QString::fromLatin1( uri ) );
+    thumb.setText( "Thumb::MTime", mtime );
+    thumb.setText( "Thumb::Size", file_size );
+    thumb.setText( "Software", "BBTag" );
+    if( image_size.isValid() ) {
+        thumb.setText( "Thumb::Image::Width", QString::number( image_size.width() ) );
+        thumb.setText( "Thumb::Image::Height", QString::number( image_size.height() ) );
+    }
+
+    // written to a temporary file then renamed
+    // so that readers never see a partial thumbnail
+    QString thumb_path = thumbnail_path( path, size );
+    QDir().mkpath( QFileInfo( thumb_path ).absolutePath() );
+
+    QSaveFile file( thumb_path );
+    if( file.open( QFile::WriteOnly ) ) {
+        file.setPermissions( QFile::ReadOwner | QFile::WriteOwner );
+        if( thumb.save( &file, "png" ) ) {
+            file.commit();
+        } else {
+            file.cancelWriting();
+        }
+    }
+
+    return thumb;
+}
+
+QImage ThumbnailCache::thumbnail(
+        const QString& path,
+        int size
+    )
+{
+    QImage thumb = lookup( path, size );
+    if( thumb.isNull() ) {
+        thumb = generate( path, size );
+    }
+
+    return thumb;
+}
+
+void ThumbnailCache::prefetch(
+        const QStringList& paths,
+        int size,
+        int priority
+    )
+{
+    int generation = generation_.load();
+    for( int i = 0; i < paths.count(); i += TASK_BATCH_SIZE ) {
+        pool_.start( new ThumbnailTask( this, paths.mid( i, TASK_BATCH_SIZE ), size, generation ), priority );
+    }
+}
+
+void ThumbnailCache::cancel()
+{
+    // running tasks stop at their next image
+    generation_.ref();
+    pool_.clear();
+}
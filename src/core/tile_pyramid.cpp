@@ -0,0 +1,361 @@
+#include <core/tile_pyramid.h>
+#include <core/image_codec.h>
+
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+
+#include <cmath>
+
+const int TilePyramid::TILE_SIZE = 512;
+
+namespace {
+
+// images with more pixels are displayed through tiles
+const qint64 TILED_PIXELS = 64 * 1024 * 1024;
+
+// column (and row) of the key of a whole level request
+const int WHOLE_LEVEL = 0xffffff;
+
+// returns a tile converted for a fast pixmap conversion
+QImage display_format(
+        const QImage& image
+    )
+{
+    return image.convertToFormat( image.hasAlphaChannel()? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+}
+
+}
+
+
+// decodes a single tile with region decoding
+// or a whole level if the decoder does not support it
+class TileTask : public QRunnable
+{
+public:
+    // single tile: clip is the tile area in image coordinates
+    // and scaled_size its size at the level
+    TileTask(
+            TilePyramid* pyramid,
+            const QString& path,
+            int generation,
+            int level,
+            int col,
+            int row,
+            const QRect& clip,
+            const QSize& scaled_size
+        ) : pyramid_( pyramid ), path_( path ), generation_( generation ),
+            level_( level ), col_( col ), row_( row ), clip_( clip ), scaled_size_( scaled_size )
+    {
+    }
+
+    // whole level: scaled_size is the size of the image at the level
+    TileTask(
+            TilePyramid* pyramid,
+            const QString& path,
+            int generation,
+            int level,
+            const QSize& scaled_size
+        ) : pyramid_( pyramid ), path_( path ), generation_( generation ),
+            level_( level ), col_( WHOLE_LEVEL ), row_( WHOLE_LEVEL ), scaled_size_( scaled_size )
+    {
+    }
+
+    virtual void run()
+    {
+        if( pyramid_->generation_.load() != generation_ ||
+            !pyramid_->take( TilePyramid::tile_key( level_, col_, row_ ) )
+        ) {
+            return;
+        }
+
+        if( col_ != WHOLE_LEVEL ) {
+            QImage tile = ImageCodec::read( path_, scaled_size_, clip_ );
+            emit pyramid_->decoded( generation_, level_, col_, row_, display_format( tile ) );
+            return;
+        }
+
+        // the level is kept by the pyramid which cuts the tiles on demand
+        QImage level_image = ImageCodec::read( path_, scaled_size_ );
+        if( !level_image.isNull() ) {
+            level_image = display_format( level_image );
+        }
+        emit pyramid_->decoded( generation_, level_, col_, row_, level_image );
+    }
+
+private:
+    TilePyramid* pyramid_;
+    QString path_;
+    int generation_;
+    int level_;
+    int col_;
+    int row_;
+    QRect clip_;
+    QSize scaled_size_;
+};
+
+
+TilePyramid::TilePyramid(
+        int max_cost,
+        QObject* parent
+    ) : QObject( parent ), max_cost_( max_cost ), region_decoding_( false ), level_count_( 0 ), min_level_( 0 ),
+        level_image_level_( -1 ), tiles_( max_cost ), request_count_( 0 ), generation_( 0 )
+{
+    pool_.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() / 2 ) );
+
+    connect(
+        this, SIGNAL( decoded(int,int,int,int,QImage) ),
+        this, SLOT( add_tile(int,int,int,int,QImage) ),
+        Qt::QueuedConnection
+    );
+}
+
+TilePyramid::~TilePyramid()
+{
+    generation_.ref();
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+bool TilePyramid::needs_tiles(
+        const QSize& image_size
+    )
+{
+    return qint64( image_size.width() ) * qint64( image_size.height() ) > TILED_PIXELS;
+}
+
+void TilePyramid::set_image(
+        const QString& path,
+        const QSize& image_size
+    )
+{
+    if( path == path_ && image_size == image_size_ ) {
+        return;
+    }
+
+    generation_.ref();
+    pool_.clear();
+    {
+        QMutexLocker locker( &mutex_ );
+        wanted_.clear();
+        in_flight_.clear();
+    }
+    tiles_.clear();
+    level_image_ = QImage();
+    level_image_level_ = -1;
+
+    path_ = image_size.isValid()? path : QString();
+    image_size_ = image_size;
+    // the decoder is picked from the file name: the image data
+    // (a whole member for deflated archive members) is not read here
+    region_decoding_ = !path_.isEmpty() && ImageCodec::supports_region_decoding( path_ );
+
+    // the coarsest level fits in a single tile
+    level_count_ = 1;
+    while( !path_.isEmpty() && ( level_size( level_count_ - 1 ).width() > TILE_SIZE || level_size( level_count_ - 1 ).height() > TILE_SIZE ) ) {
+        ++level_count_;
+    }
+
+    // without region decoding, a whole level is decoded and kept:
+    // only the levels fitting in half of the cache are used
+    min_level_ = 0;
+    while( !region_decoding_ && min_level_ < level_count_ - 1 &&
+        qint64( level_size( min_level_ ).width() ) * level_size( min_level_ ).height() * 4 / 1024 > max_cost_ / 2
+    ) {
+        ++min_level_;
+    }
+}
+
+QSize TilePyramid::level_size(
+        int level
+    ) const
+{
+    int factor = 1 << level;
+    return QSize( ( image_size_.width() + factor - 1 ) / factor, ( image_size_.height() + factor - 1 ) / factor );
+}
+
+int TilePyramid::level_for_scale(
+        float scale
+    ) const
+{
+    if( scale >= 1. || scale <= 0. ) {
+        return 0;
+    }
+
+    int level = int( std::floor( std::log( 1. / scale ) / std::log( 2. ) ) );
+    return qBound( min_level_, level, qMax( min_level_, level_count_ - 1 ) );
+}
+
+QRect TilePyramid::tile_range(
+        int level,
+        const QRect& image_rect
+    ) const
+{
+    QRect level_rect(
+        image_rect.x() >> level,
+        image_rect.y() >> level,
+        ( image_rect.width() >> level ) + 2,
+        ( image_rect.height() >> level ) + 2
+    );
+    level_rect &= QRect( QPoint( 0, 0 ), level_size( level ) );
+    if( level_rect.isEmpty() ) {
+        return QRect();
+    }
+
+    return QRect(
+        QPoint( level_rect.left() / TILE_SIZE, level_rect.top() / TILE_SIZE ),
+        QPoint( level_rect.right() / TILE_SIZE, level_rect.bottom() / TILE_SIZE )
+    );
+}
+
+QRect TilePyramid::level_tile_rect(
+        int level,
+        int col,
+        int row
+    ) const
+{
+    return QRect( col * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE ) & QRect( QPoint( 0, 0 ), level_size( level ) );
+}
+
+QRect TilePyramid::tile_rect(
+        int level,
+        int col,
+        int row
+    ) const
+{
+    QRect level_rect = level_tile_rect( level, col, row );
+    QRect image_rect( level_rect.x() << level, level_rect.y() << level, level_rect.width() << level, level_rect.height() << level );
+    return image_rect & QRect( QPoint( 0, 0 ), image_size_ );
+}
+
+quint64 TilePyramid::tile_key(
+        int level,
+        int col,
+        int row
+    )
+{
+    return ( quint64( level ) << 48 ) | ( quint64( col & WHOLE_LEVEL ) << 24 ) | quint64( row & WHOLE_LEVEL );
+}
+
+QImage TilePyramid::tile(
+        int level,
+        int col,
+        int row
+    ) const
+{
+    QImage* cached_tile = tiles_.object( tile_key( level, col, row ) );
+    return cached_tile? *cached_tile : QImage();
+}
+
+void TilePyramid::request(
+        int level,
+        const QRect& tiles
+    )
+{
+    if( !is_active() || tiles.isEmpty() || level < min_level_ ) {
+        return;
+    }
+
+    // tiles are cut from the decoded level
+    // (only the requested ones are cached)
+    if( !region_decoding_ && level == level_image_level_ ) {
+        for( int row = tiles.top(); row <= tiles.bottom(); ++row ) {
+            for( int col = tiles.left(); col <= tiles.right(); ++col ) {
+                quint64 key = tile_key( level, col, row );
+                if( !tiles_.contains( key ) ) {
+                    QImage* tile = new QImage( level_image_.isNull()? QImage() : level_image_.copy( level_tile_rect( level, col, row ) ) );
+                    tiles_.insert( key, tile, qMax( 1, tile->byteCount() / 1024 ) );
+                }
+            }
+        }
+        return;
+    }
+
+    QList<quint64> keys;
+    for( int row = tiles.top(); row <= tiles.bottom(); ++row ) {
+        for( int col = tiles.left(); col <= tiles.right(); ++col ) {
+            if( !tiles_.contains( tile_key( level, col, row ) ) ) {
+                keys.append( tile_key( level, col, row ) );
+            }
+        }
+    }
+
+    // the level is decoded once whatever tile is missing
+    // if tiles cannot be decoded alone (see above)
+    if( !region_decoding_ && !keys.isEmpty() ) {
+        keys.clear();
+        keys.append( tile_key( level, WHOLE_LEVEL, WHOLE_LEVEL ) );
+    }
+
+    QList<quint64> queued;
+    {
+        QMutexLocker locker( &mutex_ );
+        wanted_.clear();
+        for( QList<quint64>::const_iterator key_itr = keys.begin(); key_itr != keys.end(); ++key_itr ) {
+            wanted_.insert( *key_itr );
+            if( !in_flight_.contains( *key_itr ) ) {
+                in_flight_.insert( *key_itr );
+                queued.append( *key_itr );
+            }
+        }
+    }
+
+    int generation = generation_.load();
+    for( QList<quint64>::const_iterator key_itr = queued.begin(); key_itr != queued.end(); ++key_itr ) {
+        int col = int( ( *key_itr >> 24 ) & WHOLE_LEVEL );
+        int row = int( *key_itr & WHOLE_LEVEL );
+
+        if( col == WHOLE_LEVEL ) {
+            pool_.start( new TileTask( this, path_, generation, level, level_size( level ) ), ++request_count_ );
+        } else {
+            QRect level_rect = level_tile_rect( level, col, row );
+            pool_.start( new TileTask( this, path_, generation, level, col, row, tile_rect( level, col, row ), level_rect.size() ), ++request_count_ );
+        }
+    }
+}
+
+bool TilePyramid::take(
+        quint64 key
+    )
+{
+    QMutexLocker locker( &mutex_ );
+    if( wanted_.contains( key ) ) {
+        return true;
+    }
+
+    in_flight_.remove( key );
+    return false;
+}
+
+void TilePyramid::add_tile(
+        int generation,
+        int level,
+        int col,
+        int row,
+        const QImage& tile
+    )
+{
+    if( generation != generation_.load() ) {
+        return;
+    }
+
+    {
+        QMutexLocker locker( &mutex_ );
+        in_flight_.remove( tile_key( level, col, row ) );
+    }
+
+    // a level that cannot be decoded is kept as a null image
+    // so that it is not requested again
+    if( col == WHOLE_LEVEL ) {
+        level_image_ = tile;
+        level_image_level_ = level;
+        emit tile_ready( QRect( QPoint( 0, 0 ), image_size_ ) );
+        return;
+    }
+
+    // tiles that cannot be decoded are cached as null images
+    // so that they are not requested again
+    tiles_.insert( tile_key( level, col, row ), new QImage( tile ), qMax( 1, tile.byteCount() / 1024 ) );
+
+    emit tile_ready( tile_rect( level, col, row ) );
+}
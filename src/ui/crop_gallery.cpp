@@ -0,0 +1,238 @@
+#include <ui/crop_gallery.h>
+
+#include <QPainter>
+#include <QFileInfo>
+
+namespace {
+    // tile layout
+    const int CROP_SIZE = 96;
+    const int TILE_MARGIN = 3;
+
+    // crops kept in memory (in KB)
+    const int PIXMAP_CACHE_SIZE = 64 * 1024;
+}
+
+
+CropGalleryModel::CropGalleryModel(
+        QObject* parent
+    ) : LazyListModel( PIXMAP_CACHE_SIZE, parent )
+{
+    crop_loader_ = new CropLoader( this );
+
+    connect(
+        crop_loader_, SIGNAL( crop_ready(QString,QRect,QImage) ),
+        this, SLOT( add_crop(QString,QRect,QImage) ),
+        Qt::QueuedConnection
+    );
+}
+
+CropGalleryModel::~CropGalleryModel()
+{
+}
+
+QString CropGalleryModel::crop_key(
+        const QString& fullpath,
+        const QRect& bbox
+    )
+{
+    return QString( "%1#%2,%3,%4,%5" ).arg( fullpath ).arg( bbox.x() ).arg( bbox.y() ).arg( bbox.width() ).arg( bbox.height() );
+}
+
+void CropGalleryModel::set_boxes(
+        const QString& label,
+        const QColor& color,
+        const QList<TagItem::Elements>& elts
+    )
+{
+    drop_requests();
+
+    beginResetModel();
+    label_ = label;
+    color_ = color;
+    images_.clear();
+    entries_.clear();
+
+    for( QList<TagItem::Elements>::const_iterator elt_itr = elts.begin(); elt_itr != elts.end(); ++elt_itr ) {
+        if( elt_itr->_bbox.isEmpty() ) {
+            continue;
+        }
+
+        Entry entry;
+        entry._image = images_.count();
+        images_.append( elt_itr->_fullpath );
+
+        const QList<QRect>& bbox = elt_itr->_bbox;
+        for( QList<QRect>::const_iterator bbox_itr = bbox.begin(); bbox_itr != bbox.end(); ++bbox_itr ) {
+            entry._bbox = *bbox_itr;
+            entries_.append( entry );
+        }
+    }
+    endResetModel();
+}
+
+int CropGalleryModel::rowCount(
+        const QModelIndex& parent
+    ) const
+{
+    return parent.isValid()? 0 : entries_.count();
+}
+
+QVariant CropGalleryModel::data(
+        const QModelIndex& index,
+        int role
+    ) const
+{
+    if( !index.isValid() || index.row() >= entries_.count() ) {
+        return QVariant();
+    }
+
+    const Entry& entry = entries_.at( index.row() );
+    const QString& fullpath = images_.at( entry._image );
+
+    if( role == FullpathRole ) {
+        return QVariant( fullpath );
+
+    } else if( role == BoxRole ) {
+        return QVariant( entry._bbox );
+
+    } else if( role == Qt::ToolTipRole ) {
+        return QVariant(
+            QString( "%1\n%2x%3 at (%4, %5)" )
+                .arg( QFileInfo( fullpath ).fileName() )
+                .arg( entry._bbox.width() ).arg( entry._bbox.height() )
+                .arg( entry._bbox.x() ).arg( entry._bbox.y() )
+        );
+
+    } else if( role == Qt::DecorationRole ) {
+        return decoration( index.row() );
+    }
+
+    return QVariant();
+}
+
+QString CropGalleryModel::pixmap_key(
+        int row
+    ) const
+{
+    const Entry& entry = entries_.at( row );
+    return crop_key( images_.at( entry._image ), entry._bbox );
+}
+
+void CropGalleryModel::load_pixmaps(
+        const QList<int>& rows,
+        int priority
+    )
+{
+    // rows are in the gallery order: boxes of the same image stay contiguous
+    QList<CropLoader::Request> requests;
+    for( QList<int>::const_iterator row_itr = rows.begin(); row_itr != rows.end(); ++row_itr ) {
+        const Entry& entry = entries_.at( *row_itr );
+        CropLoader::Request request;
+        request._fullpath = images_.at( entry._image );
+        request._bbox = entry._bbox;
+        requests.append( request );
+    }
+    crop_loader_->request( requests, CROP_SIZE, priority );
+}
+
+void CropGalleryModel::cancel_loading()
+{
+    crop_loader_->cancel();
+}
+
+void CropGalleryModel::add_crop(
+        const QString& fullpath,
+        const QRect& bbox,
+        const QImage& crop
+    )
+{
+    add_pixmap( crop_key( fullpath, bbox ), crop );
+}
+
+
+CropDelegate::CropDelegate(
+        QObject* parent
+    ) : QStyledItemDelegate( parent )
+{
+}
+
+CropDelegate::~CropDelegate()
+{
+}
+
+QSize CropDelegate::sizeHint(
+        const QStyleOptionViewItem& /*option*/,
+        const QModelIndex& /*index*/
+    ) const
+{
+    int side = CROP_SIZE + 2 * TILE_MARGIN;
+    return QSize( side, side );
+}
+
+void CropDelegate::paint(
+        QPainter* painter,
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index
+    ) const
+{
+    const QRect& tile = option.rect;
+
+    painter->save();
+    painter->setClipRect( tile );
+
+    const CropGalleryModel* gallery_model = qobject_cast<const CropGalleryModel*>( index.model() );
+    QColor frame_color = gallery_model? gallery_model->color() : option.palette.color( QPalette::Mid );
+    painter->fillRect( tile, ( option.state & QStyle::State_Selected )? option.palette.highlight() : QBrush( frame_color ) );
+
+    QRect crop_rect = tile.adjusted( TILE_MARGIN, TILE_MARGIN, -TILE_MARGIN, -TILE_MARGIN );
+    painter->fillRect( crop_rect, option.palette.dark() );
+
+    QPixmap pix = index.data( Qt::DecorationRole ).value<QPixmap>();
+    if( !pix.isNull() ) {
+        painter->drawPixmap( crop_rect.center() - QPoint( pix.width() / 2, pix.height() / 2 ), pix );
+    }
+
+    painter->restore();
+}
+
+
+CropGallery::CropGallery(
+        QWidget* parent
+    ) : LazyListView( parent )
+{
+    gallery_model_ = new CropGalleryModel( this );
+    setModel( gallery_model_ );
+    setItemDelegate( new CropDelegate( this ) );
+    setSpacing( 1 );
+
+    connect( this, SIGNAL( activated(QModelIndex) ), this, SLOT( activate(QModelIndex) ) );
+}
+
+CropGallery::~CropGallery()
+{
+}
+
+void CropGallery::set_boxes(
+        const QString& label,
+        const QColor& color,
+        const QList<TagItem::Elements>& elts
+    )
+{
+    gallery_model_->set_boxes( label, color, elts );
+    scrollToTop();
+}
+
+void CropGallery::activate(
+        const QModelIndex& index
+    )
+{
+    if( !index.isValid() ) {
+        return;
+    }
+
+    emit box_activated(
+        index.data( CropGalleryModel::FullpathRole ).toString(),
+        gallery_model_->label(),
+        index.data( CropGalleryModel::BoxRole ).toRect()
+    );
+}
@@ -0,0 +1,169 @@
+#include <ui/display_adjustment_panel.h>
+
+#include <QSlider>
+#include <QComboBox>
+#include <QPushButton>
+#include <QFormLayout>
+#include <QLayout>
+
+namespace {
+    // sliders are integers: brightness and contrast in percents,
+    // gamma in hundredths
+    const int GAMMA_SCALE = 100;
+
+    // value of the channel selector editing the levels of all the channels
+    const int ALL_CHANNELS = -1;
+
+    QSlider* make_slider(
+            int min,
+            int max,
+            int value,
+            QWidget* parent
+        )
+    {
+        QSlider* slider = new QSlider( Qt::Horizontal, parent );
+        slider->setRange( min, max );
+        slider->setValue( value );
+        return slider;
+    }
+}
+
+
+DisplayAdjustmentPanel::DisplayAdjustmentPanel(
+        QWidget* parent
+    ) : QWidget( parent )
+{
+    brightness_ = make_slider( -100, 100, 0, this );
+    contrast_ = make_slider( -100, 100, 0, this );
+    gamma_ = make_slider( 10, 400, GAMMA_SCALE, this );
+    gamma_->setToolTip( "Greater values brighten the midtones" );
+
+    channel_ = new QComboBox( this );
+    channel_->addItem( "RGB", QVariant( ALL_CHANNELS ) );
+    channel_->addItem( "Red", QVariant( int( DisplayAdjustment::RED ) ) );
+    channel_->addItem( "Green", QVariant( int( DisplayAdjustment::GREEN ) ) );
+    channel_->addItem( "Blue", QVariant( int( DisplayAdjustment::BLUE ) ) );
+
+    black_ = make_slider( 0, 254, 0, this );
+    white_ = make_slider( 1, 255, 255, this );
+
+    QPushButton* auto_button = new QPushButton( "Auto", this );
+    auto_button->setToolTip( "Stretches the levels of each channel from the image histogram" );
+    QPushButton* reset_button = new QPushButton( "Reset", this );
+
+    QFormLayout* sliders_layout = new QFormLayout();
+    sliders_layout->addRow( "Brightness: ", brightness_ );
+    sliders_layout->addRow( "Contrast: ", contrast_ );
+    sliders_layout->addRow( "Gamma: ", gamma_ );
+    sliders_layout->addRow( "Levels: ", channel_ );
+    sliders_layout->addRow( "Black: ", black_ );
+    sliders_layout->addRow( "White: ", white_ );
+
+    QHBoxLayout* buttons_layout = new QHBoxLayout();
+    buttons_layout->addStretch();
+    buttons_layout->addWidget( auto_button );
+    buttons_layout->addWidget( reset_button );
+
+    QVBoxLayout* main_layout = new QVBoxLayout();
+    main_layout->setContentsMargins( 0, 0, 0, 0 );
+    main_layout->addLayout( sliders_layout );
+    main_layout->addLayout( buttons_layout );
+    setLayout( main_layout );
+
+    connect( brightness_, SIGNAL( valueChanged(int) ), this, SLOT( read_adjustment() ) );
+    connect( contrast_, SIGNAL( valueChanged(int) ), this, SLOT( read_adjustment() ) );
+    connect( gamma_, SIGNAL( valueChanged(int) ), this, SLOT( read_adjustment() ) );
+    connect( black_, SIGNAL( valueChanged(int) ), this, SLOT( read_adjustment() ) );
+    connect( white_, SIGNAL( valueChanged(int) ), this, SLOT( read_adjustment() ) );
+    connect( channel_, SIGNAL( currentIndexChanged(int) ), this, SLOT( show_levels() ) );
+    connect( auto_button, SIGNAL( clicked() ), this, SIGNAL( auto_stretch_requested() ) );
+    connect( reset_button, SIGNAL( clicked() ), this, SLOT( reset() ) );
+}
+
+DisplayAdjustmentPanel::~DisplayAdjustmentPanel()
+{
+}
+
+void DisplayAdjustmentPanel::set_adjustment(
+        const DisplayAdjustment& adjustment
+    )
+{
+    adjustment_ = adjustment;
+
+    brightness_->blockSignals( true );
+    contrast_->blockSignals( true );
+    gamma_->blockSignals( true );
+    brightness_->setValue( qRound( adjustment_._brightness * 100.f ) );
+    contrast_->setValue( qRound( adjustment_._contrast * 100.f ) );
+    gamma_->setValue( qRound( adjustment_._gamma * GAMMA_SCALE ) );
+    brightness_->blockSignals( false );
+    contrast_->blockSignals( false );
+    gamma_->blockSignals( false );
+
+    show_levels();
+}
+
+void DisplayAdjustmentPanel::read_adjustment()
+{
+    adjustment_._brightness = brightness_->value() / 100.f;
+    adjustment_._contrast = contrast_->value() / 100.f;
+    adjustment_._gamma = float( gamma_->value() ) / GAMMA_SCALE;
+
+    // white is kept above black
+    if( sender() == black_ && white_->value() <= black_->value() ) {
+        white_->setValue( black_->value() + 1 );
+        return;
+    }
+    if( sender() == white_ && black_->value() >= white_->value() ) {
+        black_->setValue( white_->value() - 1 );
+        return;
+    }
+
+    // other sliders leave the levels of each channel as they are
+    // (e.g. after an auto stretch)
+    if( sender() == black_ || sender() == white_ ) {
+        int first, last;
+        edited_channels( first, last );
+        for( int c = first; c < last; ++c ) {
+            adjustment_._black[c] = black_->value();
+            adjustment_._white[c] = white_->value();
+        }
+    }
+
+    emit adjustment_changed( adjustment_ );
+}
+
+void DisplayAdjustmentPanel::show_levels()
+{
+    // the levels of the first channel when editing all of them
+    int first, last;
+    edited_channels( first, last );
+
+    black_->blockSignals( true );
+    white_->blockSignals( true );
+    black_->setValue( adjustment_._black[first] );
+    white_->setValue( adjustment_._white[first] );
+    black_->blockSignals( false );
+    white_->blockSignals( false );
+}
+
+void DisplayAdjustmentPanel::reset()
+{
+    set_adjustment( DisplayAdjustment() );
+    emit adjustment_changed( adjustment_ );
+}
+
+void DisplayAdjustmentPanel::edited_channels(
+        int& first,
+        int& last
+    ) const
+{
+    int channel = channel_->currentData().toInt();
+    if( channel == ALL_CHANNELS ) {
+        first = 0;
+        last = DisplayAdjustment::CHANNEL_COUNT;
+    } else {
+        first = channel;
+        last = channel + 1;
+    }
+}
@@ -0,0 +1,174 @@
+#include <ui/lazy_list.h>
+
+#include <QTimer>
+#include <QScrollBar>
+
+#include <algorithm>
+
+namespace {
+    // delay before dropping the requests of the cells scrolled out of view (in ms)
+    const int VISIBLE_ROWS_DELAY = 100;
+}
+
+
+LazyListModel::LazyListModel(
+        int pixmap_cache_size,
+        QObject* parent
+    ) : QAbstractListModel( parent ), pixmaps_( pixmap_cache_size ), request_count_( 0 )
+{
+}
+
+LazyListModel::~LazyListModel()
+{
+}
+
+QVariant LazyListModel::decoration(
+        int row
+    ) const
+{
+    QString key = pixmap_key( row );
+    QPixmap* pix = pixmaps_.object( key );
+    if( pix ) {
+        return QVariant( *pix );
+    }
+
+    // the view only asks for the visible cells:
+    // requests are gathered and sent when control returns to the event loop
+    if( !pending_.contains( key ) ) {
+        pending_.insert( key, row );
+        if( requests_.isEmpty() ) {
+            QTimer::singleShot( 0, const_cast<LazyListModel*>( this ), SLOT( flush_requests() ) );
+        }
+        requests_.append( row );
+    }
+    return QVariant( QPixmap() );
+}
+
+void LazyListModel::add_pixmap(
+        const QString& key,
+        const QImage& image
+    )
+{
+    QHash<QString, int>::iterator pending_itr = pending_.find( key );
+    if( pending_itr == pending_.end() ) {
+        return;
+    }
+
+    int row = pending_itr.value();
+    pending_.erase( pending_itr );
+
+    // pixmaps are created here as it must be done in the interface thread
+    QPixmap* pix = new QPixmap( QPixmap::fromImage( image ) );
+    pixmaps_.insert( key, pix, qMax( 1, pix->width() * pix->height() * 4 / 1024 ) );
+
+    QModelIndex idx = index( row );
+    emit dataChanged( idx, idx );
+}
+
+void LazyListModel::drop_requests()
+{
+    cancel_loading();
+    pending_.clear();
+    requests_.clear();
+}
+
+void LazyListModel::set_visible_rows(
+        int first,
+        int last
+    )
+{
+    QHash<QString, int> visible;
+    for( QHash<QString, int>::const_iterator pending_itr = pending_.begin(); pending_itr != pending_.end(); ++pending_itr ) {
+        if( pending_itr.value() >= first && pending_itr.value() <= last ) {
+            visible.insert( pending_itr.key(), pending_itr.value() );
+        }
+    }
+
+    if( visible.count() == pending_.count() ) {
+        return;
+    }
+
+    // rows not sent yet were just shown
+    for( QList<int>::const_iterator row_itr = requests_.begin(); row_itr != requests_.end(); ++row_itr ) {
+        visible.insert( pixmap_key( *row_itr ), *row_itr );
+    }
+
+    // the queued loadings are dropped and the visible rows
+    // queued again in the row order
+    cancel_loading();
+    pending_ = visible;
+    requests_ = visible.values();
+    std::sort( requests_.begin(), requests_.end() );
+    flush_requests();
+}
+
+void LazyListModel::flush_requests()
+{
+    if( requests_.isEmpty() ) {
+        return;
+    }
+
+    // the cells shown last are served first
+    load_pixmaps( requests_, ++request_count_ );
+    requests_.clear();
+}
+
+
+LazyListView::LazyListView(
+        QWidget* parent
+    ) : QListView( parent )
+{
+    // uniform sizes let the view compute the visible cells
+    // without asking every item for its size
+    setViewMode( QListView::ListMode );
+    setFlow( QListView::LeftToRight );
+    setWrapping( true );
+    setUniformItemSizes( true );
+    setResizeMode( QListView::Adjust );
+    setMovement( QListView::Static );
+    setLayoutMode( QListView::Batched );
+    setBatchSize( 1000 );
+    setVerticalScrollMode( QAbstractItemView::ScrollPerPixel );
+
+    visible_rows_timer_ = new QTimer( this );
+    visible_rows_timer_->setSingleShot( true );
+    visible_rows_timer_->setInterval( VISIBLE_ROWS_DELAY );
+
+    connect( verticalScrollBar(), SIGNAL( valueChanged(int) ), visible_rows_timer_, SLOT( start() ) );
+    connect( visible_rows_timer_, SIGNAL( timeout() ), this, SLOT( update_visible_rows() ) );
+}
+
+LazyListView::~LazyListView()
+{
+}
+
+void LazyListView::update_visible_rows()
+{
+    LazyListModel* lazy_model = qobject_cast<LazyListModel*>( model() );
+    if( !lazy_model ) {
+        return;
+    }
+
+    // the corners are moved past the spacing between the cells
+    QRect area = viewport()->rect().adjusted( spacing(), spacing(), 0, -spacing() );
+    QModelIndex first = indexAt( area.topLeft() );
+    if( !first.isValid() ) {
+        first = indexAt( area.topLeft() + QPoint( 0, 2 * spacing() ) );
+    }
+    if( !first.isValid() ) {
+        return;
+    }
+
+    // the last visible cell ends the row of the bottom left one
+    int last_row = lazy_model->rowCount() - 1;
+    QModelIndex bottom_left = indexAt( area.bottomLeft() );
+    if( !bottom_left.isValid() ) {
+        bottom_left = indexAt( area.bottomLeft() - QPoint( 0, 2 * spacing() ) );
+    }
+    if( bottom_left.isValid() ) {
+        int cells_per_row = qMax( 1, viewport()->width() / qMax( 1, visualRect( first ).width() + spacing() ) );
+        last_row = qMin( last_row, bottom_left.row() + cells_per_row - 1 );
+    }
+
+    lazy_model->set_visible_rows( first.row(), last_row );
+}
@@ -3,6 +3,14 @@
 #include <ui/tag_scroll_view.h>
 #include <core/tag_model.h>
 #include <core/tag_io.h>
+#include <core/image_archive.h>
+#include <core/thumbnail_cache.h>
+#include <core/image_metadata.h>
+#include <core/image_loader.h>
+#include <core/tile_pyramid.h>
+#include <ui/thumbnail_grid.h>
+#include <ui/crop_gallery.h>
+#include <ui/display_adjustment_panel.h>
 
 #include <QLayout>
 #include <QWidget>
@@ -23,8 +31,84 @@
 #include <QMessageBox>
 #include <QCheckBox>
 #include <QTextBrowser>
+#include <QSpinBox>
+#include <QFormLayout>
+#include <QTabWidget>
+#include <QProgressDialog>
 
 
+namespace {
+
+// number of images decoded ahead on each side of the current one
+const int PREFETCH_NEIGHBORS = 2;
+
+// widgets for choosing the encoder options in export dialogs
+// rows are appended to the given form layout
+class CodecSelector
+{
+public:
+    CodecSelector(
+            QWidget* parent,
+            QFormLayout* layout
+        )
+    {
+        // formats are listed from the smallest to the fastest output
+        format_ = new QComboBox( parent );
+        format_->addItem( "Same as source image", QVariant( int( ImageCodec::SOURCE_FORMAT ) ) );
+        format_->addItem( "PNG", QVariant( int( ImageCodec::PNG ) ) );
+        format_->addItem( "JPEG", QVariant( int( ImageCodec::JPEG ) ) );
+        format_->addItem( "QOI (lossless, fast)", QVariant( int( ImageCodec::QOI ) ) );
+        format_->addItem( "PPM (uncompressed)", QVariant( int( ImageCodec::PPM ) ) );
+
+        // -1 lets the encoder use its default
+        png_compression_ = new QSpinBox( parent );
+        png_compression_->setRange( -1, 9 );
+        png_compression_->setSpecialValueText( "default" );
+        png_compression_->setValue( 1 );
+        png_compression_->setToolTip( "0 is the fastest, 9 is the smallest" );
+
+        jpeg_quality_ = new QSpinBox( parent );
+        jpeg_quality_->setRange( -1, 100 );
+        jpeg_quality_->setSpecialValueText( "default" );
+        jpeg_quality_->setValue( 90 );
+
+        jpeg_optimize_ = new QCheckBox( "Optimize JPEG encoding (smaller but slower)", parent );
+        jpeg_optimize_->setChecked( false );
+
+        layout->addRow( "Image format: ", format_ );
+        layout->addRow( "PNG compression level: ", png_compression_ );
+        layout->addRow( "JPEG quality: ", jpeg_quality_ );
+        layout->addRow( jpeg_optimize_ );
+    }
+
+    ImageCodec::Options options() const
+    {
+        ImageCodec::Options options;
+        options._format = ImageCodec::Format( format_->currentData().toInt() );
+        options._png_compression = png_compression_->value();
+        options._jpeg_quality = jpeg_quality_->value();
+        options._jpeg_optimize = jpeg_optimize_->isChecked();
+
+        return options;
+    }
+
+private:
+    QComboBox* format_;
+    QSpinBox* png_compression_;
+    QSpinBox* jpeg_quality_;
+    QCheckBox* jpeg_optimize_;
+};
+
+}
+
+MainWindow::ImageExportSettings::ImageExportSettings() :
+    _layout( TagIO::LABEL_FOLDERS ),
+    _shard_size( 0 ),
+    _tensor_side( 0 ),
+    _tensor_channels( 3 )
+{
+}
+
 MainWindow::MainWindow(
         QWidget *parent
     ) : QMainWindow( parent )
@@ -48,7 +132,7 @@ MainWindow::MainWindow(
     // set the tree view to follow a directory parser model
     dir_model_ = new QFileSystemModel( this );
     dir_model_->setRootPath( root_path );
-    dir_model_->setNameFilters( valid_image_format() );
+    dir_model_->setNameFilters( valid_image_format() + ImageArchive::name_filters() );
 
     // left-most widget in splitter is a directory parser
     dir_view_ = new QTreeView( splitter );
@@ -98,6 +182,9 @@ MainWindow::MainWindow(
     tag_tree_button_layout->addStretch();
 
     tag_model_ = new TagModel( this );
+    thumbnail_cache_ = new ThumbnailCache( this );
+    image_loader_ = new ImageLoader( 512 * 1024, this );
+    tile_pyramid_ = new TilePyramid( 256 * 1024, this );
     tag_view_ = new QTreeView( image_tag_widget );
     tag_view_->setEditTriggers( QAbstractItemView::NoEditTriggers );
     tag_view_->setSelectionMode( QAbstractItemView::ExtendedSelection );
@@ -117,7 +204,9 @@ MainWindow::MainWindow(
     // --------
     // widget #3
     // right-most widget in splitter is image viewer
-    QWidget* tag_viewer_widget = new QWidget( splitter );
+    // with the thumbnail grid and the crop gallery of the selected label in other tabs
+    viewer_tabs_ = new QTabWidget( splitter );
+    QWidget* tag_viewer_widget = new QWidget( viewer_tabs_ );
     label_selector_ = new QComboBox( tag_viewer_widget );
 
     tag_button_ = new QPushButton( QIcon( ":/pixmaps/tag.png" ), "", tag_viewer_widget );
@@ -143,9 +232,17 @@ MainWindow::MainWindow(
     tag_buttons_layout->addWidget( untag_button_ );
     tag_buttons_layout->setStretchFactor( label_selector_, 2 );
 
+    // display-only adjustment of dark (or washed out) images
+    QPushButton* display_button = new QPushButton( "Display", tag_viewer_widget );
+    display_button->setCheckable( true );
+    display_button->setToolTip( "Adjusts brightness, contrast, gamma and levels of the displayed image" );
+    tag_buttons_layout->addSpacing( 20 );
+    tag_buttons_layout->addWidget( display_button );
+
     tag_scroll_view_ = new TagScrollView( tag_viewer_widget );
     tag_viewer_ = new TagViewer( tag_scroll_view_ );
-    tag_scroll_view_->setWidget( tag_viewer_ );
+    tag_viewer_->set_tile_pyramid( tile_pyramid_ );
+    tag_scroll_view_->set_viewer( tag_viewer_ );
 
     QPushButton* zoom_in_button = new QPushButton( QIcon( ":/pixmaps/zoom_in.png" ), "", tag_viewer_widget );
     zoom_in_button->setFixedSize( 32, 32 );
@@ -174,17 +271,27 @@ MainWindow::MainWindow(
     viewer_layout->addWidget( tag_scroll_view_ );
     viewer_layout->addLayout( viewer_buttons_layout );
 
+    display_panel_ = new DisplayAdjustmentPanel( tag_viewer_widget );
+    display_panel_->setVisible( false );
+
     QVBoxLayout* tag_viewer_layout = new QVBoxLayout();
     tag_viewer_layout->addLayout( tag_buttons_layout );
+    tag_viewer_layout->addWidget( display_panel_ );
     tag_viewer_layout->addLayout( viewer_layout );
     tag_viewer_widget->setLayout( tag_viewer_layout );
 
+    thumbnail_grid_ = new ThumbnailGrid( tag_model_, viewer_tabs_ );
+    viewer_tabs_->addTab( tag_viewer_widget, "Image" );
+    crop_gallery_ = new CropGallery( viewer_tabs_ );
+    viewer_tabs_->addTab( thumbnail_grid_, "Grid" );
+    viewer_tabs_->addTab( crop_gallery_, "Boxes" );
+
     // --------
     // Main Widget
     // arrange widgets inside the splitter widget
     splitter->addWidget( dir_view_ );
     splitter->addWidget( image_tag_widget );
-    splitter->addWidget( tag_viewer_widget );
+    splitter->addWidget( viewer_tabs_ );
     splitter->setStretchFactor( 0, 1 );
     splitter->setStretchFactor( 1, 1 );
     splitter->setStretchFactor( 2, 3 );
@@ -202,6 +309,10 @@ MainWindow::MainWindow(
 
     QAction* open_xml_action = new QAction( tr( "&Open XML" ), this );
     QAction* open_and_merge_xml_action = new QAction( tr( "Open XML and Merge" ), this );
+    QAction* open_coco_action = new QAction( tr( "Open COCO JSON" ), this );
+    QAction* open_and_merge_coco_action = new QAction( tr( "Open COCO JSON and Merge" ), this );
+    QAction* open_annotation_dir_action = new QAction( tr( "Open VOC/YOLO Directory" ), this );
+    QAction* open_and_merge_annotation_dir_action = new QAction( tr( "Open VOC/YOLO Directory and Merge" ), this );
 
     QAction* save_xml_action = new QAction( tr( "&Save As XML" ), this );
     QAction* save_selection_xml_action = new QAction( tr( "Save Selection As XML" ), this );
@@ -209,6 +320,18 @@ MainWindow::MainWindow(
     QAction* save_images_action = new QAction( tr( "Save As Cropped Images" ), this );
     QAction* save_selection_images_action = new QAction( tr( "Save Selection As Cropped Images" ), this );
 
+    QAction* save_resized_action = new QAction( tr( "Save As Resized Images" ), this );
+    QAction* save_selection_resized_action = new QAction( tr( "Save Selection As Resized Images" ), this );
+
+    QAction* save_tiles_action = new QAction( tr( "Save As Image Tiles" ), this );
+    QAction* save_selection_tiles_action = new QAction( tr( "Save Selection As Image Tiles" ), this );
+
+    QAction* save_overlays_action = new QAction( tr( "Save As Annotated Images" ), this );
+    QAction* save_selection_overlays_action = new QAction( tr( "Save Selection As Annotated Images" ), this );
+
+    QAction* save_annotations_action = new QAction( tr( "Save As COCO/VOC/YOLO Annotations" ), this );
+    QAction* save_selection_annotations_action = new QAction( tr( "Save Selection As COCO/VOC/YOLO Annotations" ), this );
+
     QAction* quit_action = new QAction( tr( "&Quit" ), this );
 
     QAction* help_action = new QAction( QIcon( ":/pixmaps/help.png" ), tr( "&Help" ), this );
@@ -224,13 +347,26 @@ MainWindow::MainWindow(
     file_menu->addSection( QIcon( ":/pixmaps/open.png" ), "Open" );
     file_menu->addAction( open_xml_action );
     file_menu->addAction( open_and_merge_xml_action );
+    file_menu->addAction( open_coco_action );
+    file_menu->addAction( open_and_merge_coco_action );
+    file_menu->addAction( open_annotation_dir_action );
+    file_menu->addAction( open_and_merge_annotation_dir_action );
     file_menu->addSection( QIcon( ":/pixmaps/save.png" ), "Save" );
     file_menu->addAction( save_xml_action );
     file_menu->addAction( save_selection_xml_action );
+    file_menu->addAction( save_annotations_action );
+    file_menu->addAction( save_selection_annotations_action );
     file_menu->addSeparator();
     file_menu->addAction( save_images_action );
     file_menu->addAction( save_selection_images_action );
     file_menu->addSeparator();
+    file_menu->addAction( save_resized_action );
+    file_menu->addAction( save_selection_resized_action );
+    file_menu->addAction( save_tiles_action );
+    file_menu->addAction( save_selection_tiles_action );
+    file_menu->addAction( save_overlays_action );
+    file_menu->addAction( save_selection_overlays_action );
+    file_menu->addSeparator();
     file_menu->addAction( quit_action );
 
     help_menu->addAction( help_action );
@@ -254,11 +390,20 @@ MainWindow::MainWindow(
 
     connect( tag_view_, SIGNAL( customContextMenuRequested(QPoint) ), this, SLOT( show_context_menu(QPoint) ) );
     connect( tag_view_->selectionModel(), SIGNAL( selectionChanged(QItemSelection,QItemSelection) ), this, SLOT( update_viewer() ) );
+    connect( tag_view_->selectionModel(), SIGNAL( selectionChanged(QItemSelection,QItemSelection) ), this, SLOT( update_grid() ) );
+    connect( image_loader_, SIGNAL( image_ready(QString) ), this, SLOT( image_loaded(QString) ) );
+    connect( thumbnail_grid_, SIGNAL( image_activated(QString,QString) ), this, SLOT( show_image(QString,QString) ) );
+    connect( crop_gallery_, SIGNAL( box_activated(QString,QString,QRect) ), this, SLOT( show_box(QString,QString,QRect) ) );
     connect( label_selector_, SIGNAL( currentIndexChanged(int) ), this, SLOT( set_viewer_tag_options() ) );
     connect( tag_button_, SIGNAL( toggled(bool) ), this, SLOT( enable_tag(bool) ) );
     connect( untag_button_, SIGNAL( toggled(bool) ), this, SLOT( enable_untag(bool) ) );
+    connect( tag_viewer_, SIGNAL( resolution_needed() ), this, SLOT( load_full_resolution() ) );
     connect( tag_viewer_, SIGNAL( tagged(QRect) ), this, SLOT( tag_image(QRect) ) );
     connect( tag_viewer_, SIGNAL( untagged(QString,QRect) ), this, SLOT( untag_image(QString, QRect) ) );
+    connect( tag_viewer_, SIGNAL( box_edited(QString,QRect,QRect) ), this, SLOT( edit_tag(QString,QRect,QRect) ) );
+    connect( display_button, SIGNAL( toggled(bool) ), display_panel_, SLOT( setVisible(bool) ) );
+    connect( display_panel_, SIGNAL( adjustment_changed(DisplayAdjustment) ), tag_viewer_, SLOT( set_adjustment(DisplayAdjustment) ) );
+    connect( display_panel_, SIGNAL( auto_stretch_requested() ), this, SLOT( auto_stretch_display() ) );
 
     connect( zoom_in_button, SIGNAL( clicked() ), tag_scroll_view_, SLOT( zoom_in() ) );
     connect( zoom_out_button, SIGNAL( clicked() ), tag_scroll_view_, SLOT( zoom_out() ) );
@@ -266,10 +411,22 @@ MainWindow::MainWindow(
 
     connect( open_xml_action, SIGNAL( triggered() ), this, SLOT( open_xml() ) );
     connect( open_and_merge_xml_action, SIGNAL( triggered() ), this, SLOT( open_xml_and_merge() ) );
+    connect( open_coco_action, SIGNAL( triggered() ), this, SLOT( open_coco() ) );
+    connect( open_and_merge_coco_action, SIGNAL( triggered() ), this, SLOT( open_coco_and_merge() ) );
+    connect( open_annotation_dir_action, SIGNAL( triggered() ), this, SLOT( open_annotation_dir() ) );
+    connect( open_and_merge_annotation_dir_action, SIGNAL( triggered() ), this, SLOT( open_annotation_dir_and_merge() ) );
     connect( save_xml_action, SIGNAL( triggered() ), this, SLOT( save_as_xml() ) );
     connect( save_selection_xml_action, SIGNAL( triggered() ), this, SLOT( save_selection_as_xml() ) );
+    connect( save_annotations_action, SIGNAL( triggered() ), this, SLOT( save_as_annotations() ) );
+    connect( save_selection_annotations_action, SIGNAL( triggered() ), this, SLOT( save_selection_as_annotations() ) );
     connect( save_images_action, SIGNAL( triggered() ), this, SLOT( save_as_images() ) );
     connect( save_selection_images_action, SIGNAL( triggered() ), this, SLOT( save_selection_as_images() ) );
+    connect( save_resized_action, SIGNAL( triggered() ), this, SLOT( save_as_resized_images() ) );
+    connect( save_selection_resized_action, SIGNAL( triggered() ), this, SLOT( save_selection_as_resized_images() ) );
+    connect( save_tiles_action, SIGNAL( triggered() ), this, SLOT( save_as_tiles() ) );
+    connect( save_selection_tiles_action, SIGNAL( triggered() ), this, SLOT( save_selection_as_tiles() ) );
+    connect( save_overlays_action, SIGNAL( triggered() ), this, SLOT( save_as_overlays() ) );
+    connect( save_selection_overlays_action, SIGNAL( triggered() ), this, SLOT( save_selection_as_overlays() ) );
     connect( quit_action, SIGNAL( triggered() ), this, SLOT( close() ) );
     connect( help_action, SIGNAL( triggered() ), this, SLOT( show_help() ) );
     connect( credits_action, SIGNAL( triggered() ), this, SLOT( show_credits() ) );
@@ -310,16 +467,29 @@ void MainWindow::import_images()
 
         QFileInfo img_info = dir_model_->fileInfo( *s_itr );
 
-        // check if selection is a directory or a file
+        // check if selection is a directory, an archive or a file
         if( img_info.isDir() ) {
             // if a directory, add all the image files from it
             img_to_import.append( QDir( img_info.absoluteFilePath() ).entryInfoList( valid_image_format(), QDir::Files ) );
+        } else if( ImageArchive::is_archive( img_info.fileName() ) ) {
+            // if an archive, add all the image members without extracting them
+            QStringList members = ImageArchive::list_members( img_info.absoluteFilePath(), valid_image_format() );
+            for( QStringList::const_iterator member_itr = members.begin(); member_itr != members.end(); ++member_itr ) {
+                img_to_import.append( QFileInfo( *member_itr ) );
+            }
         } else {
             img_to_import.append( img_info );
         }
     }
 
     tag_model_->import_images( img_to_import );
+
+    // thumbnails are ready by the time they are browsed
+    QStringList paths;
+    for( QFileInfoList::const_iterator img_itr = img_to_import.begin(); img_itr != img_to_import.end(); ++img_itr ) {
+        paths.append( img_itr->absoluteFilePath() );
+    }
+    thumbnail_cache_->prefetch( paths, ThumbnailCache::NORMAL_SIZE );
 }
 
 void MainWindow::add_label()
@@ -436,7 +606,9 @@ void MainWindow::change_selected_label_name()
 void MainWindow::pop_up_file_dialog(
         QString& filename,
         QString& relative_dir,
-        QFileDialog::AcceptMode mode
+        QFileDialog::AcceptMode mode,
+        const QString& file_type,
+        const QString& suffix
     )
 {
     QDialog file_dialog( this );
@@ -453,8 +625,8 @@ void MainWindow::pop_up_file_dialog(
 
     xml_dialog->setFilter( QDir::Files );
     xml_dialog->setAcceptMode( mode );
-    xml_dialog->selectNameFilter( "XML Files (*.xml)" );
-    xml_dialog->setWindowTitle( "Select XML file" );
+    xml_dialog->selectNameFilter( file_type + " Files (*." + suffix + ")" );
+    xml_dialog->setWindowTitle( "Select " + file_type + " file" );
     xml_dialog->setDirectory( QDir::current() );
 
     dir_dialog->setOptions( QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks );
@@ -469,7 +641,7 @@ void MainWindow::pop_up_file_dialog(
     dir_info_label->setEnabled( false );
 
     QHBoxLayout* file_layout = new QHBoxLayout();
-    file_layout->addWidget( new QLabel( "Choose XML file: ", &file_dialog ) );
+    file_layout->addWidget( new QLabel( "Choose " + file_type + " file: ", &file_dialog ) );
     file_layout->addWidget( file_label );
     file_layout->addWidget( popup_file );
     file_layout->setStretchFactor( file_label, 2 );
@@ -546,6 +718,42 @@ void MainWindow::open_xml()
     load_xml( filename, relative_dir, false );
 }
 
+void MainWindow::open_coco()
+{
+    QString filename;
+    QString relative_dir;
+    pop_up_file_dialog( filename, relative_dir, QFileDialog::AcceptOpen, "JSON", "json" );
+    if( filename.isEmpty() ) {
+        return;
+    }
+
+    bool ok = false;
+    double min_score = QInputDialog::getDouble( this, "Open COCO JSON", "Minimum prediction score", 0.5, 0., 1., 2, &ok );
+    if( !ok ) {
+        return;
+    }
+
+    load_coco( filename, relative_dir, min_score, false );
+}
+
+void MainWindow::open_coco_and_merge()
+{
+    QString filename;
+    QString relative_dir;
+    pop_up_file_dialog( filename, relative_dir, QFileDialog::AcceptOpen, "JSON", "json" );
+    if( filename.isEmpty() ) {
+        return;
+    }
+
+    bool ok = false;
+    double min_score = QInputDialog::getDouble( this, "Open COCO JSON", "Minimum prediction score", 0.5, 0., 1., 2, &ok );
+    if( !ok ) {
+        return;
+    }
+
+    load_coco( filename, relative_dir, min_score, true );
+}
+
 void MainWindow::save_as_xml()
 {
     QString filename;
@@ -594,7 +802,87 @@ void MainWindow::load_xml(
         QMessageBox::critical( this, "Error", "Failed to recognize file format/elements" );
 
     } else {
+        // images are validated against the sidecar in parallel
+        // so that the model does not check them one by one
+        QString sidecar = ImageMetadata::sidecar_path( filename );
+        ImageMetadata::load( sidecar );
+        int changed = 0;
+        QProgressDialog progress( "Check image files", "Cancel", 0, elts.count(), this );
+        progress.setWindowModality( Qt::WindowModal );
+        ImageMetadata::refresh( elts.keys(), &changed, &progress );
+        if( changed > 0 ) {
+            ImageMetadata::save( sidecar, elts.keys() );
+        }
+
         tag_model_->init_from_elements( elts, merge );
+        thumbnail_cache_->prefetch( elts.keys(), ThumbnailCache::NORMAL_SIZE );
+        update_tag_selector();
+        update_viewer();
+    }
+
+    file.close();
+}
+
+void MainWindow::open_annotation_dir()
+{
+    load_annotation_dir( false );
+}
+
+void MainWindow::open_annotation_dir_and_merge()
+{
+    load_annotation_dir( true );
+}
+
+void MainWindow::load_annotation_dir(
+        bool merge
+    )
+{
+    QString dirname = QFileDialog::getExistingDirectory( this, "Select directory of annotation files", QDir::currentPath() );
+    if( dirname.isEmpty() ) {
+        return;
+    }
+
+    QStringList formats;
+    formats << "Pascal VOC (one XML file per image)" << "YOLO (one text file per image)";
+
+    bool ok = false;
+    QString format = QInputDialog::getItem( this, "Open Annotation Directory", "Annotation format", formats, 0, false, &ok );
+    if( !ok ) {
+        return;
+    }
+
+    QHash< QString, QList<TagItem::Elements> > elts;
+    if( !TagIO::read_annotation_dir( QDir( dirname ), format == formats.first()? TagIO::PASCAL_VOC : TagIO::YOLO_TXT, elts ) ) {
+        QMessageBox::critical( this, "Error", "Failed to read annotation files" );
+        return;
+    }
+
+    tag_model_->init_from_elements( elts, merge );
+    thumbnail_cache_->prefetch( elts.keys(), ThumbnailCache::NORMAL_SIZE );
+    update_tag_selector();
+    update_viewer();
+}
+
+void MainWindow::load_coco(
+        const QString& filename,
+        const QString& relative_dir,
+        double min_score,
+        bool merge
+    )
+{
+    QFile file( filename );
+    if( !file.open( QFile::ReadOnly ) ) {
+        QMessageBox::critical( this, "Error", "Failed to read file " + file.errorString() );
+        return;
+    }
+
+    QHash< QString, QList<TagItem::Elements> > elts;
+    if( !TagIO::read_coco( &file, relative_dir, min_score, elts ) ) {
+        QMessageBox::critical( this, "Error", "Failed to recognize file format/elements" );
+
+    } else {
+        tag_model_->init_from_elements( elts, merge );
+        thumbnail_cache_->prefetch( elts.keys(), ThumbnailCache::NORMAL_SIZE );
         update_tag_selector();
         update_viewer();
     }
@@ -614,35 +902,413 @@ void MainWindow::save_xml(
         return;
     }
 
-    TagIO::write_xml( &file, relative_dir, tag_model_->get_all_tags(), tag_model_->get_all_elements( selection ) );
+    QHash< QString, QList<TagItem::Elements> > elts = tag_model_->get_all_elements( selection );
+    TagIO::write_xml( &file, relative_dir, tag_model_->get_all_tags(), elts );
     file.close();
+
+    // images not known yet are probed so that reopening needs no decoding
+    QStringList paths = elts.keys();
+    QProgressDialog progress( "Check image files", "Cancel", 0, paths.count(), this );
+    progress.setWindowModality( Qt::WindowModal );
+    ImageMetadata::refresh( paths, 0, &progress );
+    ImageMetadata::save( ImageMetadata::sidecar_path( filename ), paths );
+}
+
+void MainWindow::save_as_annotations()
+{
+    save_annotations( QModelIndexList() );
+}
+
+void MainWindow::save_selection_as_annotations()
+{
+    QItemSelectionModel* selection_model = tag_view_->selectionModel();
+    if( !selection_model ) {
+        QMessageBox::critical( this, "Error", "No valid selection" );
+        return;
+    }
+
+    save_annotations( selection_model->selectedRows() );
+}
+
+void MainWindow::save_annotations(
+        const QModelIndexList& selection
+    )
+{
+    QDialog export_dialog( this );
+    export_dialog.setWindowTitle( "Save As Annotations" );
+
+    QComboBox* format_selector = new QComboBox( &export_dialog );
+    format_selector->addItem( "COCO JSON (annotations.json)", QVariant( int( TagIO::COCO_JSON ) ) );
+    format_selector->addItem( "Pascal VOC (one XML file per image)", QVariant( int( TagIO::PASCAL_VOC ) ) );
+    format_selector->addItem( "YOLO (one text file per image)", QVariant( int( TagIO::YOLO_TXT ) ) );
+
+    QFormLayout* options_layout = new QFormLayout();
+    options_layout->addRow( "Format: ", format_selector );
+
+    QString dirname = pop_up_export_dialog( export_dialog, options_layout );
+    if( dirname.isEmpty() ) {
+        return;
+    }
+
+    QDir dir( dirname );
+    TagIO::ExportStats stats;
+    TagIO::AnnotationFormat format = TagIO::AnnotationFormat( format_selector->currentData().toInt() );
+    if( format == TagIO::PASCAL_VOC ) {
+        TagIO::write_voc( dir, *tag_model_, selection, &stats );
+
+    } else if( format == TagIO::YOLO_TXT ) {
+        TagIO::write_yolo( dir, *tag_model_, selection, &stats );
+
+    } else {
+        QFile file( dir.absoluteFilePath( "annotations.json" ) );
+        if( !file.open( QFile::WriteOnly ) ) {
+            QMessageBox::critical( this, "Error", "Failed to write file " + file.errorString() );
+            return;
+        }
+
+        TagIO::write_coco( &file, dir.absolutePath(), *tag_model_, selection, &stats );
+        file.close();
+    }
+
+    show_export_stats( stats, "annotation files" );
 }
 
 void MainWindow::save_as_images()
 {
-    QString dir = QFileDialog::getExistingDirectory( this, "Select directory where to save images", QDir::currentPath() );
+    save_images( QModelIndexList() );
+}
+
+void MainWindow::save_selection_as_images()
+{
+    QItemSelectionModel* selection_model = tag_view_->selectionModel();
+    if( !selection_model ) {
+        QMessageBox::critical( this, "Error", "No valid selection" );
+        return;
+    }
+
+    save_images( selection_model->selectedRows() );
+}
+
+void MainWindow::save_images(
+        const QModelIndexList& selection
+    )
+{
+    ImageExportSettings settings;
+    pop_up_image_export_dialog( settings );
+    if( settings._dirname.isEmpty() ) {
+        return;
+    }
+
+    QDir dir( settings._dirname );
+    TagIO::ExportStats stats;
+    if( settings._layout == TagIO::TAR_SHARDS ) {
+        TagIO::write_shards( dir, tag_model_->get_all_elements( selection ), settings._shard_size, settings._codec, &stats );
+    } else if( settings._layout == TagIO::NPY_TENSOR ) {
+        TagIO::write_tensor( dir, tag_model_->get_all_elements( selection ), settings._tensor_side, settings._tensor_channels, &stats );
+    } else {
+        TagIO::write_images( dir, tag_model_->get_all_elements( selection ), settings._codec, &stats );
+    }
+
+    show_export_stats( stats, "crops" );
+}
+
+void MainWindow::pop_up_image_export_dialog(
+        ImageExportSettings& settings
+    )
+{
+    QDialog export_dialog( this );
+    export_dialog.setWindowTitle( "Save As Cropped Images" );
+
+    QComboBox* layout_selector = new QComboBox( &export_dialog );
+    layout_selector->addItem( "One file per crop in label folders", QVariant( int( TagIO::LABEL_FOLDERS ) ) );
+    layout_selector->addItem( "Tar shards (webdataset) with index", QVariant( int( TagIO::TAR_SHARDS ) ) );
+    layout_selector->addItem( "NumPy arrays of fixed size crops", QVariant( int( TagIO::NPY_TENSOR ) ) );
+
+    QSpinBox* shard_size_mb = new QSpinBox( &export_dialog );
+    shard_size_mb->setRange( 1, 65536 );
+    shard_size_mb->setValue( 1024 );
+    shard_size_mb->setSuffix( " MB" );
+
+    QSpinBox* tensor_side = new QSpinBox( &export_dialog );
+    tensor_side->setRange( 8, 1024 );
+    tensor_side->setValue( 224 );
+    tensor_side->setSuffix( " px" );
+
+    QComboBox* tensor_channels = new QComboBox( &export_dialog );
+    tensor_channels->addItem( "RGB", QVariant( 3 ) );
+    tensor_channels->addItem( "Grayscale", QVariant( 1 ) );
+
+    QFormLayout* options_layout = new QFormLayout();
+    options_layout->addRow( "Output layout: ", layout_selector );
+    options_layout->addRow( "Shard size: ", shard_size_mb );
+    options_layout->addRow( "NumPy crop size: ", tensor_side );
+    options_layout->addRow( "NumPy channels: ", tensor_channels );
+    CodecSelector codec_selector( &export_dialog, options_layout );
+
+    QString selected_dir = pop_up_export_dialog( export_dialog, options_layout );
+    if( selected_dir.isEmpty() ) {
+        return;
+    }
+
+    settings._layout = TagIO::CropLayout( layout_selector->currentData().toInt() );
+    settings._shard_size = qint64( shard_size_mb->value() ) * 1024 * 1024;
+    settings._tensor_side = tensor_side->value();
+    settings._tensor_channels = tensor_channels->currentData().toInt();
+    settings._codec = codec_selector.options();
+    settings._dirname = selected_dir;
+}
+
+QString MainWindow::pop_up_export_dialog(
+        QDialog& export_dialog,
+        QLayout* options_layout
+    )
+{
+    QLabel* dir_label = new QLabel( &export_dialog );
+    QPushButton* popup_dir = new QPushButton( QIcon( ":/pixmaps/open.png" ), QString(), &export_dialog );
+
+    QFileDialog* dir_dialog = new QFileDialog( &export_dialog );
+    dir_dialog->setOptions( QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks );
+    dir_dialog->setFileMode( QFileDialog::DirectoryOnly );
+    dir_dialog->setWindowTitle( "Select directory where to save images" );
+    dir_dialog->setDirectory( QDir::current() );
+
+    QHBoxLayout* dir_layout = new QHBoxLayout();
+    dir_layout->addWidget( new QLabel( "Choose directory: ", &export_dialog ) );
+    dir_layout->addWidget( dir_label );
+    dir_layout->addWidget( popup_dir );
+    dir_layout->setStretchFactor( dir_label, 2 );
+
+    QPushButton* ok_button = new QPushButton( "OK", &export_dialog );
+    QPushButton* cancel_button = new QPushButton( "Cancel", &export_dialog );
+
+    QHBoxLayout* button_layout = new QHBoxLayout();
+    button_layout->addStretch();
+    button_layout->addWidget( ok_button );
+    button_layout->addWidget( cancel_button );
+
+    QVBoxLayout* main_layout = new QVBoxLayout();
+    main_layout->addLayout( dir_layout );
+    if( options_layout ) {
+        main_layout->addLayout( options_layout );
+    }
+    main_layout->addStretch();
+    main_layout->addLayout( button_layout );
+
+    export_dialog.setLayout( main_layout );
+
+    connect( popup_dir, SIGNAL( clicked() ), dir_dialog, SLOT( exec() ) );
+    connect( dir_dialog, SIGNAL( fileSelected(QString) ), dir_label, SLOT( setText(QString) ) );
+    connect( ok_button, SIGNAL( clicked() ), &export_dialog, SLOT( accept() ) );
+    connect( cancel_button, SIGNAL( clicked() ), &export_dialog, SLOT( reject() ) );
+
+    export_dialog.exec();
+
+    if( export_dialog.result() == QDialog::Rejected ) {
+        return QString();
+    }
+
+    return dir_label->text();
+}
+
+void MainWindow::save_as_resized_images()
+{
+    save_resized_images( QModelIndexList() );
+}
+
+void MainWindow::save_selection_as_resized_images()
+{
+    QItemSelectionModel* selection_model = tag_view_->selectionModel();
+    if( !selection_model ) {
+        QMessageBox::critical( this, "Error", "No valid selection" );
+        return;
+    }
+
+    save_resized_images( selection_model->selectedRows() );
+}
+
+void MainWindow::save_resized_images(
+        const QModelIndexList& selection
+    )
+{
+    QDialog export_dialog( this );
+    export_dialog.setWindowTitle( "Save As Resized Images" );
+
+    QSpinBox* longest_side = new QSpinBox( &export_dialog );
+    longest_side->setRange( 16, 65536 );
+    longest_side->setValue( 1024 );
+    longest_side->setSuffix( " px" );
+
+    QFormLayout* options_layout = new QFormLayout();
+    options_layout->addRow( "Longest side: ", longest_side );
+    CodecSelector codec_selector( &export_dialog, options_layout );
+
+    QString dir = pop_up_export_dialog( export_dialog, options_layout );
     if( dir.isEmpty() ) {
         return;
     }
 
-    TagIO::write_images( QDir( dir ), tag_model_->get_all_elements( QModelIndexList() ) );
+    TagIO::ExportStats stats;
+    TagIO::write_resized(
+        QDir( dir ),
+        tag_model_->get_all_tags(),
+        tag_model_->get_all_elements( selection ),
+        longest_side->value(),
+        codec_selector.options(),
+        &stats
+    );
+
+    show_export_stats( stats, "images" );
 }
 
-void MainWindow::save_selection_as_images()
+void MainWindow::save_as_tiles()
+{
+    save_tiles( QModelIndexList() );
+}
+
+void MainWindow::save_selection_as_tiles()
 {
     QItemSelectionModel* selection_model = tag_view_->selectionModel();
     if( !selection_model ) {
         QMessageBox::critical( this, "Error", "No valid selection" );
         return;
     }
-    QModelIndexList selection = selection_model->selectedRows();
 
-    QString dir = QFileDialog::getExistingDirectory( this, "Select directory where to save images", QDir::currentPath() );
+    save_tiles( selection_model->selectedRows() );
+}
+
+void MainWindow::save_tiles(
+        const QModelIndexList& selection
+    )
+{
+    QDialog export_dialog( this );
+    export_dialog.setWindowTitle( "Save As Image Tiles" );
+
+    QSpinBox* tile_size = new QSpinBox( &export_dialog );
+    tile_size->setRange( 16, 65536 );
+    tile_size->setValue( 1024 );
+    tile_size->setSuffix( " px" );
+
+    QSpinBox* overlap = new QSpinBox( &export_dialog );
+    overlap->setRange( 0, 65535 );
+    overlap->setValue( 128 );
+    overlap->setSuffix( " px" );
+
+    QSpinBox* min_visible = new QSpinBox( &export_dialog );
+    min_visible->setRange( 1, 100 );
+    min_visible->setValue( 50 );
+    min_visible->setSuffix( " %" );
+    min_visible->setToolTip( "Boxes cut by a tile are kept if at least this part of their area is visible" );
+
+    QCheckBox* keep_empty = new QCheckBox( "Save tiles without tag", &export_dialog );
+    keep_empty->setChecked( false );
+
+    QFormLayout* options_layout = new QFormLayout();
+    options_layout->addRow( "Tile size: ", tile_size );
+    options_layout->addRow( "Tile overlap: ", overlap );
+    options_layout->addRow( "Minimum visible box area: ", min_visible );
+    options_layout->addRow( keep_empty );
+    CodecSelector codec_selector( &export_dialog, options_layout );
+
+    QString dir = pop_up_export_dialog( export_dialog, options_layout );
     if( dir.isEmpty() ) {
         return;
     }
 
-    TagIO::write_images( QDir( dir ), tag_model_->get_all_elements( selection ) );
+    if( overlap->value() >= tile_size->value() ) {
+        QMessageBox::critical( this, "Error", "Tile overlap must be smaller than the tile size" );
+        return;
+    }
+
+    TagIO::ExportStats stats;
+    TagIO::write_tiles(
+        QDir( dir ),
+        tag_model_->get_all_tags(),
+        tag_model_->get_all_elements( selection ),
+        tile_size->value(),
+        overlap->value(),
+        min_visible->value() / 100.,
+        keep_empty->isChecked(),
+        codec_selector.options(),
+        &stats
+    );
+
+    show_export_stats( stats, "tiles" );
+}
+
+void MainWindow::save_as_overlays()
+{
+    save_overlays( QModelIndexList() );
+}
+
+void MainWindow::save_selection_as_overlays()
+{
+    QItemSelectionModel* selection_model = tag_view_->selectionModel();
+    if( !selection_model ) {
+        QMessageBox::critical( this, "Error", "No valid selection" );
+        return;
+    }
+
+    save_overlays( selection_model->selectedRows() );
+}
+
+void MainWindow::save_overlays(
+        const QModelIndexList& selection
+    )
+{
+    QDialog export_dialog( this );
+    export_dialog.setWindowTitle( "Save As Annotated Images" );
+
+    QSpinBox* scale = new QSpinBox( &export_dialog );
+    scale->setRange( 1, 100 );
+    scale->setValue( 50 );
+    scale->setSuffix( " %" );
+    scale->setToolTip( "Size of the rendered images relative to the source images" );
+
+    QSpinBox* jpeg_quality = new QSpinBox( &export_dialog );
+    jpeg_quality->setRange( 0, 100 );
+    jpeg_quality->setValue( 80 );
+
+    QFormLayout* options_layout = new QFormLayout();
+    options_layout->addRow( "Image scale: ", scale );
+    options_layout->addRow( "JPEG quality: ", jpeg_quality );
+
+    QString dir = pop_up_export_dialog( export_dialog, options_layout );
+    if( dir.isEmpty() ) {
+        return;
+    }
+
+    TagIO::ExportStats stats;
+    TagIO::write_overlays(
+        QDir( dir ),
+        tag_model_->get_all_tags(),
+        tag_model_->get_all_elements( selection ),
+        scale->value() / 100.,
+        jpeg_quality->value(),
+        &stats
+    );
+
+    show_export_stats( stats, "images" );
+}
+
+void MainWindow::show_export_stats(
+        const TagIO::ExportStats& stats,
+        const QString& unit
+    )
+{
+    double seconds = qMax( stats._elapsed, qint64( 1 ) ) / 1000.;
+    double megabytes = stats._bytes / ( 1024. * 1024. );
+    QMessageBox::information(
+        this,
+        "Export done",
+        QString( "%1 %2 from %3 images saved (%4 MB) in %5 s\n%6 %2/s, %7 MB/s" )
+            .arg( stats._files )
+            .arg( unit )
+            .arg( stats._images )
+            .arg( megabytes, 0, 'f', 1 )
+            .arg( seconds, 0, 'f', 2 )
+            .arg( stats._files / seconds, 0, 'f', 1 )
+            .arg( megabytes / seconds, 0, 'f', 1 )
+    );
 }
 
 void MainWindow::show_help()
@@ -682,11 +1348,125 @@ void MainWindow::pop_up_html_dialog(
     html_dialog.exec();
 }
 
-void MainWindow::update_viewer()
+void MainWindow::update_grid()
 {
-    QPixmap pix;
-    QList<TagViewer::TagDisplayElement> display_elements;
+    QItemSelectionModel* selection_model = tag_view_->selectionModel();
+    if( !selection_model ) {
+        return;
+    }
+
+    // the grid follows the selected label
+    // and is left as is when images are selected
+    QModelIndexList selection = selection_model->selectedRows();
+    if( selection.count() != 1 || selection.first().parent().isValid() ) {
+        return;
+    }
+
+    const QModelIndex& label_index = selection.first();
+    QString label = tag_model_->get_label( label_index );
+    thumbnail_grid_->set_images( label, tag_model_->get_image_paths( label_index ) );
+    crop_gallery_->set_boxes( label, tag_model_->get_color( label_index ), tag_model_->get_label_elements( label_index ) );
+}
+
+void MainWindow::show_image(
+        const QString& fullpath,
+        const QString& label
+    )
+{
+    QModelIndex index = tag_model_->get_index( fullpath, label );
+    if( !index.isValid() ) {
+        return;
+    }
+
+    tag_view_->selectionModel()->select( index, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows );
+    tag_view_->scrollTo( index );
+    viewer_tabs_->setCurrentIndex( 0 );
+}
+
+void MainWindow::show_box(
+        const QString& fullpath,
+        const QString& label,
+        const QRect& bbox
+    )
+{
+    // the box is highlighted once the image is displayed
+    // (it may still be decoding)
+    highlighted_fullpath_ = fullpath;
+    highlighted_box_ = bbox;
+
+    show_image( fullpath, label );
+    if( current_fullpath_ == fullpath ) {
+        show_highlighted_box();
+    }
+}
 
+void MainWindow::show_highlighted_box()
+{
+    if( highlighted_fullpath_.isEmpty() || highlighted_fullpath_ != current_fullpath_ ) {
+        return;
+    }
+
+    tag_viewer_->set_highlighted_box( highlighted_box_ );
+    tag_scroll_view_->ensure_visible( highlighted_box_ );
+
+    highlighted_fullpath_.clear();
+}
+
+void MainWindow::image_loaded(
+        const QString& fullpath
+    )
+{
+    // full resolution of the displayed image (after zooming in)
+    if( fullpath == current_fullpath_ && fullpath == requested_fullpath_ ) {
+        QImage image;
+        QSize image_size;
+        if( image_loader_->cached( fullpath, image, image_size ) ) {
+            tag_viewer_->set_image( QPixmap::fromImage( image ), image_size );
+        }
+
+    } else if( fullpath == requested_fullpath_ ) {
+        update_viewer();
+    }
+}
+
+void MainWindow::load_full_resolution()
+{
+    image_loader_->load_full_resolution( current_fullpath_ );
+}
+
+QStringList MainWindow::get_neighbor_images(
+        const QModelIndexList& selection
+    ) const
+{
+    QStringList neighbors;
+
+    // neighbors are the siblings of the first selected image item
+    QModelIndexList::const_iterator idx_itr = selection.begin();
+    while( idx_itr != selection.end() && tag_model_->get_fullpath( *idx_itr ).isEmpty() ) {
+        ++idx_itr;
+    }
+    if( idx_itr == selection.end() ) {
+        return neighbors;
+    }
+
+    // closest images first
+    const QModelIndex& index = *idx_itr;
+    for( int offset = 1; offset <= PREFETCH_NEIGHBORS; ++offset ) {
+        QString next = tag_model_->get_fullpath( index.sibling( index.row() + offset, index.column() ) );
+        if( !next.isEmpty() ) {
+            neighbors.append( next );
+        }
+        QString previous = tag_model_->get_fullpath( index.sibling( index.row() - offset, index.column() ) );
+        if( !previous.isEmpty() ) {
+            neighbors.append( previous );
+        }
+    }
+
+    return neighbors;
+}
+
+void MainWindow::update_viewer()
+{
     QItemSelectionModel* selection_model = tag_view_->selectionModel();
     if( !selection_model ) {
         return;
@@ -701,47 +1481,92 @@ void MainWindow::update_viewer()
 
     // ensure and get the single image referenced in the selection
     QString fullpath_ref = get_image_from_index_list( selection );
-    if( !fullpath_ref.isEmpty() ) {
-
-        QList<TagItem::Elements> item_elts = tag_model_->get_elements( selection );
+    requested_fullpath_ = fullpath_ref;
 
-        for( QList<TagItem::Elements>::iterator elt_itr = item_elts.begin(); elt_itr != item_elts.end(); ++elt_itr ) {
-            const TagItem::Elements& tag_elt = *elt_itr;
-
-            QString cur_fullpath = tag_elt._fullpath;
-            TagViewer::TagDisplayElement tag;
-
-            // if fullpath is empty, we are dealing with a label name
-            // therefore we need to find the item within that label
-            if( cur_fullpath.isEmpty() ) {
-                TagItem::Elements elt_from_label = tag_model_->get_element( fullpath_ref, tag_elt._label );
-                tag._color = elt_from_label._color;
-                tag._label = elt_from_label._label;
-                tag._bbox = elt_from_label._bbox;
-
-            } else {
-                tag._color = tag_elt._color;
-                tag._label = tag_elt._label;
-                tag._bbox = tag_elt._bbox;
-            }
+    // same image (e.g. after tagging or untagging):
+    // only the boxes that changed are repainted
+    if( !fullpath_ref.isEmpty() && fullpath_ref == current_fullpath_ ) {
+        tag_viewer_->set_overlay_elements( get_display_elements( selection, fullpath_ref ) );
+        return;
+    }
 
-            display_elements.append( tag );
+    // images are decoded in the background along with the neighbors
+    // at the resolution they are displayed at when fit to view:
+    // the previous image stays displayed until the selected one is ready
+    QImage image;
+    QSize image_size;
+    if( !fullpath_ref.isEmpty() ) {
+        bool is_cached = image_loader_->cached( fullpath_ref, image, image_size );
+        image_loader_->load( fullpath_ref, get_neighbor_images( selection ), tag_scroll_view_->viewport()->size() );
+
+        viewer_tabs_->setTabToolTip(
+            0,
+            QString( "Decoded image cache: %1 hits, %2 misses, %3 MB" )
+                .arg( image_loader_->hit_count() ).arg( image_loader_->miss_count() ).arg( image_loader_->cost() / 1024 )
+        );
+        if( !is_cached ) {
+            return;
         }
     }
 
     // ok to send a null pixmap
     // the viewer will recognize that
     // and display a message instead
-    pix.load( fullpath_ref );
-    tag_viewer_->set_image( pix );
-    tag_viewer_->set_overlay_elements( display_elements );
-    tag_viewer_->update();
+    // large images are displayed through tiles when zooming in
+    if( TilePyramid::needs_tiles( image_size ) ) {
+        tile_pyramid_->set_image( fullpath_ref, image_size );
+    } else {
+        tile_pyramid_->set_image( QString(), QSize() );
+    }
+
+    tag_viewer_->set_image( QPixmap::fromImage( image ), image_size );
+    tag_viewer_->set_overlay_elements( get_display_elements( selection, fullpath_ref ) );
 
     // fit to view only if new image being displayed
     if( current_fullpath_ != fullpath_ref ) {
         tag_scroll_view_->fit_to_view();
         current_fullpath_ = fullpath_ref;
     }
+
+    show_highlighted_box();
+}
+
+QList<TagViewer::TagDisplayElement> MainWindow::get_display_elements(
+        const QModelIndexList& selection,
+        const QString& fullpath
+    ) const
+{
+    QList<TagViewer::TagDisplayElement> display_elements;
+    if( fullpath.isEmpty() ) {
+        return display_elements;
+    }
+
+    QList<TagItem::Elements> item_elts = tag_model_->get_elements( selection );
+
+    for( QList<TagItem::Elements>::iterator elt_itr = item_elts.begin(); elt_itr != item_elts.end(); ++elt_itr ) {
+        const TagItem::Elements& tag_elt = *elt_itr;
+
+        QString cur_fullpath = tag_elt._fullpath;
+        TagViewer::TagDisplayElement tag;
+
+        // if fullpath is empty, we are dealing with a label name
+        // therefore we need to find the item within that label
+        if( cur_fullpath.isEmpty() ) {
+            TagItem::Elements elt_from_label = tag_model_->get_element( fullpath, tag_elt._label );
+            tag._color = elt_from_label._color;
+            tag._label = elt_from_label._label;
+            tag._bbox = elt_from_label._bbox;
+
+        } else {
+            tag._color = tag_elt._color;
+            tag._label = tag_elt._label;
+            tag._bbox = tag_elt._bbox;
+        }
+
+        display_elements.append( tag );
+    }
+
+    return display_elements;
 }
 
 void MainWindow::update_tag_selector()
@@ -823,6 +1648,12 @@ void MainWindow::tag_image(
         return;
     }
 
+    // the viewer still shows the previous image while the selected one
+    // is decoding: its boxes must not be applied to the selected image
+    if( fullpath_ref != current_fullpath_ ) {
+        return;
+    }
+
     // ensure a label is selected
     QString label = label_selector_->currentText();
     if( label.isEmpty() ) {
@@ -871,6 +1702,12 @@ void MainWindow::untag_image(
         return;
     }
 
+    // the viewer still shows the previous image while the selected one
+    // is decoding: its boxes must not be applied to the selected image
+    if( fullpath_ref != current_fullpath_ ) {
+        return;
+    }
+
     // block viewer update as selection
     // will change --> allows viewer
     // to keep the same pixmap and scale factor
@@ -890,3 +1727,45 @@ void MainWindow::untag_image(
 
     update_viewer();
 }
+
+void MainWindow::auto_stretch_display()
+{
+    // the decoded image is not modified
+    QImage image;
+    QSize image_size;
+    if( current_fullpath_.isEmpty() || !image_loader_->cached( current_fullpath_, image, image_size ) ) {
+        return;
+    }
+
+    DisplayAdjustment adjustment = display_panel_->adjustment();
+    adjustment.auto_stretch( image );
+    display_panel_->set_adjustment( adjustment );
+    tag_viewer_->set_adjustment( adjustment );
+}
+
+void MainWindow::edit_tag(
+        const QString& label,
+        const QRect& bbox,
+        const QRect& new_bbox
+    )
+{
+    if( label.isEmpty() ) {
+        return;
+    }
+
+    QItemSelectionModel* selection_model = tag_view_->selectionModel();
+    if( !selection_model ) {
+        return;
+    }
+
+    // (see tag_image)
+    QString fullpath_ref = get_image_from_index_list( selection_model->selectedRows() );
+    if( fullpath_ref.isEmpty() || fullpath_ref != current_fullpath_ ) {
+        return;
+    }
+
+    // the box is replaced in place: the tree and the selection are unchanged
+    // and the viewer only repaints the old and new boxes
+    tag_model_->update_tag( fullpath_ref, label, bbox, new_bbox );
+    update_viewer();
+}
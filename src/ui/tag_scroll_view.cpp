@@ -1,11 +1,20 @@
 #include <ui/tag_scroll_view.h>
+#include <ui/tag_viewer.h>
 
 #include <QWheelEvent>
 #include <QScrollBar>
 
+namespace {
+    // zoom limits:
+    // the image is at least 10 pixels wide and high
+    // and can be zoomed up to 16 pixels per image pixel
+    const int MIN_DISPLAYED_SIZE = 10;
+    const float MAX_ZOOM = 16.;
+}
+
 TagScrollView::TagScrollView(
         QWidget* parent
-    ) : QScrollArea( parent )
+    ) : QAbstractScrollArea( parent ), viewer_( 0 ), zoom_( 1. )
 {
     setBackgroundRole( QPalette::Dark );
     setAutoFillBackground( true );
@@ -15,54 +24,181 @@ TagScrollView::~TagScrollView()
 {
 }
 
-void TagScrollView::zoom_in()
+void TagScrollView::set_viewer(
+        TagViewer* viewer
+    )
 {
-    // safeguard
-    QSize new_size = 1.25 * widget()->size();
-    if( qMax( new_size.width(), new_size.height() ) > 10 * qMax( size().width(), size().height() ) ) {
-        return;
-    }
+    viewer_ = viewer;
+    setViewport( viewer_ );
+    update_view();
+}
 
-    scale_by( 1.25 );
+void TagScrollView::zoom_in()
+{
+    scale_by( 1.25, viewport()->rect().center() );
 }
 
 void TagScrollView::zoom_out()
 {
-    // safeguard
-    QSize new_size = 0.8 * widget()->size();
-    if( qMin( new_size.width(), new_size.height() ) < 10 ) {
+    scale_by( 0.8, viewport()->rect().center() ); // = 1 / 1.25
+}
+
+void TagScrollView::fit_to_view()
+{
+    if( !viewer_ || viewer_->image_size().isEmpty() ) {
         return;
     }
 
-    scale_by( 0.8 ); // = 1 / 1.25
+    QSize image_size = viewer_->image_size();
+    QSize fitted_size = image_size;
+    fitted_size.scale( viewport()->size(), Qt::KeepAspectRatio );
+
+    zoom_ = float( fitted_size.width() ) / image_size.width();
+    adjust_scrollbars();
+    horizontalScrollBar()->setValue( 0 );
+    verticalScrollBar()->setValue( 0 );
+    update_view();
 }
 
-void TagScrollView::fit_to_view()
+void TagScrollView::ensure_visible(
+        const QRect& bbox,
+        int margin
+    )
 {
-    QSize widget_size = widget()->size();
-    widget_size.scale( size(), Qt::KeepAspectRatio );
-    widget()->resize( widget_size );
+    if( !viewer_ ) {
+        return;
+    }
+
+    QRect rect = viewer_->map_to_widget( bbox ).adjusted( -margin, -margin, margin, margin );
+    QRect visible = viewport()->rect();
+
+    // scrollbar values are the offsets of the view
+    if( rect.left() < visible.left() ) {
+        horizontalScrollBar()->setValue( horizontalScrollBar()->value() + rect.left() );
+    } else if( rect.right() > visible.right() ) {
+        horizontalScrollBar()->setValue( horizontalScrollBar()->value() + qMin( rect.left(), rect.right() - visible.right() ) );
+    }
+
+    if( rect.top() < visible.top() ) {
+        verticalScrollBar()->setValue( verticalScrollBar()->value() + rect.top() );
+    } else if( rect.bottom() > visible.bottom() ) {
+        verticalScrollBar()->setValue( verticalScrollBar()->value() + qMin( rect.top(), rect.bottom() - visible.bottom() ) );
+    }
 }
 
 void TagScrollView::scale_by(
-        float factor
+        float factor,
+        const QPoint& anchor
     )
 {
     if( factor <= 0. ) {
         return;
     }
 
-    widget()->resize( widget()->size() * factor );
+    set_zoom( zoom_ * factor, anchor );
+}
+
+void TagScrollView::set_zoom(
+        float zoom,
+        const QPoint& anchor
+    )
+{
+    if( !viewer_ || viewer_->image_size().isEmpty() ) {
+        return;
+    }
 
-    adjust_scrollbars( factor );
+    // safeguard
+    QSize image_size = viewer_->image_size();
+    float min_zoom = float( MIN_DISPLAYED_SIZE ) / qMin( image_size.width(), image_size.height() );
+    float max_zoom = qMax( MAX_ZOOM, min_zoom );
+    zoom = qBound( min_zoom, zoom, max_zoom );
+    if( zoom == zoom_ ) {
+        return;
+    }
+
+    // image point under the anchor
+    QPoint offset = viewer_->offset();
+    float image_x = ( anchor.x() + offset.x() ) / zoom_;
+    float image_y = ( anchor.y() + offset.y() ) / zoom_;
+
+    zoom_ = zoom;
+    adjust_scrollbars();
+
+    // setting the values calls scrollContentsBy only if they change
+    horizontalScrollBar()->setValue( int( image_x * zoom_ ) - anchor.x() );
+    verticalScrollBar()->setValue( int( image_y * zoom_ ) - anchor.y() );
+    update_view();
+}
+
+void TagScrollView::adjust_scrollbars()
+{
+    QSize zoomed_size( 0, 0 );
+    if( viewer_ ) {
+        zoomed_size = viewer_->image_size() * zoom_;
+    }
+    QSize visible_size = viewport()->size();
+
+    horizontalScrollBar()->setRange( 0, qMax( 0, zoomed_size.width() - visible_size.width() ) );
+    horizontalScrollBar()->setPageStep( visible_size.width() );
+    horizontalScrollBar()->setSingleStep( qMax( 1, visible_size.width() / 20 ) );
+
+    verticalScrollBar()->setRange( 0, qMax( 0, zoomed_size.height() - visible_size.height() ) );
+    verticalScrollBar()->setPageStep( visible_size.height() );
+    verticalScrollBar()->setSingleStep( qMax( 1, visible_size.height() / 20 ) );
+}
+
+void TagScrollView::update_view()
+{
+    if( !viewer_ ) {
+        return;
+    }
+
+    // images smaller than the viewport are centered
+    QSize zoomed_size = viewer_->image_size() * zoom_;
+    QSize visible_size = viewport()->size();
+
+    QPoint offset( horizontalScrollBar()->value(), verticalScrollBar()->value() );
+    if( zoomed_size.width() < visible_size.width() ) {
+        offset.setX( -( visible_size.width() - zoomed_size.width() ) / 2 );
+    }
+    if( zoomed_size.height() < visible_size.height() ) {
+        offset.setY( -( visible_size.height() - zoomed_size.height() ) / 2 );
+    }
+
+    viewer_->set_view( zoom_, offset );
 }
 
-void TagScrollView::adjust_scrollbars(
-        float factor
+void TagScrollView::scrollContentsBy(
+        int /*dx*/,
+        int /*dy*/
     )
 {
-    horizontalScrollBar()->setValue( int( factor * horizontalScrollBar()->value() + ( ( factor - 1 ) * horizontalScrollBar()->pageStep() / 2 ) ) );
-    verticalScrollBar()->setValue( int( factor * verticalScrollBar()->value() + ( ( factor - 1 ) * verticalScrollBar()->pageStep() / 2 ) ) );
+    update_view();
+}
+
+bool TagScrollView::viewportEvent(
+        QEvent* e
+    )
+{
+    switch( e->type() ) {
+    case QEvent::Paint:
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove:
+        // handled by the viewer itself
+        return false;
+
+    case QEvent::Resize:
+        adjust_scrollbars();
+        update_view();
+        return false;
+
+    default:
+        break;
+    }
+
+    return QAbstractScrollArea::viewportEvent( e );
 }
 
 void TagScrollView::wheelEvent(
@@ -75,12 +211,13 @@ void TagScrollView::wheelEvent(
             return;
         }
 
+        // zoom around the cursor
         if( angle.y() > 0 ) {
-            zoom_in();
+            scale_by( 1.25, e->pos() );
         } else if( angle.y() < 0 ) {
-            zoom_out();
+            scale_by( 0.8, e->pos() );
         }
     } else {
-        QScrollArea::wheelEvent(e);
+        QAbstractScrollArea::wheelEvent(e);
     }
 }
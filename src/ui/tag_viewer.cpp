@@ -1,14 +1,62 @@
 #include <ui/tag_viewer.h>
+#include <core/tag_painter.h>
+#include <core/tile_pyramid.h>
 
 #include <QPainter>
 #include <QMouseEvent>
+#include <QApplication>
+#include <QRegion>
+#include <QHash>
+#include <QPair>
+
+#include <algorithm>
+
+namespace {
+    // the background image is scaled once per zoom
+    // while its scaled size is at most this many widget areas
+    const int SCALED_CACHE_AREAS = 4;
+
+    // side of the handles of the selected box (in widget pixels)
+    const int HANDLE_SIZE = 8;
+
+    // orders the boxes so that two lists are diffed in a single pass
+    bool rect_less_than(
+            const QRect& r1,
+            const QRect& r2
+        )
+    {
+        if( r1.top() != r2.top() ) {
+            return r1.top() < r2.top();
+        }
+        if( r1.left() != r2.left() ) {
+            return r1.left() < r2.left();
+        }
+        if( r1.bottom() != r2.bottom() ) {
+            return r1.bottom() < r2.bottom();
+        }
+        return r1.right() < r2.right();
+    }
+}
+
+// corners first: they overlap the edge handles of small boxes
+const int TagViewer::HANDLES[HANDLE_COUNT] = {
+    LEFT_EDGE | TOP_EDGE, RIGHT_EDGE | TOP_EDGE, LEFT_EDGE | BOTTOM_EDGE, RIGHT_EDGE | BOTTOM_EDGE,
+    LEFT_EDGE, RIGHT_EDGE, TOP_EDGE, BOTTOM_EDGE
+};
 
 TagViewer::TagViewer(
         QWidget* parent
-    ) : QWidget( parent ), tagging_( false ), untagging_( false )
+    ) : QWidget( parent ), tagging_( false ), untagging_( false ), zoom_( 1. ), pyramid_( 0 ), edit_handle_( NO_HANDLE ), edit_dragged_( false )
 {
-    setBackgroundRole( QPalette::Base );
-    setAutoFillBackground( true );
+    setBackgroundRole( QPalette::Dark );
+
+    // the layer covers the whole widget (background included)
+    setAttribute( Qt::WA_OpaquePaintEvent );
+
+    // for highlighting the box under the mouse
+    setMouseTracking( true );
+
+    luts_ = adjustment_.make_luts();
 }
 
 TagViewer::~TagViewer()
@@ -19,6 +67,10 @@ void TagViewer::set_tagging_status(
         bool activate
     )
 {
+    update( rubber_band_rect() );
+    set_hovered_box( QRect() );
+    select_box( QString(), QRect() );
+
     tagging_ = activate;
     tag_start_ = QPoint( 0, 0 );
     tag_end_ = QPoint( 0, 0 );
@@ -32,85 +84,517 @@ void TagViewer::set_untagging_status(
     )
 {
     untagging_ = activate;
+    set_hovered_box( QRect() );
+    select_box( QString(), QRect() );
 
     QCursor cursor = activate? QCursor( Qt::ForbiddenCursor ) : QCursor( Qt::ArrowCursor );
     setCursor( cursor );
 }
 
-void TagViewer::enforce_boundary_conditions(
-        QPoint& p
+void TagViewer::set_adjustment(
+        const DisplayAdjustment& adjustment
     )
 {
-    int x = p.x();
-    int y = p.y();
+    if( adjustment == adjustment_ ) {
+        return;
+    }
+
+    // the tables are built once per setting
+    adjustment_ = adjustment;
+    luts_ = adjustment_.make_luts();
+    invalidate_layer( rect() );
+}
 
-    if( x < 0 ) {
-        p.setX( 0 );
+void TagViewer::set_image(
+        const QPixmap& pix,
+        const QSize& image_size
+    )
+{
+    QSize previous_size = image_size_;
+    pix_ = pix;
+    image_size_ = image_size.isValid()? image_size : pix.size();
+    scaled_pix_ = QPixmap();
+
+    // the index grid is sized for the image
+    if( image_size_ != previous_size ) {
+        box_index_.reset( image_size_ );
+        for( QList<TagDisplayElement>::const_iterator tag_itr = elts_.begin(); tag_itr != elts_.end(); ++tag_itr ) {
+            for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+                box_index_.insert( tag_itr->_label, *bbox_itr );
+            }
+        }
     }
 
-    if( y < 0 ) {
-        p.setY( 0 );
+    invalidate_layer( rect() );
+}
+
+void TagViewer::set_view(
+        float zoom,
+        const QPoint& offset
+    )
+{
+    if( zoom <= 0. ) {
+        return;
     }
 
-    if( x >= width() ) {
-        p.setX( width() - 3 );
+    if( zoom != zoom_ ) {
+        scaled_pix_ = QPixmap();
     }
 
-    if( y >= height() ) {
-        p.setY( height() - 3 );
+    zoom_ = zoom;
+    offset_ = offset;
+    invalidate_layer( rect() );
+
+    // large images are displayed through tiles instead
+    // 1 pixel of slack for the rounding of the fit to view size
+    if( !pix_.isNull() && !uses_tiles() && pix_.width() < image_size_.width() && image_size_.width() * zoom_ > pix_.width() + 1 ) {
+        emit resolution_needed();
     }
 }
 
-float TagViewer::scale_factor() const
+void TagViewer::set_overlay_elements(
+        const QList<TagViewer::TagDisplayElement>& elements
+    )
 {
-    float scale_factor = 1.;
+    // repaints what was and what is now drawn
+    // for the boxes which are not in both lists
+    QList<TagDisplayElement> removed = changed_elements( elts_, elements );
+    QList<TagDisplayElement> added = changed_elements( elements, elts_ );
+
+    QRegion dirty = painted_region( removed ) + painted_region( added );
+    if( highlighted_box_.isValid() ) {
+        dirty += highlight_rect( highlighted_box_ );
+    }
+    if( hovered_box_.isValid() ) {
+        dirty += highlight_rect( hovered_box_ );
+    }
+
+    elts_ = elements;
+    highlighted_box_ = QRect();
+    hovered_box_ = QRect();
 
-    if( !pix_.isNull() && !size().isNull() ) {
-        scale_factor = (float)(size().width()) / (float)(pix_.width());
+    for( QList<TagDisplayElement>::const_iterator tag_itr = removed.begin(); tag_itr != removed.end(); ++tag_itr ) {
+        for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+            box_index_.remove( tag_itr->_label, *bbox_itr );
+        }
+    }
+    for( QList<TagDisplayElement>::const_iterator tag_itr = added.begin(); tag_itr != added.end(); ++tag_itr ) {
+        for( QList<QRect>::const_iterator bbox_itr = tag_itr->_bbox.begin(); bbox_itr != tag_itr->_bbox.end(); ++bbox_itr ) {
+            box_index_.insert( tag_itr->_label, *bbox_itr );
+        }
     }
 
-    return scale_factor;
+    // the selection follows the edited box (see box_edited)
+    const TagDisplayElement* selected_tag = find_element( selected_label_ );
+    if( selected_box_.isValid() && ( !selected_tag || !selected_tag->_bbox.contains( selected_box_ ) ) ) {
+        select_box( QString(), QRect() );
+    } else {
+        update( selection_rect( selected_box_ ) );
+    }
+
+    // label texts are kept for the labels still displayed
+    QHash<QString, QStaticText> label_texts;
+    for( QList<TagDisplayElement>::const_iterator tag_itr = elts_.begin(); tag_itr != elts_.end(); ++tag_itr ) {
+        const QString& label = tag_itr->_label;
+        if( !label_texts.contains( label ) ) {
+            label_texts.insert( label, label_texts_.contains( label )? label_texts_.value( label ) : TagPainter::label_text( label ) );
+        }
+    }
+    label_texts_ = label_texts;
+
+    if( !dirty.isEmpty() ) {
+        invalidate_layer( dirty );
+    }
+}
+
+void TagViewer::set_highlighted_box(
+        const QRect& bbox
+    )
+{
+    if( highlighted_box_.isValid() ) {
+        invalidate_layer( highlight_rect( highlighted_box_ ) );
+    }
+
+    highlighted_box_ = bbox;
+
+    if( highlighted_box_.isValid() ) {
+        invalidate_layer( highlight_rect( highlighted_box_ ) );
+    }
+}
+
+QList<TagViewer::TagDisplayElement> TagViewer::changed_elements(
+        const QList<TagDisplayElement>& elements,
+        const QList<TagDisplayElement>& other_elements
+    )
+{
+    QList<TagDisplayElement> changed;
+
+    // boxes of the same label and color are drawn the same way
+    QHash< QPair<QString, QRgb>, const TagDisplayElement* > other_tags;
+    for( QList<TagDisplayElement>::const_iterator other_itr = other_elements.begin(); other_itr != other_elements.end(); ++other_itr ) {
+        QPair<QString, QRgb> key( other_itr->_label, other_itr->_color.rgba() );
+        if( !other_tags.contains( key ) ) {
+            other_tags.insert( key, &(*other_itr) );
+        }
+    }
+
+    for( QList<TagDisplayElement>::const_iterator tag_itr = elements.begin(); tag_itr != elements.end(); ++tag_itr ) {
+        const TagDisplayElement& tag = *tag_itr;
+        const TagDisplayElement* other_tag = other_tags.value( qMakePair( tag._label, tag._color.rgba() ), 0 );
+
+        // most labels are left unchanged
+        if( other_tag && other_tag->_bbox == tag._bbox ) {
+            continue;
+        }
+
+        TagDisplayElement changed_tag;
+        changed_tag._color = tag._color;
+        changed_tag._label = tag._label;
+
+        // both lists of boxes are sorted then walked once
+        QList<QRect> boxes = tag._bbox;
+        std::sort( boxes.begin(), boxes.end(), rect_less_than );
+        QList<QRect> other_boxes;
+        if( other_tag ) {
+            other_boxes = other_tag->_bbox;
+            std::sort( other_boxes.begin(), other_boxes.end(), rect_less_than );
+        }
+
+        QList<QRect>::const_iterator other_itr = other_boxes.begin();
+        for( QList<QRect>::const_iterator bbox_itr = boxes.begin(); bbox_itr != boxes.end(); ++bbox_itr ) {
+            while( other_itr != other_boxes.end() && rect_less_than( *other_itr, *bbox_itr ) ) {
+                ++other_itr;
+            }
+            if( other_itr == other_boxes.end() || *other_itr != *bbox_itr ) {
+                changed_tag._bbox.append( *bbox_itr );
+            }
+        }
+
+        if( !changed_tag._bbox.isEmpty() ) {
+            changed.append( changed_tag );
+        }
+    }
+
+    return changed;
 }
 
-int TagViewer::shortest_distance(
+QRegion TagViewer::painted_region(
+        const QList<TagDisplayElement>& elements
+    ) const
+{
+    QRegion region;
+    QFont font = TagPainter::label_font();
+    float scale_f = scale_factor();
+
+    for( QList<TagDisplayElement>::const_iterator tag_itr = elements.begin(); tag_itr != elements.end(); ++tag_itr ) {
+        const TagDisplayElement& tag = *tag_itr;
+        for( QList<QRect>::const_iterator bbox_itr = tag._bbox.begin(); bbox_itr != tag._bbox.end(); ++bbox_itr ) {
+            region += TagPainter::painted_rect( font, tag._label, *bbox_itr, scale_f ).translated( -offset_ );
+        }
+    }
+
+    return region;
+}
+
+bool TagViewer::pick_box(
         const QPoint& p,
-        const QRect& rect
+        BoxIndex::Box& found
+    ) const
+{
+    if( pix_.isNull() ) {
+        return false;
+    }
+
+    if( !untagging_ ) {
+        return box_index_.box_at( map_to_image( p ), found );
+    }
+
+    // removes the closest box only if it is deemed close enough
+    QPoint image_p = p;
+    enforce_boundary_conditions( image_p );
+    int distance_max = 200. / scale_factor();
+    return box_index_.nearest( map_to_image( image_p ), distance_max, found );
+}
+
+void TagViewer::set_hovered_box(
+        const QRect& bbox
+    )
+{
+    if( bbox == hovered_box_ ) {
+        return;
+    }
+
+    if( hovered_box_.isValid() ) {
+        invalidate_layer( highlight_rect( hovered_box_ ) );
+    }
+
+    hovered_box_ = bbox;
+
+    if( hovered_box_.isValid() ) {
+        invalidate_layer( highlight_rect( hovered_box_ ) );
+    }
+}
+
+QRect TagViewer::highlight_rect(
+        const QRect& bbox
+    ) const
+{
+    int margin = 3 * TagPainter::PEN_WIDTH;
+    return map_to_widget( bbox ).adjusted( -margin, -margin, margin, margin );
+}
+
+const TagViewer::TagDisplayElement* TagViewer::find_element(
+        const QString& label
+    ) const
+{
+    for( QList<TagDisplayElement>::const_iterator tag_itr = elts_.begin(); tag_itr != elts_.end(); ++tag_itr ) {
+        if( tag_itr->_label == label ) {
+            return &(*tag_itr);
+        }
+    }
+
+    return 0;
+}
+
+void TagViewer::select_box(
+        const QString& label,
+        const QRect& bbox
+    )
+{
+    // the selection is painted over the layer
+    if( selected_box_.isValid() ) {
+        update( selection_rect( edit_handle_ != NO_HANDLE? edited_box_ : selected_box_ ) );
+    }
+
+    selected_label_ = bbox.isValid()? label : QString();
+    selected_box_ = bbox;
+    edit_handle_ = NO_HANDLE;
+    edit_dragged_ = false;
+
+    if( selected_box_.isValid() ) {
+        update( selection_rect( selected_box_ ) );
+    }
+}
+
+QRect TagViewer::selection_rect(
+        const QRect& bbox
+    ) const
+{
+    if( !bbox.isValid() ) {
+        return QRect();
+    }
+
+    return map_to_widget( bbox ).adjusted( -HANDLE_SIZE, -HANDLE_SIZE, HANDLE_SIZE, HANDLE_SIZE );
+}
+
+QRect TagViewer::handle_rect(
+        const QRect& box,
+        int handle
+    )
+{
+    int x = ( handle & LEFT_EDGE )? box.left() : ( handle & RIGHT_EDGE )? box.x() + box.width() : box.center().x();
+    int y = ( handle & TOP_EDGE )? box.top() : ( handle & BOTTOM_EDGE )? box.y() + box.height() : box.center().y();
+    return QRect( x - HANDLE_SIZE / 2, y - HANDLE_SIZE / 2, HANDLE_SIZE, HANDLE_SIZE );
+}
+
+int TagViewer::handle_at(
+        const QPoint& p
+    ) const
+{
+    if( !selected_box_.isValid() ) {
+        return NO_HANDLE;
+    }
+
+    QRect box = map_to_widget( selected_box_ );
+    for( int i = 0; i < HANDLE_COUNT; ++i ) {
+        if( handle_rect( box, HANDLES[i] ).contains( p ) ) {
+            return HANDLES[i];
+        }
+    }
+
+    return box.contains( p )? MOVE_HANDLE : NO_HANDLE;
+}
+
+QRect TagViewer::dragged_box(
+        const QPoint& p
+    ) const
+{
+    QPoint delta = map_to_image( p ) - edit_start_;
+    QRect image_rect( QPoint( 0, 0 ), image_size_ );
+
+    // the whole box is moved within the image
+    if( edit_handle_ == MOVE_HANDLE ) {
+        int dx = qBound( image_rect.left() - selected_box_.left(), delta.x(), image_rect.right() - selected_box_.right() );
+        int dy = qBound( image_rect.top() - selected_box_.top(), delta.y(), image_rect.bottom() - selected_box_.bottom() );
+        return selected_box_.translated( dx, dy );
+    }
+
+    int left = selected_box_.left();
+    int top = selected_box_.top();
+    int right = selected_box_.right();
+    int bottom = selected_box_.bottom();
+
+    if( edit_handle_ & LEFT_EDGE ) {
+        left += delta.x();
+    }
+    if( edit_handle_ & TOP_EDGE ) {
+        top += delta.y();
+    }
+    if( edit_handle_ & RIGHT_EDGE ) {
+        right += delta.x();
+    }
+    if( edit_handle_ & BOTTOM_EDGE ) {
+        bottom += delta.y();
+    }
+
+    // edges dragged past the opposite edge flip the box
+    return QRect( QPoint( left, top ), QPoint( right, bottom ) ).normalized() & image_rect;
+}
+
+void TagViewer::draw_selection(
+        QPainter& p
     )
-{    
-    int top = rect.top();
-    int left = rect.left();
-    int bottom = rect.y() + rect.height(); // note from Qt doc --> retrieve the true y-coordinate
-    int right = rect.x() + rect.width(); // note from Qt doc --> retrieve the true x-coordinate
+{
+    bool editing = ( edit_handle_ != NO_HANDLE && edit_dragged_ );
+    QRect box = map_to_widget( editing? edited_box_ : selected_box_ );
+
+    // the box being edited is drawn over its original position
+    if( editing ) {
+        const TagDisplayElement* tag = find_element( selected_label_ );
+        p.setPen( QPen( tag? tag->_color : current_color_, TagPainter::PEN_WIDTH, Qt::DashLine ) );
+        p.setBrush( Qt::NoBrush );
+        p.drawRect( box );
+    }
 
+    p.setPen( QPen( Qt::black, 1 ) );
+    p.setBrush( Qt::white );
+    for( int i = 0; i < HANDLE_COUNT; ++i ) {
+        p.drawRect( handle_rect( box, HANDLES[i] ) );
+    }
+    p.setBrush( Qt::NoBrush );
+}
+
+QRect TagViewer::rubber_band_rect() const
+{
+    if( !tagging_ || tag_start_ == tag_end_ ) {
+        return QRect();
+    }
+
+    // already in widget coordinates
+    QRect band = QRect( tag_start_, tag_end_ ).normalized();
+    return TagPainter::painted_rect( TagPainter::label_font(), current_label_, band, 1. );
+}
+
+void TagViewer::invalidate_layer(
+        const QRegion& region
+    )
+{
+    layer_dirty_ += region;
+    update( region );
+}
+
+QRect TagViewer::map_to_widget(
+        const QRect& bbox
+    ) const
+{
+    float scale_f = scale_factor();
+    return QRect( int( bbox.x() * scale_f ) - offset_.x(), int( bbox.y() * scale_f ) - offset_.y(), int( bbox.width() * scale_f ), int( bbox.height() * scale_f ) );
+}
+
+QPoint TagViewer::map_to_image(
+        const QPoint& p
+    ) const
+{
+    float scale_f = scale_factor();
+    return QPoint( int( ( p.x() + offset_.x() ) / scale_f ), int( ( p.y() + offset_.y() ) / scale_f ) );
+}
+
+QRect TagViewer::image_area() const
+{
+    return map_to_widget( QRect( QPoint( 0, 0 ), image_size_ ) );
+}
+
+void TagViewer::enforce_boundary_conditions(
+        QPoint& p
+    ) const
+{
+    QRect area = image_area();
     int x = p.x();
     int y = p.y();
 
-    // if x (resp. y ) in between rectangle left & right (resp. top and bottom)
-    // --> count a distance of 0
-    int dx = ( x < right && x > left )? 0 : qMin( abs( left - x ), abs( right - x ) );
-    int dy = ( y < bottom && y > top )? 0 : qMin( abs( bottom - y ), abs( top - y ) );
+    if( x < area.left() ) {
+        p.setX( area.left() );
+    }
+
+    if( y < area.top() ) {
+        p.setY( area.top() );
+    }
 
-    return ( dx * dx + dy * dy );
+    if( x > area.right() ) {
+        p.setX( area.right() - 2 );
+    }
+
+    if( y > area.bottom() ) {
+        p.setY( area.bottom() - 2 );
+    }
+}
+
+float TagViewer::scale_factor() const
+{
+    return zoom_;
 }
 
 void TagViewer::paintEvent(
-        QPaintEvent* /*e*/
+        QPaintEvent* e
     )
 {
+    if( size().isEmpty() ) {
+        return;
+    }
+
+    // the layer is only re-rendered where it changed
+    if( layer_.size() != size() ) {
+        layer_ = QPixmap( size() );
+        layer_dirty_ = QRegion( rect() );
+    }
+
+    if( !layer_dirty_.isEmpty() ) {
+        QPainter layer_p( &layer_ );
+        layer_p.setClipRegion( layer_dirty_ );
+        render_layer( layer_p, layer_dirty_.boundingRect() );
+        layer_dirty_ = QRegion();
+    }
+
     QPainter p( this );
+    p.drawPixmap( e->rect().topLeft(), layer_, e->rect() );
 
-    float scale_f = scale_factor();
-    QRect drawing_area( 0, 0, size().width(), size().height() );
+    // draw current box being tagged
+    if( tagging_ && tag_start_ != tag_end_ ) {
+        QRect current_rect = QRect( tag_start_, tag_end_ ).normalized();
+        TagPainter::set_label_font( p );
+        p.setPen( QPen( current_color_, TagPainter::PEN_WIDTH ) );
+        p.drawRect( current_rect );
+        p.drawText( current_rect.x(), current_rect.y(), current_label_ );
+    }
 
-    if( !pix_.isNull() && !size().isNull() ) {
-        p.drawPixmap( drawing_area, pix_ );
+    if( selected_box_.isValid() ) {
+        draw_selection( p );
+    }
+}
 
-    } else {
+void TagViewer::render_layer(
+        QPainter& p,
+        const QRect& area
+    )
+{
+    p.fillRect( area, palette().brush( backgroundRole() ) );
+
+    if( pix_.isNull() ) {
         QTextOption options( Qt::AlignLeft );
         options.setWrapMode( QTextOption::WordWrap );
         p.setPen( QPen( Qt::red, 4 ) );
         p.drawText(
-            QRectF( drawing_area ),
+            QRectF( rect() ),
             "Image cannot be displayed. Check:\n"
             " - the same image is selected among the multiple selection (it's ok to select labels)\n"
             " - the image file is still at the same disk location when imported\n"
@@ -121,33 +605,157 @@ void TagViewer::paintEvent(
         return;
     }
 
-    QFont font;
-    font.setPointSize( 10 );
-    p.setFont( font );
+    QRect exposed = area & image_area();
+    if( adjustment_.is_identity() ) {
+        draw_background( p, exposed );
+        draw_tiles( p, exposed );
+    } else {
+        draw_adjusted_image( p, exposed );
+    }
+
+    float scale_f = scale_factor();
+    TagPainter::set_label_font( p );
 
     // draw bounding boxes
-    for( QList<TagDisplayElement>::iterator tag_itr = elts_.begin(); tag_itr != elts_.end(); ++tag_itr ) {
+    // (only the ones within the area, one batch per label)
+    p.translate( -offset_ );
+    QRect clip = area.translated( offset_ );
+    for( QList<TagDisplayElement>::const_iterator tag_itr = elts_.begin(); tag_itr != elts_.end(); ++tag_itr ) {
         const TagDisplayElement& tag = *tag_itr;
-        const QList<QRect>& bbox = tag._bbox;
+        TagPainter::draw_tags( p, tag._color, label_texts_.value( tag._label ), tag._bbox, scale_f, clip );
+    }
+    p.translate( offset_ );
 
-        p.setPen( QPen( tag._color, 2 ) );
+    // shades the box under the mouse
+    // (in red for the one to be removed)
+    if( hovered_box_.isValid() ) {
+        QColor shade = untagging_? QColor( 255, 0, 0, 64 ) : QColor( 255, 255, 255, 48 );
+        p.fillRect( map_to_widget( hovered_box_ ), shade );
+    }
 
-        for( QList<QRect>::const_iterator bbox_itr = bbox.begin(); bbox_itr != bbox.end(); ++bbox_itr ) {
-            const QRect& box_rect = *bbox_itr;
-            QRect scaled_box( scale_f * box_rect.topLeft(), scale_f * box_rect.bottomRight() );
-            p.drawRect( scaled_box );
-            p.drawText( scaled_box.x(), scaled_box.y(), tag._label );
-        }
+    // outline the highlighted box so that it stands out of its neighbors
+    if( highlighted_box_.isValid() ) {
+        QRect outline = map_to_widget( highlighted_box_ ).adjusted( -2 * TagPainter::PEN_WIDTH, -2 * TagPainter::PEN_WIDTH, 2 * TagPainter::PEN_WIDTH, 2 * TagPainter::PEN_WIDTH );
+        p.setPen( QPen( Qt::white, TagPainter::PEN_WIDTH, Qt::DashLine ) );
+        p.drawRect( outline );
+    }
+}
+
+void TagViewer::draw_background(
+        QPainter& p,
+        const QRect& exposed
+    )
+{
+    QRect area = image_area();
+    if( exposed.isEmpty() || area.isEmpty() ) {
+        return;
     }
 
-    // draw current box being tagged
-    p.setPen( QPen( current_color_, 2 ) );
-    if( tagging_ && tag_start_ != tag_end_ ) {
-        QRect current_rect( tag_start_, tag_end_ );
-        p.drawRect( current_rect );
-        p.drawText( current_rect.x(), current_rect.y(), current_label_ );
+    // scrolling only copies the cached pixmap
+    if( scaled_pix_.size() != area.size() &&
+        qint64( area.width() ) * area.height() <= SCALED_CACHE_AREAS * qint64( width() ) * height()
+    ) {
+        scaled_pix_ = pix_.scaled( area.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
     }
 
+    if( scaled_pix_.size() == area.size() ) {
+        p.drawPixmap( exposed.topLeft(), scaled_pix_, exposed.translated( -area.topLeft() ) );
+        return;
+    }
+
+    // too large to be cached at this zoom: only the exposed part is scaled
+    QRect source_area = exposed.translated( -area.topLeft() );
+    float pix_scale_x = float( pix_.width() ) / area.width();
+    float pix_scale_y = float( pix_.height() ) / area.height();
+    QRectF source( source_area.x() * pix_scale_x, source_area.y() * pix_scale_y, source_area.width() * pix_scale_x, source_area.height() * pix_scale_y );
+    p.drawPixmap( QRectF( exposed ), pix_, source );
+}
+
+void TagViewer::draw_adjusted_image(
+        QPainter& p,
+        const QRect& exposed
+    )
+{
+    if( exposed.isEmpty() ) {
+        return;
+    }
+
+    // the cost only depends on the painted area (at most the widget)
+    // whatever the size of the image
+    QImage region( exposed.size(), QImage::Format_RGB32 );
+    region.fill( palette().color( backgroundRole() ) );
+    QPainter region_p( &region );
+    region_p.translate( -exposed.topLeft() );
+    draw_background( region_p, exposed );
+    draw_tiles( region_p, exposed );
+    region_p.end();
+
+    DisplayAdjustment::apply( luts_, region );
+    p.drawImage( exposed.topLeft(), region );
+}
+
+void TagViewer::set_tile_pyramid(
+        TilePyramid* pyramid
+    )
+{
+    if( pyramid_ ) {
+        disconnect( pyramid_, 0, this, 0 );
+    }
+
+    pyramid_ = pyramid;
+
+    if( pyramid_ ) {
+        connect( pyramid_, SIGNAL( tile_ready(QRect) ), this, SLOT( update_image_rect(QRect) ) );
+    }
+}
+
+void TagViewer::update_image_rect(
+        const QRect& image_rect
+    )
+{
+    invalidate_layer( map_to_widget( image_rect ).adjusted( -1, -1, 1, 1 ) );
+}
+
+bool TagViewer::uses_tiles() const
+{
+    return pyramid_ && pyramid_->is_active() && pyramid_->image_size() == image_size_;
+}
+
+void TagViewer::draw_tiles(
+        QPainter& p,
+        const QRect& exposed
+    )
+{
+    if( !uses_tiles() ) {
+        return;
+    }
+
+    // tiles are only needed above the resolution of the background pixmap
+    float scale_f = scale_factor();
+    int level = pyramid_->level_for_scale( scale_f );
+    if( float( image_size_.width() >> level ) <= float( pix_.width() ) ) {
+        return;
+    }
+
+    // the tiles of the whole widget are requested
+    // (exposed may only be a part of it)
+    QRect visible_image( map_to_image( rect().topLeft() ), map_to_image( rect().bottomRight() ) );
+    pyramid_->request( level, pyramid_->tile_range( level, visible_image ) );
+
+    QRect exposed_image( map_to_image( exposed.topLeft() ), map_to_image( exposed.bottomRight() ) );
+    QRect tiles = pyramid_->tile_range( level, exposed_image );
+    for( int row = tiles.top(); row <= tiles.bottom(); ++row ) {
+        for( int col = tiles.left(); col <= tiles.right(); ++col ) {
+            QImage tile = pyramid_->tile( level, col, row );
+            if( tile.isNull() ) {
+                continue;
+            }
+
+            QRect tile_rect = pyramid_->tile_rect( level, col, row );
+            QRectF target( tile_rect.x() * scale_f - offset_.x(), tile_rect.y() * scale_f - offset_.y(), tile_rect.width() * scale_f, tile_rect.height() * scale_f );
+            p.drawImage( target, tile );
+        }
+    }
 }
 
 void TagViewer::mousePressEvent(
@@ -164,33 +772,32 @@ void TagViewer::mousePressEvent(
         tag_end_ = tag_start_;
 
     } else if( untagging_ ) {
-        // searches the closest rectangle to the picked point
-        // removes it only if point is deemed close enough
-        // there won't be tons of label per image, so a brute force search
-        // is perfectly acceptable, no need to go into quad-tree
-        float scale_f = scale_factor();
-        QRect rect_found;
-        QString label_found;
-        int distance_min = 200. / scale_f;
-        QPoint p = e->pos();
-        enforce_boundary_conditions( p );
-        p /= scale_f;
-
-        for( QList<TagDisplayElement>::iterator tag_itr = elts_.begin(); tag_itr != elts_.end(); ++tag_itr ) {
-            const TagDisplayElement& tag = *tag_itr;
-            const QList<QRect>& bbox = tag._bbox;
-
-            for( QList<QRect>::const_iterator bbox_itr = bbox.begin(); bbox_itr != bbox.end(); ++bbox_itr ) {
-                int d = shortest_distance( p, *bbox_itr );
-                if( d < distance_min ) {
-                    distance_min = d;
-                    label_found = tag._label;
-                    rect_found = *bbox_itr;
-                }
+        BoxIndex::Box found;
+        if( pick_box( e->pos(), found ) ) {
+            emit( untagged( found._label, found._bbox ) );
+        }
+
+    } else {
+        // picks another box unless a handle of the selected one is grabbed
+        // the picked box can be moved right away
+        // (the edit starts once the mouse is dragged far enough)
+        int handle = handle_at( e->pos() );
+        if( handle == NO_HANDLE ) {
+            BoxIndex::Box found;
+            if( pick_box( e->pos(), found ) ) {
+                select_box( found._label, found._bbox );
+                handle = MOVE_HANDLE;
+            } else {
+                select_box( QString(), QRect() );
             }
         }
-        if( !label_found.isEmpty() && rect_found.isValid() ) {
-            emit( untagged( label_found, rect_found ) );
+
+        if( handle != NO_HANDLE ) {
+            edit_handle_ = handle;
+            edit_dragged_ = false;
+            edit_press_ = e->pos();
+            edit_start_ = map_to_image( e->pos() );
+            edited_box_ = selected_box_;
         }
     }
 }
@@ -199,31 +806,110 @@ void TagViewer::mouseMoveEvent(
         QMouseEvent* e
     )
 {
+    // only the old and new edited boxes are repainted
+    if( edit_handle_ != NO_HANDLE && ( e->buttons() & Qt::LeftButton ) ) {
+        // a click jitter does not edit the box
+        if( !edit_dragged_ ) {
+            if( ( e->pos() - edit_press_ ).manhattanLength() < QApplication::startDragDistance() ) {
+                return;
+            }
+            edit_dragged_ = true;
+        }
+
+        QRect old_rect = selection_rect( edited_box_ );
+        edited_box_ = dragged_box( e->pos() );
+        update( QRegion( old_rect ) + selection_rect( edited_box_ ) );
+        return;
+    }
+
     if( !tagging_ ) {
+        BoxIndex::Box found;
+        set_hovered_box( pick_box( e->pos(), found )? found._bbox : QRect() );
+
+        // shows what dragging the mouse would do
+        if( !untagging_ ) {
+            switch( handle_at( e->pos() ) ) {
+            case LEFT_EDGE | TOP_EDGE:
+            case RIGHT_EDGE | BOTTOM_EDGE:
+                setCursor( Qt::SizeFDiagCursor );
+                break;
+            case RIGHT_EDGE | TOP_EDGE:
+            case LEFT_EDGE | BOTTOM_EDGE:
+                setCursor( Qt::SizeBDiagCursor );
+                break;
+            case LEFT_EDGE:
+            case RIGHT_EDGE:
+                setCursor( Qt::SizeHorCursor );
+                break;
+            case TOP_EDGE:
+            case BOTTOM_EDGE:
+                setCursor( Qt::SizeVerCursor );
+                break;
+            case MOVE_HANDLE:
+                setCursor( Qt::SizeAllCursor );
+                break;
+            default:
+                setCursor( Qt::ArrowCursor );
+            }
+        }
+        return;
+    }
+
+    // the mouse is tracked for hovering
+    if( !( e->buttons() & Qt::LeftButton ) ) {
         return;
     }
 
+    // only the old and new boxes are repainted (from the layer)
+    // update() merges the moves between two repaints
+    QRect old_band = rubber_band_rect();
     tag_end_ = e->pos();
     enforce_boundary_conditions( tag_end_ );
-    repaint();
 
+    QRegion dirty = QRegion( old_band ) + rubber_band_rect();
+    if( !dirty.isEmpty() ) {
+        update( dirty );
+    }
 }
 
 void TagViewer::mouseReleaseEvent(
         QMouseEvent* e
      )
 {
-    if( !tagging_ || e->button() != Qt::LeftButton ) {
+    if( e->button() != Qt::LeftButton ) {
+        return;
+    }
+
+    // the edited box replaces the selected box
+    // once the model has been updated (see set_overlay_elements)
+    if( edit_handle_ != NO_HANDLE ) {
+        QRect bbox = selected_box_;
+        QRect new_bbox = edited_box_;
+        update( selection_rect( bbox ) );
+        update( selection_rect( new_bbox ) );
+
+        bool dragged = edit_dragged_;
+        edit_handle_ = NO_HANDLE;
+        edit_dragged_ = false;
+        if( dragged && new_bbox.isValid() && new_bbox != bbox ) {
+            selected_box_ = new_bbox;
+            emit( box_edited( selected_label_, bbox, new_bbox ) );
+        }
+        return;
+    }
+
+    if( !tagging_ ) {
         return;
     }
 
+    // the box being drawn is cleared
+    update( rubber_band_rect() );
+
     tag_end_ = e->pos();
     enforce_boundary_conditions( tag_end_ );
 
-    float scale_f = scale_factor();
-
     // make a valid rectangle
-    QRect tag( tag_start_ / scale_f, tag_end_ / scale_f );
+    QRect tag( map_to_image( tag_start_ ), map_to_image( tag_end_ ) );
     int left = tag.left();
     int top = tag.top();
     if( left > tag.right() ) {
@@ -240,3 +926,11 @@ void TagViewer::mouseReleaseEvent(
     tag_start_ = QPoint( 0, 0 );
     tag_end_ = QPoint( 0, 0 );
 }
+
+void TagViewer::leaveEvent(
+        QEvent* e
+    )
+{
+    set_hovered_box( QRect() );
+    QWidget::leaveEvent( e );
+}
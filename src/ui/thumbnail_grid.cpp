@@ -0,0 +1,228 @@
+#include <ui/thumbnail_grid.h>
+#include <core/thumbnail_cache.h>
+#include <core/tag_model.h>
+#include <core/tag_painter.h>
+
+#include <QPainter>
+#include <QFileInfo>
+
+namespace {
+    // cell layout
+    const int CELL_MARGIN = 4;
+    const int TEXT_HEIGHT = 16;
+
+    // thumbnails kept in memory (in KB)
+    const int PIXMAP_CACHE_SIZE = 128 * 1024;
+}
+
+
+ThumbnailGridModel::ThumbnailGridModel(
+        QObject* parent
+    ) : LazyListModel( PIXMAP_CACHE_SIZE, parent )
+{
+    // a pool of its own so that canceling requests
+    // does not cancel the import prefetch
+    thumbnail_cache_ = new ThumbnailCache( this );
+
+    connect(
+        thumbnail_cache_, SIGNAL( thumbnail_ready(QString,int,QImage) ),
+        this, SLOT( add_thumbnail(QString,int,QImage) ),
+        Qt::QueuedConnection
+    );
+}
+
+ThumbnailGridModel::~ThumbnailGridModel()
+{
+}
+
+void ThumbnailGridModel::set_images(
+        const QString& label,
+        const QStringList& paths
+    )
+{
+    drop_requests();
+
+    beginResetModel();
+    label_ = label;
+    paths_ = paths;
+    endResetModel();
+}
+
+int ThumbnailGridModel::rowCount(
+        const QModelIndex& parent
+    ) const
+{
+    return parent.isValid()? 0 : paths_.count();
+}
+
+QVariant ThumbnailGridModel::data(
+        const QModelIndex& index,
+        int role
+    ) const
+{
+    if( !index.isValid() || index.row() >= paths_.count() ) {
+        return QVariant();
+    }
+
+    const QString& path = paths_.at( index.row() );
+
+    if( role == Qt::DisplayRole ) {
+        return QVariant( QFileInfo( path ).fileName() );
+
+    } else if( role == Qt::ToolTipRole || role == FullpathRole ) {
+        return QVariant( path );
+
+    } else if( role == ImageSizeRole ) {
+        return QVariant( image_sizes_.value( path ) );
+
+    } else if( role == Qt::DecorationRole ) {
+        return decoration( index.row() );
+    }
+
+    return QVariant();
+}
+
+QString ThumbnailGridModel::pixmap_key(
+        int row
+    ) const
+{
+    return paths_.at( row );
+}
+
+void ThumbnailGridModel::load_pixmaps(
+        const QList<int>& rows,
+        int priority
+    )
+{
+    QStringList paths;
+    for( QList<int>::const_iterator row_itr = rows.begin(); row_itr != rows.end(); ++row_itr ) {
+        paths.append( paths_.at( *row_itr ) );
+    }
+    thumbnail_cache_->prefetch( paths, ThumbnailCache::NORMAL_SIZE, priority );
+}
+
+void ThumbnailGridModel::cancel_loading()
+{
+    thumbnail_cache_->cancel();
+}
+
+void ThumbnailGridModel::add_thumbnail(
+        const QString& path,
+        int /*size*/,
+        const QImage& thumb
+    )
+{
+    image_sizes_.insert( path, QSize( thumb.text( "Thumb::Image::Width" ).toInt(), thumb.text( "Thumb::Image::Height" ).toInt() ) );
+    add_pixmap( path, thumb );
+}
+
+
+ThumbnailDelegate::ThumbnailDelegate(
+        TagModel* tag_model,
+        QObject* parent
+    ) : QStyledItemDelegate( parent ), tag_model_( tag_model )
+{
+}
+
+ThumbnailDelegate::~ThumbnailDelegate()
+{
+}
+
+QSize ThumbnailDelegate::sizeHint(
+        const QStyleOptionViewItem& /*option*/,
+        const QModelIndex& /*index*/
+    ) const
+{
+    int side = ThumbnailCache::NORMAL_SIZE + 2 * CELL_MARGIN;
+    return QSize( side, side + TEXT_HEIGHT );
+}
+
+void ThumbnailDelegate::paint(
+        QPainter* painter,
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index
+    ) const
+{
+    const QRect& cell = option.rect;
+
+    painter->save();
+    painter->setClipRect( cell );
+
+    if( option.state & QStyle::State_Selected ) {
+        painter->fillRect( cell, option.palette.highlight() );
+    }
+
+    QRect thumb_rect( cell.x() + CELL_MARGIN, cell.y() + CELL_MARGIN, ThumbnailCache::NORMAL_SIZE, ThumbnailCache::NORMAL_SIZE );
+    QPixmap pix = index.data( Qt::DecorationRole ).value<QPixmap>();
+
+    if( pix.isNull() ) {
+        painter->fillRect( thumb_rect, option.palette.midlight() );
+
+    } else {
+        QPoint origin = thumb_rect.center() - QPoint( pix.width() / 2, pix.height() / 2 );
+        painter->drawPixmap( origin, pix );
+
+        // boxes of the shown label only (all labels for ALL)
+        QSize image_size = index.data( ThumbnailGridModel::ImageSizeRole ).toSize();
+        const ThumbnailGridModel* grid_model = qobject_cast<const ThumbnailGridModel*>( index.model() );
+        if( tag_model_ && grid_model && image_size.width() > 0 ) {
+            const QString& label = grid_model->label();
+            QList<TagItem::Elements> elts = tag_model_->get_image_elements( index.data( ThumbnailGridModel::FullpathRole ).toString() );
+
+            painter->translate( origin );
+            for( QList<TagItem::Elements>::const_iterator elt_itr = elts.begin(); elt_itr != elts.end(); ++elt_itr ) {
+                if( label != TagModel::ALL && elt_itr->_label != label ) {
+                    continue;
+                }
+                // labels would not be readable at this scale
+                TagPainter::draw_tags( *painter, elt_itr->_color, QString(), elt_itr->_bbox, float( pix.width() ) / image_size.width() );
+            }
+            painter->translate( -origin );
+        }
+    }
+
+    QRect text_rect( cell.x() + CELL_MARGIN, thumb_rect.bottom() + 1, cell.width() - 2 * CELL_MARGIN, TEXT_HEIGHT );
+    QString text = option.fontMetrics.elidedText( index.data( Qt::DisplayRole ).toString(), Qt::ElideMiddle, text_rect.width() );
+    painter->setPen( option.palette.color( ( option.state & QStyle::State_Selected )? QPalette::HighlightedText : QPalette::Text ) );
+    painter->drawText( text_rect, Qt::AlignCenter, text );
+
+    painter->restore();
+}
+
+
+ThumbnailGrid::ThumbnailGrid(
+        TagModel* tag_model,
+        QWidget* parent
+    ) : LazyListView( parent )
+{
+    grid_model_ = new ThumbnailGridModel( this );
+    setModel( grid_model_ );
+    setItemDelegate( new ThumbnailDelegate( tag_model, this ) );
+    setSelectionMode( QAbstractItemView::ExtendedSelection );
+
+    connect( this, SIGNAL( activated(QModelIndex) ), this, SLOT( activate(QModelIndex) ) );
+}
+
+ThumbnailGrid::~ThumbnailGrid()
+{
+}
+
+void ThumbnailGrid::set_images(
+        const QString& label,
+        const QStringList& paths
+    )
+{
+    grid_model_->set_images( label, paths );
+    scrollToTop();
+}
+
+void ThumbnailGrid::activate(
+        const QModelIndex& index
+    )
+{
+    if( !index.isValid() ) {
+        return;
+    }
+
+    emit image_activated( index.data( ThumbnailGridModel::FullpathRole ).toString(), grid_model_->label() );
+}